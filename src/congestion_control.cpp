@@ -0,0 +1,582 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// Custom headers.
+#include "congestion_control.h"
+
+/** Pacing rate as a multiple of the window per RTT, in slow start. */
+static const double SLOW_START_PACING_GAIN = 2;
+
+/** Pacing rate as a multiple of the window per RTT, after slow start. */
+static const double PACING_GAIN = 1.2;
+
+constexpr double cubic_control::C;
+constexpr double cubic_control::BETA;
+constexpr double vegas_control::ALPHA;
+constexpr double vegas_control::BETA;
+constexpr double vegas_control::GAMMA;
+constexpr double dctcp_control::G;
+
+// -------------------------- congestion_control class ------------------------
+
+congestion_control::congestion_control(const netflow &flow, double window) :
+		flow(&flow), window(window), threshold(-1), pacing(false) { }
+
+congestion_control::~congestion_control() { }
+
+congestion_control *congestion_control::makeCongestionControl(cc_type type,
+		const netflow &flow, double window) {
+	switch (type) {
+	case TAHOE_CC:
+		return new tahoe_control(flow, window);
+	case RENO_CC:
+		return new reno_control(flow, window);
+	case NEWRENO_CC:
+		return new newreno_control(flow, window);
+	case CUBIC_CC:
+		return new cubic_control(flow, window);
+	case VEGAS_CC:
+		return new vegas_control(flow, window);
+	case FAST_CC:
+		return new fast_control(flow, window);
+	case BBR_CC:
+		return new bbr_control(flow, window);
+	case DCTCP_CC:
+		return new dctcp_control(flow, window);
+	default:
+		assert(false);
+	}
+	return NULL;
+}
+
+bool congestion_control::parseCongestionControlType(const string &name,
+		cc_type &type) {
+	if (name == "tahoe") {
+		type = TAHOE_CC;
+		return true;
+	}
+	if (name == "reno") {
+		type = RENO_CC;
+		return true;
+	}
+	if (name == "newreno") {
+		type = NEWRENO_CC;
+		return true;
+	}
+	if (name == "cubic") {
+		type = CUBIC_CC;
+		return true;
+	}
+	if (name == "vegas") {
+		type = VEGAS_CC;
+		return true;
+	}
+	if (name == "fast") {
+		type = FAST_CC;
+		return true;
+	}
+	if (name == "bbr") {
+		type = BBR_CC;
+		return true;
+	}
+	if (name == "dctcp") {
+		type = DCTCP_CC;
+		return true;
+	}
+	return false;
+}
+
+bool congestion_control::inSlowStart() const {
+	return threshold < 0 || window < threshold;
+}
+
+int congestion_control::getInFlight() const {
+	return max(0, flow->getHighestSentSeqnum() - flow->getHighestAckSeqnum()
+			+ 1);
+}
+
+void congestion_control::onRttSample(double rtt, double now) { }
+
+bool congestion_control::isEcnCapable() const { return false; }
+
+void congestion_control::onEcnEcho(int num_marked, double now) { }
+
+double congestion_control::getUpdateInterval() const { return 0; }
+
+void congestion_control::onUpdate(double now) { }
+
+double congestion_control::getPacingRate() const {
+	if (!pacing || flow->getAvgRTT() <= 0) {
+		return 0;
+	}
+	return (inSlowStart() ? SLOW_START_PACING_GAIN : PACING_GAIN) *
+			max(window, (double) getInFlight()) / flow->getAvgRTT();
+}
+
+double congestion_control::getWindow() const { return window; }
+
+double congestion_control::getThreshold() const { return threshold; }
+
+void congestion_control::setPacing(bool pacing) { this->pacing = pacing; }
+
+// ------------------------------ tahoe_control class -------------------------
+
+tahoe_control::tahoe_control(const netflow &flow, double window) :
+		congestion_control(flow, window) { }
+
+void tahoe_control::onAck(int num_acked, double now) {
+	for (int i = 0; i < num_acked; i++) {
+		if (inSlowStart()) {
+			window++;
+		}
+		else {
+			window += 1 / window;
+		}
+	}
+}
+
+void tahoe_control::onDupAck(int num_dups, double now) {
+	if (num_dups >= netflow::FAST_RETRANSMIT_DUPLICATE_ACK_THRESHOLD) {
+		threshold = window / 2;
+		window = 1;
+	}
+}
+
+void tahoe_control::onTimeout() {
+	threshold = window / 2;
+	window = 1;
+}
+
+// ------------------------------ reno_control class --------------------------
+
+reno_control::reno_control(const netflow &flow, double window) :
+		tahoe_control(flow, window) { }
+
+void reno_control::halveWindow() {
+	threshold = max(window / 2, 2.0);
+	window = threshold;
+}
+
+void reno_control::onDupAck(int num_dups, double now) {
+	if (num_dups >= netflow::FAST_RETRANSMIT_DUPLICATE_ACK_THRESHOLD) {
+		halveWindow();
+	}
+}
+
+void reno_control::onTimeout() {
+	threshold = max(window / 2, 2.0);
+	window = 1;
+}
+
+// ----------------------------- newreno_control class ------------------------
+
+newreno_control::newreno_control(const netflow &flow, double window) :
+		reno_control(flow, window), recover(-1) { }
+
+void newreno_control::onAck(int num_acked, double now) {
+	if (recover != -1) {
+		if (flow->getHighestAckSeqnum() <= recover) {
+			return; // a partial ACK; the window stays put until recovery ends
+		}
+		recover = -1;
+	}
+	reno_control::onAck(num_acked, now);
+}
+
+void newreno_control::onDupAck(int num_dups, double now) {
+	if (num_dups < netflow::FAST_RETRANSMIT_DUPLICATE_ACK_THRESHOLD) {
+		return;
+	}
+
+	// Another loss from the window that's already being recovered.
+	if (recover != -1 && flow->getHighestAckSeqnum() <= recover) {
+		return;
+	}
+	recover = flow->getHighestSentSeqnum();
+	halveWindow();
+}
+
+void newreno_control::onTimeout() {
+	recover = -1;
+	reno_control::onTimeout();
+}
+
+// ------------------------------ cubic_control class -------------------------
+
+cubic_control::cubic_control(const netflow &flow, double window) :
+		reno_control(flow, window), last_max_window(0), epoch_start(-1),
+		k(0), origin(0), reno_window(0) { }
+
+void cubic_control::startOver() {
+	epoch_start = -1;
+
+	// Fast convergence: if this loss came sooner than the last, give up
+	// some more bandwidth to newer flows.
+	last_max_window = window < last_max_window ?
+			window * (1 + BETA) / 2 : window;
+}
+
+void cubic_control::halveWindow() {
+	startOver();
+	threshold = max(window * BETA, 2.0);
+	window = threshold;
+}
+
+void cubic_control::onAck(int num_acked, double now) {
+	for (int i = 0; i < num_acked; i++) {
+		if (inSlowStart()) {
+			window++;
+			continue;
+		}
+
+		if (epoch_start < 0) {
+			epoch_start = now;
+			reno_window = window;
+			if (window < last_max_window) {
+				k = cbrt((last_max_window - window) / C);
+				origin = last_max_window;
+			}
+			else {
+				k = 0;
+				origin = window;
+			}
+		}
+
+		// Head for where the cubic will be a round trip from now.
+		double rtt = flow->getAvgRTT() < 0 ? 0 : flow->getMinRTT();
+		double t = (now - epoch_start + rtt) / MS_PER_SEC;
+		double target = origin + C * pow(t - k, 3);
+		if (target > window) {
+			window += (target - window) / window;
+		}
+		else {
+			window += 0.01 / window;
+		}
+
+		// Never do worse than Reno with the same average window would.
+		reno_window += 3 * (1 - BETA) / (1 + BETA) / window;
+		window = max(window, reno_window);
+	}
+}
+
+void cubic_control::onTimeout() {
+	startOver();
+	threshold = max(window * BETA, 2.0);
+	window = 1;
+}
+
+// ------------------------------ vegas_control class -------------------------
+
+vegas_control::vegas_control(const netflow &flow, double window) :
+		reno_control(flow, window), round_end(0),
+		round_min_rtt(numeric_limits<double>::max()) { }
+
+void vegas_control::onRttSample(double rtt, double now) {
+	round_min_rtt = min(round_min_rtt, rtt);
+}
+
+void vegas_control::onAck(int num_acked, double now) {
+	if (flow->getHighestAckSeqnum() > round_end) {
+
+		// A round trip is over. Estimate how many of the window's packets
+		// are sitting in queues from how much slower it went than it could.
+		if (round_min_rtt != numeric_limits<double>::max()) {
+			double queued = window * (1 - flow->getMinRTT() / round_min_rtt);
+			if (inSlowStart()) {
+				if (queued > GAMMA) {
+					threshold = window;
+				}
+			}
+			else if (queued < ALPHA) {
+				window++;
+			}
+			else if (queued > BETA) {
+				window = max(window - 1, 2.0);
+				threshold = window; // so it doesn't slow start again
+			}
+		}
+		round_end = flow->getHighestSentSeqnum();
+		round_min_rtt = numeric_limits<double>::max();
+	}
+
+	if (inSlowStart()) {
+		window += num_acked;
+	}
+}
+
+// ------------------------------- fast_control class -------------------------
+
+fast_control::fast_control(const netflow &flow, double window) :
+		tahoe_control(flow, window) { }
+
+void fast_control::onAck(int num_acked, double now) { }
+
+void fast_control::onDupAck(int num_dups, double now) { }
+
+double fast_control::getUpdateInterval() const {
+	return WINDOW_UPDATE_INTERVAL;
+}
+
+void fast_control::onUpdate(double now) {
+	if (flow->getAvgRTT() == -1) {
+		window = ALPHA;
+	}
+	else {
+		window = window * (flow->getMinRTT() / flow->getPktRTT()) + ALPHA;
+	}
+}
+
+// ------------------------------- bbr_control class --------------------------
+
+/**
+ * PROBE_BW's pacing gains, one per round trip: probe for bandwidth, drain
+ * the queue that made, then cruise.
+ */
+static const double PROBE_BW_GAINS[] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+/** Number of entries in @c PROBE_BW_GAINS. */
+static const int PROBE_BW_CYCLE = 8;
+
+const int bbr_control::BW_ROUNDS;
+constexpr double bbr_control::MIN_RTT_WINDOW;
+constexpr double bbr_control::PROBE_RTT_TIME;
+constexpr double bbr_control::MIN_WINDOW;
+constexpr double bbr_control::HIGH_GAIN;
+
+bbr_control::bbr_control(const netflow &flow, double window) :
+		congestion_control(flow, window), mode(STARTUP), delivered(0),
+		pending_rtt(-1), round_count(0), round_end(0),
+		min_rtt(numeric_limits<double>::max()), min_rtt_stamp(0),
+		filled_pipe(false), full_bw(0), full_bw_count(0), cycle_index(0),
+		cycle_stamp(0), probe_rtt_done(-1), prior_window(window),
+		pacing_gain(HIGH_GAIN), window_gain(HIGH_GAIN) {
+	for (int i = 0; i < BW_ROUNDS; i++) {
+		round_bw[i] = 0;
+	}
+}
+
+double bbr_control::getBandwidth() const {
+	double bw = 0;
+	for (int i = 0; i < BW_ROUNDS; i++) {
+		bw = max(bw, round_bw[i]);
+	}
+	return bw;
+}
+
+double bbr_control::getBdp() const {
+	if (min_rtt == numeric_limits<double>::max()) {
+		return 0;
+	}
+	return getBandwidth() * min_rtt;
+}
+
+double bbr_control::getPacingGain() const { return pacing_gain; }
+
+void bbr_control::onRttSample(double rtt, double now) {
+	pending_rtt = rtt;
+
+	// Take a new minimum, or a fresh one if the old one is too old to trust.
+	if (rtt <= min_rtt || now > min_rtt_stamp + MIN_RTT_WINDOW) {
+		if (now > min_rtt_stamp + MIN_RTT_WINDOW && mode != PROBE_RTT &&
+				min_rtt != numeric_limits<double>::max()) {
+			// It's stale: drain the queues so the next samples show the
+			// propagation delay again.
+			mode = PROBE_RTT;
+			pacing_gain = 1;
+			window_gain = 1;
+			prior_window = window;
+			probe_rtt_done = -1;
+		}
+		min_rtt = rtt;
+		min_rtt_stamp = now;
+	}
+}
+
+void bbr_control::sampleBandwidth(double now) {
+	if (pending_rtt <= 0) {
+		pending_rtt = -1;
+		return;
+	}
+
+	// Find how many packets had been delivered when the sampled packet was
+	// sent. Earlier history won't be needed again.
+	double sent_time = now - pending_rtt;
+	while (delivery_history.size() > 1 &&
+			delivery_history[1].first <= sent_time) {
+		delivery_history.pop_front();
+	}
+	long delivered_then = 0;
+	if (!delivery_history.empty() &&
+			delivery_history.front().first <= sent_time) {
+		delivered_then = delivery_history.front().second;
+	}
+	double rate = (delivered - delivered_then) / pending_rtt;
+	double &slot = round_bw[round_count % BW_ROUNDS];
+	slot = max(slot, rate);
+	pending_rtt = -1;
+}
+
+void bbr_control::checkFullPipe() {
+	if (filled_pipe) {
+		return;
+	}
+	double bw = getBandwidth();
+	if (bw >= full_bw * 1.25) {
+		full_bw = bw;
+		full_bw_count = 0;
+		return;
+	}
+	filled_pipe = ++full_bw_count >= 3;
+}
+
+void bbr_control::enterProbeBw(double now) {
+	mode = PROBE_BW;
+	window_gain = 2;
+	cycle_index = 2;
+	cycle_stamp = now;
+	pacing_gain = PROBE_BW_GAINS[cycle_index];
+}
+
+void bbr_control::updateMode(double now) {
+	switch (mode) {
+	case STARTUP:
+		if (filled_pipe) {
+			mode = DRAIN;
+			pacing_gain = 1 / HIGH_GAIN;
+			window_gain = HIGH_GAIN;
+		}
+		break;
+	case DRAIN:
+		if (getInFlight() <= getBdp()) {
+			enterProbeBw(now);
+		}
+		break;
+	case PROBE_BW:
+		// Each gain lasts a round trip, except that probing keeps on until
+		// the extra packets are in flight, and draining stops as soon as
+		// the queue is gone.
+		if (now - cycle_stamp > min_rtt ?
+				pacing_gain <= 1 || getInFlight() >= pacing_gain * getBdp() :
+				pacing_gain < 1 && getInFlight() <= getBdp()) {
+			cycle_index = (cycle_index + 1) % PROBE_BW_CYCLE;
+			cycle_stamp = now;
+			pacing_gain = PROBE_BW_GAINS[cycle_index];
+		}
+		break;
+	case PROBE_RTT:
+		if (probe_rtt_done < 0) {
+			if (getInFlight() <= MIN_WINDOW) {
+				probe_rtt_done = now + PROBE_RTT_TIME;
+			}
+		}
+		else if (now >= probe_rtt_done) {
+			min_rtt_stamp = now;
+			window = max(window, prior_window);
+			if (filled_pipe) {
+				enterProbeBw(now);
+			}
+			else {
+				mode = STARTUP;
+				pacing_gain = HIGH_GAIN;
+				window_gain = HIGH_GAIN;
+			}
+		}
+		break;
+	}
+}
+
+void bbr_control::updateWindow(int num_acked) {
+	if (mode == PROBE_RTT) {
+		window = min(window, MIN_WINDOW);
+		return;
+	}
+
+	// Grow towards the target, or without limit until there is one.
+	double target = window_gain * getBdp();
+	if (filled_pipe) {
+		window = min(window + num_acked, target);
+	}
+	else if (window < target || target == 0) {
+		window += num_acked;
+	}
+	window = max(window, MIN_WINDOW);
+}
+
+void bbr_control::onAck(int num_acked, double now) {
+	delivered += num_acked;
+	delivery_history.push_back(make_pair(now, delivered));
+
+	bool round_start = false;
+	if (flow->getHighestAckSeqnum() > round_end) {
+		round_end = flow->getHighestSentSeqnum();
+		round_count++;
+		round_bw[round_count % BW_ROUNDS] = 0;
+		round_start = true;
+	}
+	sampleBandwidth(now);
+	if (round_start) {
+		checkFullPipe();
+	}
+	updateMode(now);
+	updateWindow(num_acked);
+}
+
+void bbr_control::onDupAck(int num_dups, double now) { }
+
+void bbr_control::onTimeout() {
+	window = 1;
+}
+
+double bbr_control::getPacingRate() const {
+	double bw = getBandwidth();
+	if (bw > 0) {
+		return pacing_gain * bw;
+	}
+
+	// No delivery rate yet: pace the window over the RTT if that's known.
+	if (flow->getAvgRTT() > 0) {
+		return pacing_gain * window / flow->getAvgRTT();
+	}
+	return 0;
+}
+
+// ------------------------------ dctcp_control class -------------------------
+
+dctcp_control::dctcp_control(const netflow &flow, double window) :
+		reno_control(flow, window), alpha(1), acked(0), marked(0),
+		window_end(0), cut_end(0) { }
+
+void dctcp_control::onAck(int num_acked, double now) {
+	acked++;
+	if (flow->getHighestAckSeqnum() > window_end) {
+		alpha = (1 - G) * alpha + G * marked / acked;
+		acked = 0;
+		marked = 0;
+		window_end = flow->getHighestSentSeqnum();
+	}
+	reno_control::onAck(num_acked, now);
+}
+
+void dctcp_control::onDupAck(int num_dups, double now) {
+	acked++;
+	reno_control::onDupAck(num_dups, now);
+}
+
+bool dctcp_control::isEcnCapable() const { return true; }
+
+void dctcp_control::onEcnEcho(int num_marked, double now) {
+	marked += num_marked;
+	if (flow->getHighestAckSeqnum() > cut_end) {
+		threshold = max(window * (1 - alpha / 2), 2.0);
+		window = threshold;
+		cut_end = flow->getHighestSentSeqnum();
+	}
+}
+
+double dctcp_control::getAlpha() const { return alpha; }
@@ -0,0 +1,618 @@
+/**
+ * @file
+ *
+ * Contains the congestion control algorithms a flow can use to size its
+ * window and how fast to pace its packets: Tahoe, Reno, NewReno, CUBIC,
+ * Vegas, FAST, BBR, and DCTCP.
+ */
+
+#ifndef CONGESTION_CONTROL_H
+#define CONGESTION_CONTROL_H
+
+// Standard includes.
+#include <deque>
+#include <string>
+
+// Custom headers.
+#include "network.h"
+
+using namespace std;
+
+/** Kinds of congestion control a flow can be configured to use. */
+enum cc_type {
+	TAHOE_CC,
+	RENO_CC,
+	NEWRENO_CC,
+	CUBIC_CC,
+	VEGAS_CC,
+	FAST_CC,
+	BBR_CC,
+	DCTCP_CC
+};
+
+// -------------------------- congestion_control class ------------------------
+
+/**
+ * Interface for a flow's congestion control. The flow keeps track of what's
+ * been sent and acknowledged, retransmits, and measures round-trip times;
+ * it tells its congestion control about each of those and asks it how big
+ * the window should be.
+ *
+ * The window is in packets. While the slow start threshold is negative or
+ * the window is below it, the window grows by a packet per ACK.
+ *
+ * A congestion control can also pace the flow, i.e. space its packets out
+ * at a given rate rather than sending a window's worth back to back. Any of
+ * them can be told to pace at about the window per smoothed RTT, as Linux
+ * does; BBR always paces at its own rate.
+ *
+ * One that's ECN-capable has its packets marked rather than dropped by
+ * links set up to mark them, and hears about the marks through
+ * @c onEcnEcho.
+ */
+class congestion_control {
+
+protected:
+
+	/** Flow whose window this is, for its RTTs and sequence numbers. */
+	const netflow *flow;
+
+	/** Window size in packets. */
+	double window;
+
+	/** Slow start threshold in packets, or negative if there's been none. */
+	double threshold;
+
+	/**
+	 * True if packets should be paced at the window, or the packets in
+	 * flight if there are more, per smoothed RTT.
+	 */
+	bool pacing;
+
+	/** @return true if the window should grow by a packet per ACK */
+	bool inSlowStart() const;
+
+	/** @return packets sent but not yet acknowledged */
+	int getInFlight() const;
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow whose window this is
+	 * @param window initial window size in packets
+	 */
+	congestion_control(const netflow &flow, double window);
+
+	/** Destructor. */
+	virtual ~congestion_control();
+
+	/**
+	 * Makes a congestion control of the given type.
+	 * @param type
+	 * @param flow whose window it is
+	 * @param window initial window size in packets
+	 * @return the new congestion control, which the caller owns
+	 */
+	static congestion_control *makeCongestionControl(cc_type type,
+			const netflow &flow, double window);
+
+	/**
+	 * Looks up a congestion control type by the name used in the input file:
+	 * "tahoe", "reno", "newreno", "cubic", "vegas", "fast", "bbr", or
+	 * "dctcp".
+	 * @param name
+	 * @param type set if the name is known
+	 * @return true if the name is known
+	 */
+	static bool parseCongestionControlType(const string &name, cc_type &type);
+
+	/**
+	 * Called when an ACK acknowledges new packets. The flow's highest ACK
+	 * sequence number has already moved up.
+	 * @param num_acked number of packets newly acknowledged
+	 * @param now time in ms
+	 */
+	virtual void onAck(int num_acked, double now) = 0;
+
+	/**
+	 * Called for each duplicate ACK. When @c num_dups reaches
+	 * @c netflow::FAST_RETRANSMIT_DUPLICATE_ACK_THRESHOLD the flow fast
+	 * retransmits; it hasn't moved back its sequence numbers yet.
+	 * @param num_dups duplicates seen in a row, including this one
+	 * @param now time in ms
+	 */
+	virtual void onDupAck(int num_dups, double now) = 0;
+
+	/** Called when the retransmission timer goes off. */
+	virtual void onTimeout() = 0;
+
+	/**
+	 * Called with each round-trip time sample, before the @c onAck for the
+	 * ACK that carried it. The flow's RTT estimates include it already.
+	 * @param rtt in ms
+	 * @param now time in ms
+	 */
+	virtual void onRttSample(double rtt, double now);
+
+	/** @return true if the flow's packets should be sent ECN-capable */
+	virtual bool isEcnCapable() const;
+
+	/**
+	 * Called when an ACK, new or duplicate, echoes an ECN mark, before the
+	 * @c onAck or @c onDupAck for it. ACKs that come while the flow waits
+	 * out a fast retransmit are ignored, echo and all.
+	 * @param num_marked packets the echo is about; the receiver ACKs every
+	 * packet, so always the one that triggered the ACK
+	 * @param now time in ms
+	 */
+	virtual void onEcnEcho(int num_marked, double now);
+
+	/**
+	 * @return ms between calls to @c onUpdate, or 0 if the algorithm doesn't
+	 * need them
+	 */
+	virtual double getUpdateInterval() const;
+
+	/**
+	 * Called every @c getUpdateInterval ms while the flow is running.
+	 * @param now time in ms
+	 */
+	virtual void onUpdate(double now);
+
+	/**
+	 * @return packets per ms to send at, or 0 to send a window's packets
+	 * back to back
+	 */
+	virtual double getPacingRate() const;
+
+	/** @return window size in packets */
+	double getWindow() const;
+
+	/** @return slow start threshold, or negative if there hasn't been one */
+	double getThreshold() const;
+
+	/**
+	 * Turns pacing at the window per smoothed RTT on or off. It never goes
+	 * slower than the packets in flight per RTT, so packets a recovery lets
+	 * out as duplicate ACKs come in don't pile up behind one another.
+	 * @param pacing
+	 */
+	void setPacing(bool pacing);
+};
+
+// ------------------------------ tahoe_control class -------------------------
+
+/**
+ * TCP Tahoe: slow start then one packet per window per RTT, and back to a
+ * window of one with the threshold at half the window on any loss.
+ */
+class tahoe_control : public congestion_control {
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	tahoe_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onDupAck(int num_dups, double now);
+
+	void onTimeout();
+};
+
+// ------------------------------ reno_control class --------------------------
+
+/**
+ * TCP Reno: like Tahoe, but a fast retransmit only halves the window. The
+ * flow goes back and resends everything from the lost packet on, so there's
+ * no window inflation during recovery.
+ */
+class reno_control : public tahoe_control {
+
+protected:
+
+	/**
+	 * Halves the threshold and sets the window to it, as on entering fast
+	 * recovery.
+	 */
+	virtual void halveWindow();
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	reno_control(const netflow &flow, double window);
+
+	void onDupAck(int num_dups, double now);
+
+	void onTimeout();
+};
+
+// ----------------------------- newreno_control class ------------------------
+
+/**
+ * TCP NewReno: like Reno, but stays in recovery until everything that was
+ * outstanding when the loss was detected has been acknowledged, so several
+ * losses from one window only halve it once.
+ */
+class newreno_control : public reno_control {
+
+private:
+
+	/**
+	 * Recovery ends once an ACK asks for a packet past this one; -1 when
+	 * not recovering.
+	 */
+	int recover;
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	newreno_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onDupAck(int num_dups, double now);
+
+	void onTimeout();
+};
+
+// ------------------------------ cubic_control class -------------------------
+
+/**
+ * CUBIC (RFC 8312): after a loss the window follows a cubic function of the
+ * time since, which climbs quickly back towards the window where the loss
+ * happened, flattens out there, then probes beyond it. It never grows
+ * slower than Reno would.
+ */
+class cubic_control : public reno_control {
+
+private:
+
+	/** Scales the cubic, in packets per second cubed. */
+	static constexpr double C = 0.4;
+
+	/** Fraction of the window kept after a loss. */
+	static constexpr double BETA = 0.7;
+
+	/** Window just before the last loss. */
+	double last_max_window;
+
+	/** Time in ms the current growth epoch started, or -1 before it has. */
+	double epoch_start;
+
+	/** Seconds after the epoch starts that the cubic reaches its origin. */
+	double k;
+
+	/** Window the cubic flattens out at. */
+	double origin;
+
+	/** What Reno's window would be by now, for the TCP-friendly region. */
+	double reno_window;
+
+	/** Remembers the window at a loss and starts a new epoch later. */
+	void startOver();
+
+protected:
+
+	void halveWindow();
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	cubic_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onTimeout();
+};
+
+// ------------------------------ vegas_control class -------------------------
+
+/**
+ * TCP Vegas: once per round trip, compares the throughput the window would
+ * get at the smallest RTT seen with what it's getting, and nudges the
+ * window so that between @c ALPHA and @c BETA packets are queued in the
+ * network. Losses are handled as in Reno.
+ */
+class vegas_control : public reno_control {
+
+private:
+
+	/** Fewest packets the flow should keep queued. */
+	static constexpr double ALPHA = 2;
+
+	/** Most packets the flow should keep queued. */
+	static constexpr double BETA = 4;
+
+	/** Packets queued above which slow start ends. */
+	static constexpr double GAMMA = 1;
+
+	/** The round ends when an ACK asks for a packet past this one. */
+	int round_end;
+
+	/** Smallest RTT sample this round, in ms. */
+	double round_min_rtt;
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	vegas_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onRttSample(double rtt, double now);
+};
+
+// ------------------------------- fast_control class -------------------------
+
+/**
+ * FAST TCP: every @c WINDOW_UPDATE_INTERVAL ms, scales the window by the
+ * ratio of the smallest RTT to the latest one and adds @c ALPHA. ACKs and
+ * duplicate ACKs leave it alone; a timeout resets it as in Tahoe until the
+ * next update.
+ */
+class fast_control : public tahoe_control {
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	fast_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onDupAck(int num_dups, double now);
+
+	double getUpdateInterval() const;
+
+	void onUpdate(double now);
+};
+
+// ------------------------------- bbr_control class --------------------------
+
+/**
+ * BBR, version 1 (Cardwell et al., 2016). Rather than reacting to losses,
+ * models the path by its bottleneck bandwidth, the most packets per ms
+ * delivered in the last @c BW_ROUNDS round trips, and its propagation
+ * delay, the smallest RTT in the last @c MIN_RTT_WINDOW ms. It paces at a
+ * multiple of the bandwidth and keeps the window at a multiple of their
+ * product:
+ *
+ * - STARTUP doubles the rate every round trip until the bandwidth stops
+ *   growing by a quarter for three in a row.
+ * - DRAIN then paces slower until the queue STARTUP built is gone.
+ * - PROBE_BW cycles through eight round trips, pacing a quarter faster in
+ *   one to look for more bandwidth and a quarter slower in the next to
+ *   drain what that queued.
+ * - PROBE_RTT cuts the window to @c MIN_WINDOW for @c PROBE_RTT_TIME ms if
+ *   the smallest RTT hasn't been seen again for @c MIN_RTT_WINDOW ms, so
+ *   queues empty and it can be measured afresh.
+ *
+ * Delivery rates come from the ACKs' RTT samples: the packets acknowledged
+ * since the sample's packet was sent, over its RTT. Losses are left alone
+ * but a timeout drops the window to one packet, from which it grows back a
+ * packet per ACK. Flows aren't ever limited by the application, so that
+ * part of BBR isn't needed.
+ */
+class bbr_control : public congestion_control {
+
+private:
+
+	/** Where BBR is in its cycle; see the class comment. */
+	enum bbr_mode { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+	/** Round trips the bandwidth estimate looks back over. */
+	static const int BW_ROUNDS = 10;
+
+	/** Window in ms the smallest RTT is kept for. */
+	static constexpr double MIN_RTT_WINDOW = 10000;
+
+	/** Time in ms PROBE_RTT holds the window down for. */
+	static constexpr double PROBE_RTT_TIME = 200;
+
+	/** Fewest packets the window ever has, timeouts aside. */
+	static constexpr double MIN_WINDOW = 4;
+
+	/** Pacing and window gain during STARTUP, 2 / ln 2. */
+	static constexpr double HIGH_GAIN = 2.885;
+
+	/** Current mode. */
+	bbr_mode mode;
+
+	/** Packets acknowledged so far. */
+	long delivered;
+
+	/**
+	 * Times in ms at which @c delivered went up, with its value then, oldest
+	 * first; kept back to the oldest packet that may still be acknowledged.
+	 */
+	deque<pair<double, long> > delivery_history;
+
+	/** RTT sample in ms from the ACK about to be passed on, or -1. */
+	double pending_rtt;
+
+	/** Most packets per ms delivered in each of the last round trips. */
+	double round_bw[BW_ROUNDS];
+
+	/** Round trips so far. */
+	long round_count;
+
+	/** The round ends when an ACK asks for a packet past this one. */
+	int round_end;
+
+	/** Smallest RTT in ms, or the largest double if there's none yet. */
+	double min_rtt;
+
+	/** Time in ms @c min_rtt was measured. */
+	double min_rtt_stamp;
+
+	/** True once the bandwidth has stopped growing in STARTUP. */
+	bool filled_pipe;
+
+	/** Bandwidth the last time it grew by a quarter, packets per ms. */
+	double full_bw;
+
+	/** Round trips since the bandwidth last grew by a quarter. */
+	int full_bw_count;
+
+	/** PROBE_BW: which of the eight gains is in use. */
+	int cycle_index;
+
+	/** PROBE_BW: time in ms the current gain took over. */
+	double cycle_stamp;
+
+	/**
+	 * PROBE_RTT: time in ms it may end, or -1 until few enough packets are
+	 * in flight for the wait to start.
+	 */
+	double probe_rtt_done;
+
+	/** Window before PROBE_RTT, to go back to afterwards. */
+	double prior_window;
+
+	/** Multiple of the bandwidth to pace at. */
+	double pacing_gain;
+
+	/** Multiple of the bandwidth-delay product to keep the window at. */
+	double window_gain;
+
+	/** @return packets the path holds when full, or 0 if unknown */
+	double getBdp() const;
+
+	/**
+	 * Takes a delivery rate sample from the pending RTT sample, if any.
+	 * @param now time in ms
+	 */
+	void sampleBandwidth(double now);
+
+	/** STARTUP: notes whether the bandwidth grew this round. */
+	void checkFullPipe();
+
+	/**
+	 * Switches to PROBE_BW at the gain after the probing ones.
+	 * @param now time in ms
+	 */
+	void enterProbeBw(double now);
+
+	/**
+	 * Moves between modes as their ending conditions come true.
+	 * @param now time in ms
+	 */
+	void updateMode(double now);
+
+	/**
+	 * Moves the window towards its target.
+	 * @param num_acked packets this ACK acknowledged
+	 */
+	void updateWindow(int num_acked);
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	bbr_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onDupAck(int num_dups, double now);
+
+	void onTimeout();
+
+	void onRttSample(double rtt, double now);
+
+	double getPacingRate() const;
+
+	/** @return packets per ms the path can deliver, or 0 if unknown */
+	double getBandwidth() const;
+
+	/** @return multiple of the bandwidth the flow is paced at now */
+	double getPacingGain() const;
+};
+
+// ------------------------------ dctcp_control class -------------------------
+
+/**
+ * DCTCP (RFC 8257): keeps @c alpha, a moving average of the fraction of
+ * packets the links marked, updated once per window of data, and on the
+ * first mark in a window cuts the window by @c alpha / 2 rather than
+ * halving it. Lightly marked flows barely slow down, so queues stay near
+ * the marking threshold instead of filling the buffer. It grows and
+ * handles losses like Reno.
+ */
+class dctcp_control : public reno_control {
+
+private:
+
+	/** Weight of each window's marked fraction in @c alpha. */
+	static constexpr double G = 1.0 / 16;
+
+	/** Estimated fraction of packets marked; starts at 1, i.e. cautious. */
+	double alpha;
+
+	/**
+	 * ACKs, new or duplicate, so far in the current window. The receiver
+	 * ACKs every packet, so each one is a packet delivered.
+	 */
+	int acked;
+
+	/** How many of @c acked were marked. */
+	int marked;
+
+	/** The window ends when an ACK asks for a packet past this one. */
+	int window_end;
+
+	/**
+	 * No further cuts until an ACK asks for a packet past this one, so a
+	 * window's marks only cut it once.
+	 */
+	int cut_end;
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param flow
+	 * @param window initial window size in packets
+	 */
+	dctcp_control(const netflow &flow, double window);
+
+	void onAck(int num_acked, double now);
+
+	void onDupAck(int num_dups, double now);
+
+	bool isEcnCapable() const;
+
+	void onEcnEcho(int num_marked, double now);
+
+	/** @return estimated fraction of packets marked */
+	double getAlpha() const;
+};
+
+#endif // CONGESTION_CONTROL_H
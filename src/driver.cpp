@@ -28,11 +28,12 @@ using namespace std;
 void print_usage_statement (char *progname);
 
 /**
- * Processes console arguments and sets the global variables @c infile and
- * @c outfile.
+ * Processes console arguments and sets the global variables @c infile,
+ * @c outfile, and @c sched_type.
  * @param argc number of console arguments
  * @param argv console arguments
- * @post sets the debug flag and infile and outfile global variables.
+ * @post sets the debug flags and infile, outfile, and sched_type global
+ * variables.
  * @warning exits from this process after printing a usage statement if the
  * console arguments don't conform to the usage statement
  */
@@ -45,6 +46,14 @@ void process_console_args(int argc, char **argv);
  */
 void term_sig_handler(int signal);
 
+/**
+ * Reports a flow's completion time on stdout. Registered as the
+ * simulation's flow completion callback.
+ * @param flow that just finished
+ * @param time_ms completion time in milliseconds
+ */
+void print_flow_completion(netflow &flow, double time_ms);
+
 // ------------------------ Global variables ----------------------------------
 
 /** If true lots of debugging output is shown. */
@@ -74,6 +83,9 @@ char *infile;
 /** Output filename */
 char *outfile;
 
+/** Kind of event queue the simulation uses. */
+scheduler_type sched_type = CALENDAR_SCHEDULER;
+
 // ------------------------------ Main ----------------------------------------
 
 /**
@@ -89,7 +101,8 @@ int main (int argc, char **argv) {
 	process_console_args(argc, argv);
 
 	// Load hosts, routers, links, and flows from the JSON input file.
-	sim = new simulation(infile);
+	sim = new simulation(infile, sched_type);
+	sim->setFlowCompletionCallback(print_flow_completion);
 
 	// Invoke the simulation loop, which should terminate when all events
 	// have been processed. Every time an event is executed, network sim
@@ -112,35 +125,54 @@ void term_sig_handler(int signal) {
 	return;
 }
 
+void print_flow_completion(netflow &flow, double time_ms) {
+	cout << "Flow " << flow.getName() << " finished at " << time_ms << " ms."
+			<< endl;
+}
+
 void print_usage_statement (char *progname) {
 	cerr << endl << "Usage: " << progname << " <JSON input file> "
-			"<JSON output file> [-d|-dd]" << endl;
+			"<JSON output file> [-d|-dd] [-s <scheduler>]" << endl;
 	cerr << "  -d to print debugging statements to stdout." << endl;
 	cerr << "  -dd to print detailed, pausing debugging statements to stdout."
-			<< endl << endl << "Note that the debug flags must come after "
+			<< endl;
+	cerr << "  -s to pick the event queue: calendar (default), heap, or "
+			"multimap." << endl << endl << "Note that the flags must come after "
 			"the two required filenames." << endl << endl;
 }
 
 void process_console_args(int argc, char **argv) {
 
 	// See print_usage_statement function for expected console arguments.
-	if (argc != 3 && argc != 4) {
+	if (argc < 3) {
 		print_usage_statement(argv[0]);
 		exit (1);
 	}
 
-	// No flags
-	if (argc == 3) {
-		debug = false;
-		detail = false;
-	}
+	debug = false;
+	detail = false;
 
-	// One debug flag
-	if (argc == 4) {
-		debug = true;
-		if (strcmp(argv[3], "-dd") == 0) {
+	for (int i = 3; i < argc; i++) {
+
+		// Debug flags
+		if (strcmp(argv[i], "-d") == 0) {
+			debug = true;
+		}
+		else if (strcmp(argv[i], "-dd") == 0) {
+			debug = true;
 			detail = true;
 		}
+
+		// Event queue implementation
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc &&
+				event_scheduler::parseSchedulerType(argv[i + 1], sched_type)) {
+			i++;
+		}
+
+		else {
+			print_usage_statement(argv[0]);
+			exit (1);
+		}
 	}
 
 	infile = argv[1];
@@ -0,0 +1,114 @@
+/**
+ * @file
+ *
+ * Contains the table that interns a simulation's network elements (hosts,
+ * routers, links, flows) by name and hands them dense integer IDs.
+ */
+
+#ifndef ELEMENT_TABLE_H
+#define ELEMENT_TABLE_H
+
+// Standard includes.
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// ----------------------------- element_table class --------------------------
+
+/**
+ * Owns nothing, but keeps one kind of @c netelement both by name and in a
+ * vector indexed by ID. Names are only looked up while the input is being
+ * parsed and for I/O; once @c assignIds has run, everything else goes
+ * through the IDs.
+ *
+ * IDs are handed out in name order, so walking the table visits elements in
+ * the same order the name-keyed maps it replaced did. That keeps event
+ * creation order, and so the simulation's output, the same.
+ *
+ * @tparam T a @c netelement subclass
+ */
+template <typename T>
+class element_table {
+
+private:
+
+	/** Elements by name. Only used while parsing and to number them. */
+	map<string, T *> by_name;
+
+	/** Elements in ID order, less @c first_id. */
+	vector<T *> elements;
+
+	/** ID of @c elements[0]. */
+	int first_id;
+
+public:
+
+	element_table() : first_id(0) { }
+
+	/**
+	 * Adds an element. It has no ID until @c assignIds is called.
+	 * @param element element whose name isn't in the table yet
+	 */
+	void add(T *element) {
+		assert(by_name.find(element->getName()) == by_name.end());
+		by_name[element->getName()] = element;
+		elements.push_back(element);
+	}
+
+	/**
+	 * Numbers the elements @c first_id, @c first_id + 1, ... in name order.
+	 * @param first_id ID of the first element by name
+	 */
+	void assignIds(int first_id) {
+		this->first_id = first_id;
+		elements.clear();
+		for (typename map<string, T *>::iterator it = by_name.begin();
+				it != by_name.end(); it++) {
+			it->second->setId(first_id + elements.size());
+			elements.push_back(it->second);
+		}
+	}
+
+	/**
+	 * @param name name to look up
+	 * @return the element with that name, or NULL if there's none
+	 */
+	T *find(const string &name) const {
+		typename map<string, T *>::const_iterator it = by_name.find(name);
+		return it == by_name.end() ? NULL : it->second;
+	}
+
+	/**
+	 * @param id ID handed out by @c assignIds
+	 * @return the element with that ID
+	 */
+	T *get(int id) const { return elements[id - first_id]; }
+
+	/**
+	 * @param element any element, numbered or not
+	 * @return true if @c element is the one in this table under its ID
+	 */
+	bool contains(const T *element) const {
+		int index = element->getId() - first_id;
+		return element->getId() >= 0 && index >= 0 &&
+				index < (int) elements.size() && elements[index] == element;
+	}
+
+	/** @return number of elements */
+	int size() const { return elements.size(); }
+
+	/** @return elements in ID order */
+	typename vector<T *>::const_iterator begin() const {
+		return elements.begin();
+	}
+
+	/** @return end of the elements */
+	typename vector<T *>::const_iterator end() const {
+		return elements.end();
+	}
+};
+
+#endif // ELEMENT_TABLE_H
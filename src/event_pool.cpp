@@ -0,0 +1,87 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+// Custom headers.
+#include "event_pool.h"
+
+// ------------------------------ event_pool class ----------------------------
+
+const size_t event_pool::GRANULE;
+
+const size_t event_pool::MAX_BLOCK_SIZE;
+
+const size_t event_pool::SLAB_SIZE;
+
+event_pool::event_pool() :
+		free_lists(MAX_BLOCK_SIZE / GRANULE + 1, NULL), slab_next(NULL),
+		slab_end(NULL), num_live(0) { }
+
+event_pool::~event_pool() {
+	assert(num_live == 0);
+	for (unsigned long i = 0; i < slabs.size(); i++) {
+		free(slabs[i]);
+	}
+}
+
+size_t event_pool::blockSize(size_t size) {
+	return (size + GRANULE - 1) / GRANULE * GRANULE;
+}
+
+void *event_pool::allocate(size_t size) {
+	size_t block_size = blockSize(size);
+	if (block_size > MAX_BLOCK_SIZE) {
+		void *p = malloc(size);
+		if (p == NULL) {
+			throw bad_alloc();
+		}
+		num_live++;
+		return p;
+	}
+
+	// Reuse a freed block if there is one.
+	void *&head = free_lists[block_size / GRANULE];
+	if (head != NULL) {
+		void *p = head;
+		head = *(void **) p;
+		num_live++;
+		return p;
+	}
+
+	// Otherwise carve one off the newest slab, starting a new slab if this
+	// one's full. The tail of the old slab is wasted, but it's small.
+	if (slab_next == NULL || slab_end - slab_next < (long) block_size) {
+		char *slab = (char *) malloc(SLAB_SIZE);
+		if (slab == NULL) {
+			throw bad_alloc();
+		}
+		slabs.push_back(slab);
+		slab_next = slab;
+		slab_end = slab + SLAB_SIZE;
+	}
+	void *p = slab_next;
+	slab_next += block_size;
+	num_live++;
+	return p;
+}
+
+void event_pool::release(void *p, size_t size) {
+	size_t block_size = blockSize(size);
+	num_live--;
+	if (block_size > MAX_BLOCK_SIZE) {
+		free(p);
+		return;
+	}
+	void *&head = free_lists[block_size / GRANULE];
+	*(void **) p = head;
+	head = p;
+}
+
+long event_pool::getNumLive() const { return num_live; }
+
+long event_pool::getNumSlabs() const { return slabs.size(); }
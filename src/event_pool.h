@@ -0,0 +1,104 @@
+/**
+ * @file
+ *
+ * Contains the declaration of the event pool, a free-list allocator that
+ * each simulation uses for its events. Every packet hop makes and destroys
+ * a couple of events, so once a run reaches steady state the pool hands
+ * back recycled blocks and the hot path never calls the global allocator.
+ */
+
+#ifndef EVENT_POOL_H
+#define EVENT_POOL_H
+
+// Standard includes.
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// ------------------------------ event_pool class ----------------------------
+
+/**
+ * Carves fixed-size blocks out of large slabs and keeps one free list per
+ * size class. Event subclasses of the same size share a free list. Memory
+ * is only given back to the system when the pool is destroyed, so a run's
+ * footprint is bounded by the largest number of events alive at once.
+ * Requests bigger than @c MAX_BLOCK_SIZE go to the global allocator.
+ */
+class event_pool {
+
+private:
+
+	/**
+	 * Block sizes are rounded up to a multiple of this. Also the alignment of
+	 * every block.
+	 */
+	static const size_t GRANULE = 16;
+
+	/** Largest block size served from the slabs, in bytes. */
+	static const size_t MAX_BLOCK_SIZE = 1024;
+
+	/** Size of each slab in bytes. */
+	static const size_t SLAB_SIZE = 64 * 1024;
+
+	/**
+	 * Heads of the free lists, indexed by block size / @c GRANULE. A free
+	 * block's first word points at the next free block of the same size.
+	 */
+	vector<void *> free_lists;
+
+	/** Every slab allocated so far, so they can be freed at the end. */
+	vector<char *> slabs;
+
+	/** Next unused byte in the newest slab. */
+	char *slab_next;
+
+	/** One past the end of the newest slab. */
+	char *slab_end;
+
+	/** Number of blocks currently handed out. */
+	long num_live;
+
+	/**
+	 * Rounds a request up to its block size.
+	 * @param size in bytes
+	 * @return block size in bytes
+	 */
+	static size_t blockSize(size_t size);
+
+public:
+
+	/** Makes an empty pool; slabs are allocated on demand. */
+	event_pool();
+
+	/** Frees all the slabs. Every block must have been released by now. */
+	~event_pool();
+
+	/**
+	 * Hands out a block of at least the given size, aligned to @c GRANULE.
+	 * @param size in bytes
+	 * @return the block
+	 */
+	void *allocate(size_t size);
+
+	/**
+	 * Takes back a block that came from @c allocate.
+	 * @param p the block
+	 * @param size the size that was passed to @c allocate
+	 */
+	void release(void *p, size_t size);
+
+	/**
+	 * Getter for the number of blocks currently handed out.
+	 * @return number of live blocks
+	 */
+	long getNumLive() const;
+
+	/**
+	 * Getter for the number of slabs allocated so far.
+	 * @return number of slabs
+	 */
+	long getNumSlabs() const;
+};
+
+#endif // EVENT_POOL_H
@@ -2,57 +2,255 @@
  * See header file for comments.
  */
 
+// Standard includes.
+#include <cassert>
+#include <type_traits>
+#include <typeinfo>
+
 // Custom headers.
 #include "events.h"
 #include "simulation.h"
 #include "network.h"
+#include "congestion_control.h"
 
 // -------------------------------- event class -------------------------------
 
-long event::id_generator = 1;
+/**
+ * Stored just before every event's memory so @c delete knows which pool, if
+ * any, the event came from and how big it was.
+ */
+struct event_block_header {
+
+	/** Pool the block came from, or NULL for the global heap. */
+	event_pool *pool;
+
+	/** Size that was asked for, not counting this header. */
+	size_t size;
+};
+
+/** Room left for the header; keeps events 16-byte aligned. */
+static const size_t EVENT_HEADER_SIZE = 16;
+
+static_assert(sizeof(event_block_header) <= EVENT_HEADER_SIZE,
+		"event header doesn't fit in front of the event");
+
+/**
+ * Allocates memory for an event plus its header.
+ * @param pool to allocate from, NULL for the global heap
+ * @param size of the event
+ * @return memory for the event, just past the header
+ */
+static void *allocateEvent(event_pool *pool, size_t size) {
+	char *block = (char *) (pool == NULL ?
+			::operator new(EVENT_HEADER_SIZE + size) :
+			pool->allocate(EVENT_HEADER_SIZE + size));
+	event_block_header *header = (event_block_header *) block;
+	header->pool = pool;
+	header->size = size;
+	return block + EVENT_HEADER_SIZE;
+}
+
+thread_local long event::id_generator = 1;
 
-event::event() : time(-1), id(-1), sim(NULL) { }
+void *event::operator new(size_t size, simulation &sim) {
+	return allocateEvent(&sim.getEventPool(), size);
+}
+
+void *event::operator new(size_t size) {
+	return allocateEvent(NULL, size);
+}
+
+void event::operator delete(void *p) {
+	if (p == NULL) {
+		return;
+	}
+	char *block = (char *) p - EVENT_HEADER_SIZE;
+	event_block_header *header = (event_block_header *) block;
+	if (header->pool == NULL) {
+		::operator delete(block);
+	}
+	else {
+		header->pool->release(block, EVENT_HEADER_SIZE + header->size);
+	}
+}
+
+void event::operator delete(void *p, simulation &sim) {
+	event::operator delete(p);
+}
+
+const long event::NOT_SCHEDULED;
+
+event::event() : time(-1), id(-1), queue_slot(NOT_SCHEDULED),
+		timer_slot(NOT_SCHEDULED), type(GENERIC_EVENT), sim(NULL) { }
 
 event::event(double time, simulation &sim) :
-		time(time), id(id_generator++), sim(&sim) { }
+		time(time), id(id_generator++), queue_slot(NOT_SCHEDULED),
+		timer_slot(NOT_SCHEDULED), type(GENERIC_EVENT), sim(&sim) { }
+
+event::event(double time, simulation &sim, event_type type) :
+		time(time), id(id_generator++), queue_slot(NOT_SCHEDULED),
+		timer_slot(NOT_SCHEDULED), type(type), sim(&sim) { }
 
 event::~event() {}
 
 void event::runEvent() { }
 
+/**
+ * Runs @c e as the class its type tag names. That class must be final, so
+ * the call can't skip an override.
+ */
+template <class E>
+static inline void runTagged(event *e) {
+	static_assert(is_final<E>::value, "tagged event classes must be final");
+	assert(typeid(*e) == typeid(E));
+	static_cast<E *>(e)->runEvent();
+}
+
+void event::dispatch() {
+	switch (type) {
+	case RECEIVE_PACKET_EVENT:
+		runTagged<receive_packet_event>(this);
+		break;
+	case SEND_PACKET_EVENT:
+		runTagged<send_packet_event>(this);
+		break;
+	case LINK_TRANSMIT_EVENT:
+		runTagged<link_transmit_event>(this);
+		break;
+	case ACK_EVENT:
+		runTagged<ack_event>(this);
+		break;
+	case START_FLOW_EVENT:
+		runTagged<start_flow_event>(this);
+		break;
+	case TIMEOUT_EVENT:
+		runTagged<timeout_event>(this);
+		break;
+	case PERIODIC_EVENT:
+		// Not final, but its runEvent is.
+		assert(dynamic_cast<periodic_event *>(this) != NULL);
+		static_cast<periodic_event *>(this)->runEvent();
+		break;
+	case FLUID_UPDATE_EVENT:
+		runTagged<fluid_update_event>(this);
+		break;
+	default:
+		runEvent();
+		break;
+	}
+}
+
 double event::getTime() const { return time; }
 
+event_type event::getType() const { return type; }
+
 long event::getId() const { return id; }
 
+bool event::isScheduled() const { return isQueued() || isTimerArmed(); }
+
+bool event::isQueued() const { return queue_slot != NOT_SCHEDULED; }
+
+bool event::isTimerArmed() const { return timer_slot != NOT_SCHEDULED; }
+
+long event::getQueueSlot() const { return queue_slot; }
+
+void event::setQueueSlot(long slot) { queue_slot = slot; }
+
+long event::getTimerSlot() const { return timer_slot; }
+
+void event::setTimerSlot(long slot) { timer_slot = slot; }
+
+void event::setTime(double time) { this->time = time; }
+
 void event::printHelper(ostream &os) {
 	os << "event. id: " << id << ", time: " << time << " ";
 }
 
+bool event::nextInTrain(packet_train &train, packet &pkt) {
+	if (train.empty()) {
+		return false;
+	}
+	pkt.releasePayload();
+	train.pop(time, pkt);
+	if (sim->allFlowsDone() || sim->hasEventBefore(*this)) {
+		sim->addEvent(this);
+		return false;
+	}
+	return true;
+}
+
+// ----------------------------- packet_train class ---------------------------
+
+packet_train::packet_train() : next(0) { }
+
+packet_train::~packet_train() {
+	for (size_t i = next; i < cars.size(); i++) {
+		cars[i].pkt.releasePayload();
+	}
+}
+
+bool packet_train::empty() const { return next == cars.size(); }
+
+void packet_train::append(double time, packet &pkt) {
+	assert(cars.empty() || time >= cars.back().time);
+	car c = { time, pkt };
+	c.pkt.retainPayload();
+	cars.push_back(c);
+}
+
+double packet_train::getLastTime() const {
+	assert(!empty());
+	return cars.back().time;
+}
+
+void packet_train::pop(double &time, packet &pkt) {
+	assert(!empty());
+	time = cars[next].time;
+	pkt = cars[next].pkt;
+	next++;
+}
+
 // ------------------------- receive_packet_event class -----------------------
 
 void receive_packet_event::constructorHelper(netflow *flow, packet &pkt,
 			netnode *step_destination, netlink *link) {
 	this->flow = flow;
 	this->pkt = pkt;
+	this->pkt.retainPayload();
 	this->step_destination = step_destination;
 	this->link = link;
 }
 
 receive_packet_event::receive_packet_event(double time, simulation &sim,
 			netflow &flow, packet &pkt, netnode &step_destination,
-			netlink &link) : event(time, sim) {
+			netlink &link) : event(time, sim, RECEIVE_PACKET_EVENT) {
 	constructorHelper(&flow, pkt, &step_destination, &link);
 }
 
 receive_packet_event::receive_packet_event(double time, simulation &sim, 
-			packet &pkt, netnode &step_destination, netlink &link) {
+			packet &pkt, netnode &step_destination, netlink &link) :
+				event(time, sim, RECEIVE_PACKET_EVENT) {
 	constructorHelper(NULL, pkt, &step_destination, &link);
 }
 
-receive_packet_event::~receive_packet_event() { }
+receive_packet_event::~receive_packet_event() { pkt.releasePayload(); }
+
+bool receive_packet_event::joinTrain(double time, packet &pkt) {
+	if (time < (train.empty() ? getTime() : train.getLastTime())) {
+		return false;
+	}
+	train.append(time, pkt);
+	return true;
+}
 
 void receive_packet_event::runEvent() {
-	
+	do {
+		receive();
+	} while (nextInTrain(train, pkt));
+}
+
+void receive_packet_event::receive() {
+
 	if(debug) {
 		debug_os << getTime() << "\tRECEIVING " << pkt.getTypeString()
 				<< " PACKET: " << pkt.getSeq() << endl;
@@ -62,7 +260,7 @@ void receive_packet_event::runEvent() {
 
 	// update link traffic used to calculate link rate
 	double time = getTime();
-	link->updateLinkTraffic(time, pkt.getType());
+	link->updateLinkTraffic(time, pkt);
 
 	/*
 	 * If this arrival event is at a router then forward the packet. The
@@ -86,19 +284,11 @@ void receive_packet_event::runEvent() {
 
 		else {
 			// FLOW and ACK packets are handled the same way here:
-			map<netlink *, packet> link_pkt_map =
+			netlink *out_link =
 					router->receivePacket(getTime(), *sim, *flow, pkt);
-
-			// Iterate over all the packets that must be sent, making a
-			// send packet event for each.
-			map<netlink *, packet>::iterator it = link_pkt_map.begin();
-			while (it != link_pkt_map.end()) {
-				send_packet_event *e = new send_packet_event(
-						getTime(), *sim, *flow, pkt, *(it->first),
-						*step_destination);
-				sim->addEvent(e);
-				it++;
-			}
+			send_packet_event *e = new (*sim) send_packet_event(
+					getTime(), *sim, *flow, pkt, *out_link, *step_destination);
+			sim->addEvent(e);
 		}
 	}
 
@@ -120,41 +310,29 @@ void receive_packet_event::runEvent() {
 	 * of FLOW packets.
 	 */
 	else if (pkt.getType() == ACK) {
-		flow->receivedAck(pkt, getTime(), link->getLinkFreeAtTime());
+		flow->receivedAck(pkt, getTime(),
+				link->getLinkFreeAtTime(step_destination));
 
 		if(debug && this) {
 			debug_os << "Got ACK #" << pkt.getSeq() << endl;
 		}
 
 		// Get the current window's packet(s) to send.
-		double linkFreeAt = flow->getSource()->getLink()->getLinkFreeAtTime();
+		double linkFreeAt = flow->getSource()->getLink()->getLinkFreeAtTime(
+				flow->getSource());
 		vector<packet> pkts_to_send =
 				flow->popOutstandingPackets(getTime(),
 						linkFreeAt == 0 ? getTime() : linkFreeAt);
 
-		// Iterate over the packets to send, making send_packet_events for
-		// each. The timout_events have already been added to the flow and to
-		// the simulation's queue.
+		// Send them back to back as one train. The timout_events have
+		// already been added to the flow and to the simulation's queue.
 
 		if (debug) {
 			cout << "Num packets to send: " <<  pkts_to_send.size() << endl;
 		}
 
-		vector<packet>::iterator pkt_it = pkts_to_send.begin();
-		int i = 0;
-		while(pkt_it != pkts_to_send.end()) {
-
-			if(debug && this) {
-				debug_os << "  Sending packet #" << pkt_it->getSeq() << endl;
-			}
-			pkt_it->setTransmitTimestamp(getTime());
-			send_packet_event *e = new send_packet_event(
-					getTime() + i++ * netflow::TIME_EPSILON, *sim,
-					*flow, *pkt_it, *(flow->getSource()->getLink()),
-					*(flow->getSource()));
-			sim->addEvent(e);
-			pkt_it++;
-		}
+		send_packet_event::sendWindow(getTime(), netflow::TIME_EPSILON,
+				*sim, *flow, pkts_to_send);
 	}
 	else if (pkt.getType() == ROUTING) {
 		// should have been handled by the "am at a router" condition
@@ -171,7 +349,7 @@ void receive_packet_event::runEvent() {
 				<< pkt.getSeq() << " from buffer" << endl;
 	}
 
-	if(!link->receivedPacket(pkt.getId()) && debug) {
+	if(!link->receivedPacket(pkt.getId(), step_destination) && debug) {
 		debug_os << "ERROR: packet at front of buffer wasn't the same as the"
 				" one received." << endl;
 	}
@@ -186,7 +364,6 @@ void receive_packet_event::printHelper(ostream &os) {
 
 	flow->setNestingDepth(1);
 	link->setNestingDepth(1);
-	pkt.setNestingDepth(1);
 
 	os << "<-- receive_packet_event. {" << endl <<
 			"  flow: " << *flow << endl <<
@@ -196,37 +373,64 @@ void receive_packet_event::printHelper(ostream &os) {
 
 	flow->setNestingDepth(0);
 	link->setNestingDepth(0);
-	pkt.setNestingDepth(0);
+}
+
+// ----------------------------- periodic_event class -------------------------
+
+periodic_event::periodic_event(double time, simulation &sim, double period,
+		double stop_time) :
+				event(time, sim, PERIODIC_EVENT), period(period),
+				stop_time(stop_time), stopped(false) { }
+
+periodic_event::~periodic_event() { }
+
+double periodic_event::getPeriod() const { return period; }
+
+void periodic_event::stop() { stopped = true; }
+
+void periodic_event::runEvent() {
+	fire();
+
+	// Re-arm for the next occurrence. The simulation loop doesn't delete
+	// events that are scheduled again, so this event is reused.
+	double next = getTime() + period;
+	if (!stopped && period > 0 && next < stop_time) {
+		sim->armTimer(this, next);
+	}
 }
 
 // ------------------------- router_discovery_event class ---------------------
 
 router_discovery_event::router_discovery_event(
 		double time, simulation &sim) :
-				event(time, sim), router(NULL) { }
+				periodic_event(time, sim, 0, time), router(NULL) { }
+
+router_discovery_event::router_discovery_event(double time, simulation &sim,
+		double period, double stop_time) :
+				periodic_event(time, sim, period, stop_time), router(NULL) { }
 
 router_discovery_event::~router_discovery_event() { }
 
-void router_discovery_event::runEvent() {
+void router_discovery_event::fire() {
 
 	if(debug && this) {
 		debug_os << "ROUTING: " << *this << endl;
 	}
 
 	// Reset each router's distance table
-	map<string, netrouter *> router_list = sim->getRouters();
-	for (map<string, netrouter *>::iterator it = router_list.begin();
+	const element_table<netrouter> &router_list = sim->getRouters();
+	for (vector<netrouter *>::const_iterator it = router_list.begin();
 		 it != router_list.end(); it++) {
-		it->second->resetDistances(sim->getHosts(), sim->getRouters());
+		(*it)->resetDistances();
 	}
 
 	// Have each router send packets to its neighbors
-	for (map<string, netrouter *>::iterator it = router_list.begin();
+	for (vector<netrouter *>::const_iterator it = router_list.begin();
 		 it != router_list.end(); it++) {
 
-		netrouter *r = it->second;
+		netrouter *r = *it;
 
-		vector<netlink *> adj_links = r->getLinks();
+		const vector<netlink *> &adj_links = r->getLinks();
 		for (unsigned i = 0; i < adj_links.size(); i++) {
 
 			netnode *other_node = r->getOtherNode(adj_links[i]);
@@ -234,15 +438,14 @@ void router_discovery_event::runEvent() {
 			// Check if other_node points to router
 			if (other_node->isRoutingNode()) {
 
-				packet rpack = packet(ROUTING, r->getName(),
-						other_node->getName());
-				rpack.setDistances(r->getRDistances()); 
+				packet rpack = packet(ROUTING, *r, *other_node);
+				rpack.setDistances(r->getDistanceVector());
 				rpack.setTransmitTimestamp(getTime());
 
 				// Queue up new packet. Send_packet_event will check when the
 				// link is free.
-				send_packet_event *e = new send_packet_event(getTime(), *sim,
-					rpack, *adj_links[i], *r);
+				send_packet_event *e = new (*sim) send_packet_event(getTime(),
+						*sim, rpack, *adj_links[i], *r);
 				sim->addEvent(e);
 
 			}
@@ -264,28 +467,23 @@ void router_discovery_event::printHelper(ostream &os) {
 
 // --------------------------- update_window_event class ------------------------
 
-update_window_event::update_window_event(
-		double time, simulation &sim, netflow &flow) :
-				event(time, sim) { 
+update_window_event::update_window_event(double time, simulation &sim,
+		netflow &flow, double period, double stop_time) :
+				periodic_event(time, sim, period, stop_time) {
 	this->flow = &flow;
 }
 
 update_window_event::~update_window_event() { }
 
-void update_window_event::runEvent() {
+void update_window_event::fire() {
 
-	double w = flow->getWindowSize();
-	
-	double new_windowsize;
-	if (flow->getAvgRTT() == -1) {
-		new_windowsize = ALPHA;
-	}
-	else {
-		new_windowsize = w * (flow->getMinRTT()/(flow->getPktRTT())) + ALPHA;
+	// Nothing left to send, so stop updating.
+	if (flow->doneTransmitting()) {
+		stop();
+		return;
 	}
 
-	flow->setFASTWindowSize(new_windowsize);
-
+	flow->getCongestionControl().onUpdate(getTime());
 }
 
 void update_window_event::printHelper(ostream &os) {
@@ -305,15 +503,15 @@ void send_packet_event::constructorHelper(netflow *flow, packet &pkt,
 		netlink *link, netnode *departure_node) {
 	this->flow = flow;
 	this->pkt = pkt;
+	this->pkt.retainPayload();
 	this->link = link;
 	this->departure_node = departure_node;
+	this->last_arrival = NULL;
 
 	// Make sure the given departure node matches one of the endpoints of the
 	// given link.
-	assert((strcmp(this->departure_node->getName().c_str(),
-				   this->link->getEndpoint1()->getName().c_str()) == 0) ||
-		   (strcmp(this->departure_node->getName().c_str(),
-				   this->link->getEndpoint2()->getName().c_str()) == 0));
+	assert(this->departure_node == this->link->getEndpoint1() ||
+		   this->departure_node == this->link->getEndpoint2());
 }
 
 send_packet_event::send_packet_event() : event() {
@@ -323,26 +521,24 @@ send_packet_event::send_packet_event() : event() {
 
 send_packet_event::send_packet_event(double time, simulation &sim, 
 			packet &pkt, netlink &link, netnode &departure_node) : 
-					event(time, sim) {
+					event(time, sim, SEND_PACKET_EVENT) {
 	constructorHelper(NULL, pkt, &link, &departure_node);
 }
 
 send_packet_event::send_packet_event(double time, simulation &sim,
 		netflow &flow, packet &pkt, netlink &link, netnode &departure_node) :
-				event(time, sim) {
+				event(time, sim, SEND_PACKET_EVENT) {
 	constructorHelper(&flow, pkt, &link, &departure_node);
 }
 
-send_packet_event::~send_packet_event() { }
+send_packet_event::~send_packet_event() { pkt.releasePayload(); }
 
 netnode *send_packet_event::getDestinationNode() const {
 
-	if (strcmp(departure_node->getName().c_str(),
-			link->getEndpoint1()->getName().c_str()) == 0) {
+	if (departure_node == link->getEndpoint1()) {
 		return link->getEndpoint2();
 	}
-	else if (strcmp(departure_node->getName().c_str(),
-			link->getEndpoint2()->getName().c_str()) == 0) {
+	else if (departure_node == link->getEndpoint2()) {
 		return link->getEndpoint1();
 	}
 	else {
@@ -352,7 +548,43 @@ netnode *send_packet_event::getDestinationNode() const {
 	return NULL;
 }
 
+void send_packet_event::sendWindow(double time, double spacing,
+		simulation &sim, netflow &flow, vector<packet> &pkts) {
+	send_packet_event *e = NULL;
+	bool paced = flow.isPaced();
+	bool ecn = flow.getCongestionControl().isEcnCapable();
+	for (size_t i = 0; i < pkts.size(); i++) {
+		if(debug) {
+			debug_os << "  Sending packet #" << pkts[i].getSeq() << endl;
+		}
+		double send_time = flow.pace(time + i * spacing);
+
+		// An unpaced window is stamped with the time it was released.
+		pkts[i].setTransmitTimestamp(paced ? send_time : time);
+		pkts[i].setEcnCapable(ecn);
+		if (e == NULL) {
+			e = new (sim) send_packet_event(send_time, sim, flow, pkts[i],
+					*(flow.getSource()->getLink()), *(flow.getSource()));
+		}
+		else {
+			e->train.append(send_time, pkts[i]);
+		}
+	}
+	if (e != NULL) {
+		sim.addEvent(e);
+	}
+}
+
 void send_packet_event::runEvent() {
+	do {
+		send();
+	} while (nextInTrain(train, pkt));
+
+	// Whatever this event sends next, it's not right behind that arrival.
+	last_arrival = NULL;
+}
+
+void send_packet_event::send() {
 
 	if(debug && this) {
 		debug_os << getTime() << "\tSENDING " << pkt.getTypeString()
@@ -367,13 +599,30 @@ void send_packet_event::runEvent() {
 		}
 	}
 
+	// A link with a queue discipline decides when the packet goes out once
+	// the transmitter gets to it.
+	if (link->hasQueueDiscipline()) {
+		int transmitter = link->directionIndex(getDestinationNode());
+		if (!link->enqueuePacket(pkt, getDestinationNode(), getTime())) {
+			if (debug) {
+				debug_os << "This packet was DROPPED: " << pkt << endl;
+			}
+		}
+		else if (!link->isTransmitting(transmitter)) {
+			link_transmit_event::transmitNext(getTime(), *sim, *link,
+					transmitter);
+		}
+		sim->logEvent(getTime());
+		return;
+	}
+
 	// Find (absolute) arrival time to the next node from the given departure
 	// node down the given link, taking into account that packets in window-
 	// loads incur the link delay penalty once per WINDOW, not once per packet.
 	bool use_delay = !link->isSameDirectionAsLastPacket(getDestinationNode())
 		|| link->getBufferOccupancy() == 0;
-	double arrival_time =
-			link->getArrivalTime(pkt, use_delay, getTime());
+	double arrival_time = link->getArrivalTime(pkt, getDestinationNode(),
+			use_delay, getTime());
 	if (debug) {
 		debug_os << "transmission time: " << link->getTransmissionTimeMs(pkt)
 				<< ", event time: " << getTime() << endl;
@@ -383,21 +632,12 @@ void send_packet_event::runEvent() {
 	// Use the arrival time to queue a receive_packet_event (does nothing if
 	// the link buffer has no room, thereby dropping the packet).
 	if (link->sendPacket(pkt, getDestinationNode(), use_delay, getTime())) {
-		receive_packet_event *e = new receive_packet_event(arrival_time, *sim,
-				*flow, pkt, *getDestinationNode(), *link);
-
-		// If we're at a host and are sending a FLOW packet then queue
-		// up a timeout_event
-		if(!departure_node->isRoutingNode() && pkt.getType() == FLOW) {
-			/*
-			timeout_event *te = new timeout_event(
-					getTime() + flow->getTimeoutLengthMs(),
-					*sim, *flow, pkt.getSeq());
-			sim->addEvent(te);
-			*/
+		if (last_arrival == NULL ||
+				!last_arrival->joinTrain(arrival_time, pkt)) {
+			last_arrival = new (*sim) receive_packet_event(arrival_time,
+					*sim, *flow, pkt, *getDestinationNode(), *link);
+			sim->addEvent(last_arrival);
 		}
-
-		sim->addEvent(e);
 	}
 	else { // packet was dropped
 
@@ -417,7 +657,6 @@ void send_packet_event::printHelper(ostream &os) {
 
 	flow->setNestingDepth(1);
 	link->setNestingDepth(1);
-	pkt.setNestingDepth(1);
 
 	os << "<-- send_packet_event. {" << endl <<
 			"  flow: " << *flow << endl <<
@@ -427,14 +666,58 @@ void send_packet_event::printHelper(ostream &os) {
 
 	flow->setNestingDepth(0);
 	link->setNestingDepth(0);
-	pkt.setNestingDepth(0);
+}
+
+// ------------------------- link_transmit_event class ------------------------
+
+link_transmit_event::link_transmit_event(double time, simulation &sim,
+		netlink &link, int transmitter) :
+				event(time, sim, LINK_TRANSMIT_EVENT), link(&link),
+				transmitter(transmitter) { }
+
+link_transmit_event::~link_transmit_event() { }
+
+void link_transmit_event::transmitNext(double time, simulation &sim,
+		netlink &link, int transmitter) {
+	packet pkt;
+	netnode *destination;
+	double done_time, arrival_time;
+	if (!link.startNextTransmission(transmitter, time, pkt, destination,
+			done_time, arrival_time)) {
+		return;
+	}
+
+	receive_packet_event *e;
+	if (pkt.getParentFlow() == NULL) {
+		e = new (sim) receive_packet_event(
+				arrival_time, sim, pkt, *destination, link);
+	}
+	else {
+		e = new (sim) receive_packet_event(arrival_time, sim,
+				*pkt.getParentFlow(), pkt, *destination, link);
+	}
+	sim.addEvent(e);
+	pkt.releasePayload(); // the receive_packet_event has its own hold
+
+	sim.addEvent(new (sim) link_transmit_event(
+			done_time, sim, link, transmitter));
+}
+
+void link_transmit_event::runEvent() {
+	transmitNext(getTime(), *sim, *link, transmitter);
+}
+
+void link_transmit_event::printHelper(ostream &os) {
+	event::printHelper(os);
+	os << "<-- link_transmit_event. { link: " << link->getName() <<
+			", transmitter: " << transmitter << " }";
 }
 
 // --------------------------- start_flow_event class -------------------------
 
 start_flow_event::start_flow_event(
 		double time, simulation &sim, netflow &flow) :
-				event(time, sim), flow(&flow) { }
+				event(time, sim, START_FLOW_EVENT), flow(&flow) { }
 
 start_flow_event::~start_flow_event() { }
 
@@ -444,12 +727,13 @@ void start_flow_event::runEvent() {
 		debug_os << getTime() << "\tSTARTING FLOW: " << *this << endl;
 	}
 
-	// Queue the timeout event for the flow, which runs if no acknowledgements
-	// are received before the listed time is reached.
-	//flow->initFlowTimeout();
+	// Start the flow's retransmission timer, which runs if no
+	// acknowledgements are received before it goes off.
+	flow->initFlowTimeout(getTime());
 
 	// Get the current (i.e. the first) window's packet(s) to send.
-	double linkFreeAt = flow->getSource()->getLink()->getLinkFreeAtTime();
+	double linkFreeAt = flow->getSource()->getLink()->getLinkFreeAtTime(
+			flow->getSource());
 	vector<packet> pkts_to_send =
 			flow->popOutstandingPackets(getTime(),
 					linkFreeAt == 0 ? flow->getStartTimeMs() : linkFreeAt);
@@ -460,18 +744,9 @@ void start_flow_event::runEvent() {
 		return;
 	}
 
-	// Iterate over the packets to send, making a send_packet_event for each.
-	// The timout_events have already been added to the flow and to the
-	// simulation's queue.
-	vector<packet>::iterator pkt_it = pkts_to_send.begin();
-	while(pkt_it != pkts_to_send.end()) {
-		pkt_it->setTransmitTimestamp(getTime());
-		send_packet_event *e = new send_packet_event(getTime(), *sim, *flow,
-				*pkt_it, *(flow->getSource()->getLink()),
-				*(flow->getSource()));
-		sim->addEvent(e);
-		pkt_it++;
-	}
+	// Send them all at once, as one train. The timout_events have already
+	// been added to the flow and to the simulation's queue.
+	send_packet_event::sendWindow(getTime(), 0, *sim, *flow, pkts_to_send);
 
 	// log data
 	double currTime = getTime();
@@ -492,23 +767,19 @@ void start_flow_event::printHelper(ostream &os) {
 // ----------------------------- timeout_event class --------------------------
 
 timeout_event::timeout_event() :
-		event(), flow(NULL), seqnum(-1) { }
+		event(), flow(NULL) { }
 
-timeout_event::timeout_event(
-		double time, simulation &sim, netflow &flow, int seqnum) :
-				event(time, sim), flow(&flow), seqnum(seqnum) { }
+timeout_event::timeout_event(double time, simulation &sim, netflow &flow) :
+		event(time, sim, TIMEOUT_EVENT), flow(&flow) { }
 
 timeout_event::~timeout_event() { }
 
 void timeout_event::runEvent() {
 
-	// When this timeout_event was created so was a negative round-trip time
-	// in the flow for the packet that was being sent; if a corresponding
-	// ACK was received then then RTT was removed. So if there's no RTT
-	// for this sequence number then we don't need to run this timeout.
-	if (flow->getRoundTripTimes().find(seqnum) ==
-			flow->getRoundTripTimes().end()) {
-		return; // do nothing.
+	// Nothing left to retransmit.
+	if (flow->doneTransmitting()) {
+		flow->cancelFlowTimeout();
+		return;
 	}
 
 	if(debug && this) {
@@ -516,29 +787,23 @@ void timeout_event::runEvent() {
 				<< *this << endl;
 	}
 
-	// Resize the window, set the linear growth threshold, cancel the
-	// corresponding timeout locally (this event running means it was
-	// dequeued in the events queue).
+	// Resize the window, set the linear growth threshold, and back off the
+	// timeout length.
 	flow->timeoutOccurred();
 
 	// Now send the timed out packet again.
-	double linkFreeAt = flow->getSource()->getLink()->getLinkFreeAtTime();
+	double linkFreeAt = flow->getSource()->getLink()->getLinkFreeAtTime(
+			flow->getSource());
 	vector<packet> pkts_to_send =
 			flow->popOutstandingPackets(getTime(),
 					linkFreeAt == 0 ? getTime(): linkFreeAt);
 
-	// Iterate over the packets to send, making a send_packet_event for each.
-	// The timout_events have already been added to the flow and to the
-	// simulation's queue.
-	vector<packet>::iterator pkt_it = pkts_to_send.begin();
-	while(pkt_it != pkts_to_send.end()) {
-		pkt_it->setTransmitTimestamp(getTime());
-		send_packet_event *e = new send_packet_event(getTime(), *sim, *flow,
-				*pkt_it, *(flow->getSource()->getLink()),
-				*(flow->getSource()));
-		sim->addEvent(e);
-		pkt_it++;
-	}
+	// Send them all at once, as one train.
+	send_packet_event::sendWindow(getTime(), 0, *sim, *flow, pkts_to_send);
+
+	// Go off again if the retransmission doesn't get through either. This
+	// event was just popped so this puts it back on the queue.
+	flow->delayFlowTimeout(getTime() + flow->getTimeoutLengthMs());
 
 	// log data
 	double currTime = getTime();
@@ -567,7 +832,7 @@ ack_event::ack_event() :
 
 ack_event::ack_event(double time, simulation &sim,
 		netflow &flow, packet &dup_pkt) :
-				event(time, sim), flow(&flow), dup_pkt(dup_pkt) { }
+				event(time, sim, ACK_EVENT), flow(&flow), dup_pkt(dup_pkt) { }
 
 ack_event::~ack_event() { }
 
@@ -580,8 +845,8 @@ void ack_event::runEvent() {
 	}
 
 	// Make and queue the ACK's send_packet_event.
-	send_packet_event *e = new send_packet_event(getTime(), *sim, *flow,
-			dup_pkt, *(flow->getDestination()->getLink()),
+	send_packet_event *e = new (*sim) send_packet_event(getTime(), *sim,
+			*flow, dup_pkt, *(flow->getDestination()->getLink()),
 			*(flow->getDestination()));
 	sim->addEvent(e);
 
@@ -594,12 +859,29 @@ void ack_event::printHelper(ostream &os) {
 	event::printHelper(os);
 
 	flow->setNestingDepth(1);
-	dup_pkt.setNestingDepth(1);
 
 	os << "<-- ack_event. {" << endl <<
 			"  ack_pkt: " << dup_pkt << endl <<
 			"  flow: " << *flow << endl << "}";
 
 	flow->setNestingDepth(0);
-	dup_pkt.setNestingDepth(0);
+}
+
+// -------------------------- fluid_update_event class ------------------------
+
+fluid_update_event::fluid_update_event(double time, simulation &sim) :
+		event(time, sim, FLUID_UPDATE_EVENT) { }
+
+fluid_update_event::~fluid_update_event() { }
+
+void fluid_update_event::runEvent() {
+	double next = sim->getFluidModel().update(getTime());
+	if (next >= 0) {
+		sim->rescheduleEvent(this, next);
+	}
+}
+
+void fluid_update_event::printHelper(ostream &os) {
+	event::printHelper(os);
+	os << "<-- fluid_update_event.";
 }
@@ -10,11 +10,14 @@
 #define EVENTS_H
 
 // Standard includes.
+#include <cstddef>
 #include <iostream>
+#include <vector>
 
 // Custom headers
 #include "util.h"
 #include "network.h"
+#include "event_pool.h"
 
 // Forward declarations.
 class netevent;
@@ -24,12 +27,16 @@ class netnode;
 class nethost;
 class netrouter;
 class packet;
+class periodic_event;
 class router_discovery_event;
 class start_flow_event;
 class send_packet_event;
+class link_transmit_event;
 class receive_packet_event;
+class packet_train;
 class timeout_event;
 class ack_event;
+class fluid_update_event;
 class simulation;
 class eventTimeSorter;
 
@@ -39,6 +46,16 @@ extern bool debug;
 extern bool detail;
 extern ostream &debug_os;
 
+/**
+ * Tags for the concrete kinds of events, used by @c event::dispatch to run
+ * an event without a virtual call.
+ */
+enum event_type {
+	GENERIC_EVENT, RECEIVE_PACKET_EVENT, SEND_PACKET_EVENT,
+	LINK_TRANSMIT_EVENT, ACK_EVENT, START_FLOW_EVENT, TIMEOUT_EVENT,
+	PERIODIC_EVENT, FLUID_UPDATE_EVENT
+};
+
 // -------------------------------- event class -------------------------------
 
 /**
@@ -54,6 +71,23 @@ private:
 	/** ID number of this object. */
 	long id;
 
+	/**
+	 * Scheduler bookkeeping. While this event is queued the scheduler keeps
+	 * whatever it needs to find the event again in here (e.g. its heap
+	 * index or its bucket); otherwise it's @c NOT_SCHEDULED. This is what
+	 * makes cancelling and rescheduling cheap.
+	 */
+	long queue_slot;
+
+	/**
+	 * Timer wheel bookkeeping, like @c queue_slot but for events that are
+	 * armed as timers in the simulation's timer wheel.
+	 */
+	long timer_slot;
+
+	/** Which concrete kind of event this is. */
+	event_type type;
+
 protected:
 
 	/**
@@ -62,10 +96,43 @@ protected:
 	 */
 	simulation *sim;
 
+	/**
+	 * Like the public constructor, but for subclasses that @c dispatch
+	 * knows about.
+	 * @param time at which this event should run
+	 * @param sim
+	 * @param type tag of the subclass
+	 */
+	event(double time, simulation &sim, event_type type);
+
+	/**
+	 * Moves on to the next packet of a train this event carries: sets this
+	 * event's time to the packet's and swaps the packet into @c pkt. If
+	 * some other pending event would have run first, or the simulation is
+	 * over, puts this event back on the queue instead, so it handles the
+	 * packet when its turn comes. Either way packets are handled exactly
+	 * when separate events would have handled them.
+	 * @param train
+	 * @param pkt the packet just handled, to be replaced by the next one
+	 * @return true if the caller should handle @c pkt now
+	 */
+	bool nextInTrain(packet_train &train, packet &pkt);
+
 public:
 
-	/** Unique ID number generator. Initialized in corresponding cpp file. */
-	static long id_generator;
+	/**
+	 * Unique ID number generator. Initialized in corresponding cpp file.
+	 * One per thread, so simulations running on different threads don't
+	 * share any mutable state; within a simulation IDs still increase in
+	 * creation order, which is all the schedulers rely on.
+	 */
+	static thread_local long id_generator;
+
+	/**
+	 * Value of the queue and timer slots when an event isn't in a scheduler
+	 * or a timer wheel, respectively.
+	 */
+	static const long NOT_SCHEDULED = -1;
 
 	/** Default constructor; sets time and ID to -1 and simulation to NULL. */
 	event();
@@ -82,18 +149,112 @@ public:
 	/** Destructor */
 	virtual ~event();
 
+	/**
+	 * Allocates an event from the given simulation's event pool. Simulation
+	 * code should make events with <tt>new (sim) some_event(...)</tt> so they
+	 * get recycled instead of going through the global allocator.
+	 * @param size of the event
+	 * @param sim whose pool to allocate from
+	 * @return memory for the event
+	 */
+	static void *operator new(size_t size, simulation &sim);
+
+	/**
+	 * Allocates an event from the global heap. Fine for tests and other
+	 * one-offs.
+	 * @param size of the event
+	 * @return memory for the event
+	 */
+	static void *operator new(size_t size);
+
+	/**
+	 * Gives an event's memory back to wherever it came from. Each block
+	 * remembers its pool, so plain @c delete works for every event.
+	 * @param p memory of the event
+	 */
+	static void operator delete(void *p);
+
+	/**
+	 * Matches the pool version of @c new; only called if a constructor
+	 * throws.
+	 * @param p memory of the event
+	 * @param sim
+	 */
+	static void operator delete(void *p, simulation &sim);
+
 	/**
 	 * Getter for the time at which this event should run.
 	 * @return time at which this event should run.
 	 */
 	double getTime() const;
 
+	/**
+	 * Getter for this event's type tag.
+	 * @return type tag
+	 */
+	event_type getType() const;
+
 	/**
 	 * Getter for the unique ID number generated for this event.
 	 * @return ID number
 	 */
 	long getId() const;
 
+	/**
+	 * Checks if this event is waiting to run, either in the event queue or
+	 * as an armed timer.
+	 * @return true if queued or armed
+	 */
+	bool isScheduled() const;
+
+	/**
+	 * Checks if this event is currently sitting in a scheduler.
+	 * @return true if queued
+	 */
+	bool isQueued() const;
+
+	/**
+	 * Checks if this event is armed in a timer wheel.
+	 * @return true if armed
+	 */
+	bool isTimerArmed() const;
+
+	/**
+	 * Getter for the scheduler bookkeeping slot. Only schedulers should use
+	 * this.
+	 * @return queue slot, or @c NOT_SCHEDULED
+	 */
+	long getQueueSlot() const;
+
+	/**
+	 * Setter for the scheduler bookkeeping slot. Only schedulers should use
+	 * this.
+	 * @param slot
+	 */
+	void setQueueSlot(long slot);
+
+	/**
+	 * Getter for the timer wheel bookkeeping slot. Only timer wheels should
+	 * use this.
+	 * @return timer slot, or @c NOT_SCHEDULED
+	 */
+	long getTimerSlot() const;
+
+	/**
+	 * Setter for the timer wheel bookkeeping slot. Only timer wheels should
+	 * use this.
+	 * @param slot
+	 */
+	void setTimerSlot(long slot);
+
+	/**
+	 * Changes the time at which this event runs. Must not be called while
+	 * the event is queued or armed; use @c simulation::rescheduleEvent or
+	 * @c simulation::armTimer for that.
+	 * @param time
+	 */
+	void setTime(double time);
+
 	/**
 	 * Subclasses--i.e. more specific events--will run operations like
 	 * sending packets, adding new events to the simulation event queue, etc.
@@ -101,6 +262,16 @@ public:
 	 */
 	virtual void runEvent();
 
+	/**
+	 * Runs this event. Switches on the type tag and calls the tagged
+	 * class's @c runEvent directly, so the main loop's dispatch is a
+	 * predictable jump instead of a virtual call; untagged events fall back
+	 * to the virtual call. Tagged classes are final, or for periodic events
+	 * have a final @c runEvent, so no override can be skipped. Periodic
+	 * events still make one virtual call, to their @c fire.
+	 */
+	void dispatch();
+
 	/**
 	 * Print helper function. Derived classes should (partially) override this.
 	 * @param os The output stream to which to write event information.
@@ -121,6 +292,64 @@ inline ostream & operator<<(ostream &os, event &e) {
 	return os;
 }
 
+// ----------------------------- packet_train class ---------------------------
+
+/**
+ * Packets that follow the one an event carries, each due at its own time.
+ * A window's worth of packets sent back to back on a link, and their
+ * arrivals at the other end, ride in one event this way instead of one
+ * event each. Holds each packet's payload until it's handed out.
+ */
+class packet_train {
+
+private:
+
+	/** A packet and when it's due. */
+	struct car {
+		/** Time at which the packet is due, in ms. */
+		double time;
+		/** The packet. */
+		packet pkt;
+	};
+
+	/** Packets in the order they're due. */
+	vector<car> cars;
+
+	/** Index of the next packet to hand out. */
+	size_t next;
+
+public:
+
+	/** Makes an empty train. */
+	packet_train();
+
+	/** Releases the packets that were never handed out. */
+	~packet_train();
+
+	/** @return true if every packet has been handed out */
+	bool empty() const;
+
+	/**
+	 * Adds a packet to the end of the train.
+	 * @param time at which it's due; not before the last packet's
+	 * @param pkt
+	 */
+	void append(double time, packet &pkt);
+
+	/**
+	 * Getter for when the last packet is due. The train mustn't be empty.
+	 * @return time in ms
+	 */
+	double getLastTime() const;
+
+	/**
+	 * Hands out the next packet. The train mustn't be empty.
+	 * @param time set to when it's due
+	 * @param pkt set to the packet, which keeps the train's payload hold
+	 */
+	void pop(double &time, packet &pkt);
+};
+
 // --------------------------- receive_packet_event class ---------------------
 
 /**
@@ -128,7 +357,7 @@ inline ostream & operator<<(ostream &os, event &e) {
  * node (router) or a final destination (host). The packet can be a FLOW,
  * ACK, or ROUTING packet.
  */
-class receive_packet_event : public event {
+class receive_packet_event final : public event {
 
 private:
 
@@ -147,6 +376,12 @@ private:
 	/** Link on which this packet arrived. */
 	netlink *link;
 
+	/** Packets arriving right behind this one on the same link. */
+	packet_train train;
+
+	/** Handles the arrival of @c pkt; see @c runEvent. */
+	void receive();
+
 	/**
 	 * Constructor helper. Does naive assignments; logic should be in the
 	 * calling constructors.
@@ -202,9 +437,21 @@ public:
 	 * packet in the sequence. We also remove the flow's pending duplicate
 	 * ACK send_packet_event for the packet with the preceding sequence
 	 * number.
+	 *
+	 * Then does the same for each packet in this event's train, in turn.
 	 */
 	void runEvent();
 
+	/**
+	 * Adds a packet of the same flow arriving at the same node over the
+	 * same link to this event's train, if it arrives no earlier than the
+	 * packets already in it.
+	 * @param time arrival time
+	 * @param pkt
+	 * @return false if it arrives too early to join
+	 */
+	bool joinTrain(double time, packet &pkt);
+
 	/**
 	 * Print helper function.
 	 * @param os The output stream to which to write event information.
@@ -212,34 +459,110 @@ public:
 	void printHelper(ostream &os);
 };
 
+// ----------------------------- periodic_event class -------------------------
+
+/**
+ * Base class for timers that go off every so often. After @c fire runs the
+ * event re-arms itself one period later, so each timer has exactly one
+ * pending occurrence no matter how far ahead the simulation runs, and the
+ * number of pending events depends on the number of live timers rather than
+ * on the simulated horizon. A timer ends when it calls @c stop, when its
+ * next occurrence would be at or past its stop time, or when it's removed
+ * from the simulation.
+ */
+class periodic_event : public event {
+
+private:
+
+	/** Milliseconds between occurrences; zero for a one-off event. */
+	double period;
+
+	/** Don't go off at or after this time. */
+	double stop_time;
+
+	/** Set by @c stop; the timer won't be re-armed. */
+	bool stopped;
+
+protected:
+
+	/**
+	 * Does whatever the timer is for. Called every time it goes off.
+	 */
+	virtual void fire() = 0;
+
+	/** Keeps the timer from being re-armed after the current @c fire. */
+	void stop();
+
+public:
+
+	/**
+	 * Constructor.
+	 * @param time of the first occurrence
+	 * @param sim
+	 * @param period milliseconds between occurrences, zero for a one-off
+	 * @param stop_time the timer never goes off at or after this time
+	 */
+	periodic_event(double time, simulation &sim, double period,
+			double stop_time);
+
+	/** Destructor. */
+	virtual ~periodic_event();
+
+	/**
+	 * Getter for the period.
+	 * @return milliseconds between occurrences
+	 */
+	double getPeriod() const;
+
+	/**
+	 * Fires the timer then re-arms it unless it's done. Final, so that
+	 * @c dispatch can call it directly; timers customize @c fire instead.
+	 */
+	void runEvent() final;
+};
+
 // ------------------------- router_discovery_event class ---------------------
 
 /**
- * Event that triggers a given router's routing-table-population algorithm.
+ * Event that triggers every router's routing-table-population algorithm.
+ * Either runs once or periodically.
  */
-class router_discovery_event : public event {
+class router_discovery_event : public periodic_event {
 
 private:
 
 	/** Router whose routing table will be updated by this event. */
 	netrouter *router;
 
+protected:
+
+	/**
+	 * Runs the distributed Bellman-Ford algorithm from each router.
+	 */
+	void fire();
+
 public:
 
 	/**
-	 * Initializes this event's time to the given one and sets the event ID.
+	 * Makes a one-off routing update.
 	 * @param time
 	 * @param sim
 	 */
 	router_discovery_event(double time, simulation &sim);
 
-	/** Destructor */
-	~router_discovery_event();
-
 	/**
-	 * Runs the distributed Bellman-Ford algorithm from this router.
+	 * Makes a routing update that repeats every @c period milliseconds
+	 * until @c stop_time.
+	 * @param time of the first update
+	 * @param sim
+	 * @param period
+	 * @param stop_time
 	 */
-	void runEvent();
+	router_discovery_event(double time, simulation &sim, double period,
+			double stop_time);
+
+	/** Destructor */
+	~router_discovery_event();
 
 	/**
 	 * Print helper function.
@@ -251,32 +574,38 @@ public:
 // --------------------------- update_window_event class ------------------------
 
 /**
- * Event that triggers update of a given flow's window size. Only to be used
- * for FAST TCP.
+ * Periodic event that lets a flow's congestion control update its window,
+ * for algorithms like FAST TCP that want it. Stops once the flow is done
+ * transmitting.
  */
-class update_window_event : public event {
+class update_window_event : public periodic_event {
 
 private:
 
 	/** Flow whose window size will be modified by this event. */
 	netflow *flow;
 
+protected:
+
+	/** Calls the flow's congestion control's @c onUpdate. */
+	void fire();
+
 public: 
 
 	/**
 	 * Constructor.
-	 * @param time
+	 * @param time of the first update
 	 * @param sim
 	 * @param flow
+	 * @param period milliseconds between updates
+	 * @param stop_time no updates at or after this time
 	 */
-	update_window_event(double time, simulation &sim, netflow &flow);
+	update_window_event(double time, simulation &sim, netflow &flow,
+			double period, double stop_time);
 
 	/** Destructor. */
 	~update_window_event();
 
-	/** Updates window size based on FAST specifications. */
-	void runEvent();
-
 	/**
 	 * Print helper function.
 	 * @param os The output stream to which to write event information.
@@ -288,11 +617,11 @@ public:
 
 /**
  * Sends a packet from a given departure node and down a given link whether
- * it's an ACK, FLOW, or ROUTING packet. Assumes that timeout_events
+ * it's an ACK, FLOW, or ROUTING packet. Assumes that the flow's timer
  * and other flow attributes like highest_sent_seqnum have been dealt with
  * before this event runs.
  */
-class send_packet_event : public event {
+class send_packet_event final : public event {
 
 private:
 
@@ -308,9 +637,21 @@ private:
 	/** Node from which the packet is going to leave. */
 	netnode *departure_node;
 
+	/** Packets of the same flow sent right after this one. */
+	packet_train train;
+
+	/**
+	 * Arrival event made for the last packet this event sent, while it can
+	 * still take the next packet's arrival; NULL otherwise.
+	 */
+	receive_packet_event *last_arrival;
+
 	/** @return node at which this packet arrives. */
 	netnode *getDestinationNode() const;
 
+	/** Sends @c pkt; see @c runEvent. */
+	void send();
+
 	/**
 	 * Constructor helper. Does naive assignments; logic should be in the
 	 * calling constructors.
@@ -358,9 +699,81 @@ public:
 	 * Finds time of arrival to next node from the given departure node down
 	 * the given link and uses the arrival time to queue a receive_packet_event
 	 * (does nothing if the link buffer has no room, thereby dropping the
-	 * packet). Doesn't make or queue timeout events because they should have
-	 * been made and queued in parallel with the send_packet_event.
+	 * packet). Doesn't touch timers; each flow has one retransmission timer
+	 * that it manages itself.
+	 *
+	 * Then does the same for each packet in this event's train, in turn.
+	 * Consecutive packets that get through share one receive_packet_event.
+	 */
+	void runEvent();
+
+	/**
+	 * Sends a flow's packets from its source, the first one at the given
+	 * time and each of the rest @c spacing ms after the one before, or as
+	 * much later as the flow's pacing says. They all ride in one event.
+	 * @param time
+	 * @param spacing in ms
+	 * @param sim
+	 * @param flow
+	 * @param pkts packets to send, in order; their transmit timestamps are
+	 * set to @c time, or to when they go out if the flow is paced, and
+	 * they're ECN-capable if the flow's congestion control is
+	 */
+	static void sendWindow(double time, double spacing, simulation &sim,
+			netflow &flow, vector<packet> &pkts);
+
+	/**
+	 * Print helper function.
+	 * @param os The output stream to which to write event information.
+	 */
+	void printHelper(ostream &os);
+};
+
+// -------------------------- link_transmit_event class -----------------------
+
+/**
+ * Runs when one of a link's transmitters has finished putting a packet on
+ * the wire. Only links with a queue discipline use these: the transmitter
+ * asks the queue discipline for the next packet, if any, queues its
+ * arrival, and queues another of these for when that one's on the wire.
+ */
+class link_transmit_event final : public event {
+
+private:
+
+	/** The link. */
+	netlink *link;
+
+	/** Which of the link's transmitters; see @c netlink::directionIndex. */
+	int transmitter;
+
+public:
+
+	/**
+	 * @param time at which the transmitter is free
+	 * @param sim
+	 * @param link
+	 * @param transmitter
+	 */
+	link_transmit_event(double time, simulation &sim, netlink &link,
+			int transmitter);
+
+	/** Destructor. */
+	~link_transmit_event();
+
+	/**
+	 * Sends the next packet from a link's queue discipline, if any: queues
+	 * its arrival and the @c link_transmit_event for when it's on the wire.
+	 * Otherwise leaves the transmitter idle.
+	 * @param time now
+	 * @param sim
+	 * @param link
+	 * @param transmitter must be idle or just finished
 	 */
+	static void transmitNext(double time, simulation &sim, netlink &link,
+			int transmitter);
+
+	/** Sends the next packet, if any. */
 	void runEvent();
 
 	/**
@@ -374,10 +787,9 @@ public:
 
 /**
  * Event that runs when a flow is about to start. Sends the first packet and
- * has the flow register a timeout event internally and queue it up in the
- * simulation's event queue.
+ * has the flow start its retransmission timer.
  */
-class start_flow_event : public event {
+class start_flow_event final : public event {
 
 private:
 
@@ -399,8 +811,8 @@ public:
 	~start_flow_event();
 
 	/**
-	 * Sends the first packet in this event's flow and queues a timeout_event
-	 * internally and on the simulation event queue.
+	 * Sends the first packet in this event's flow and starts the flow's
+	 * retransmission timer.
 	 */
 	void runEvent();
 
@@ -414,21 +826,20 @@ public:
 // ---------------------------- timeout_event class ---------------------------
 
 /**
- * Event that sets the window size to one then sends a packet. This event
- * queues another timeout_event; timeout_events are chained so that the
- * flow will keep trying to send packets in the face of timeouts indefinitely.
- * @deprecated because timeouts aren't currently being used
+ * A flow's retransmission timer. Each flow has exactly one, made when the
+ * flow starts; every ACK that makes progress pushes it back by the flow's
+ * timeout length using @c simulation::armTimer, so it only runs if
+ * the flow hasn't heard anything useful for that long. When it runs it
+ * shrinks the window to one, resends from the first unacknowledged packet,
+ * and re-arms itself.
  */
-class timeout_event : public event {
+class timeout_event final : public event {
 
 private:
 
 	/** Flow to which to register a timeout. */
 	netflow *flow;
 
-	/** Sequence number that timed out. */
-	int seqnum;
-
 public:
 
 	/** Default constructor, sets everything to dummy or NULL. */
@@ -441,18 +852,18 @@ public:
 	 * @param time
 	 * @param sim
 	 * @param flow
-	 * @param seqnum
 	 */
-	timeout_event(double time, simulation &sim, netflow &flow, int seqnum);
+	timeout_event(double time, simulation &sim, netflow &flow);
 
 	/** Destructor. */
 	~timeout_event();
 
 	/**
 	 * Registers a timeout with the flow, which means it changes its window
-	 * size and linear growth threshold internally. This function also chains
-	 * (queues another) timeout_event and sends a packet by queueing a new
-	 * send_packet_event.
+	 * size and linear growth threshold internally. This function also sends
+	 * the lost packet by queueing a new send_packet_event and puts itself
+	 * back on the queue for the next timeout. Does nothing but cancel the
+	 * timer if the flow is done.
 	 */
 	void runEvent();
 
@@ -473,7 +884,7 @@ public:
  * ack_events should be cancelled when the destination gets the
  * correct FLOW packet.
  */
-class ack_event : public event {
+class ack_event final : public event {
 
 private:
 
@@ -514,4 +925,31 @@ public:
 	void printHelper(ostream &os);
 };
 
+/**
+ * Brings the simulation's fluid model up to date, then puts itself back on
+ * the queue for whenever the model says its rates next change.
+ */
+class fluid_update_event final : public event {
+
+public:
+
+	/**
+	 * @param time
+	 * @param sim
+	 */
+	fluid_update_event(double time, simulation &sim);
+
+	/** Destructor. */
+	~fluid_update_event();
+
+	/** Updates the fluid model and reschedules itself if needed. */
+	void runEvent();
+
+	/**
+	 * Print helper function.
+	 * @param os The output stream to which to write event information.
+	 */
+	void printHelper(ostream &os);
+};
+
 #endif // EVENTS_H
@@ -0,0 +1,267 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+#include <limits>
+#include <map>
+#include <queue>
+
+// Custom headers.
+#include "fluid_model.h"
+
+/** Bytes left below which a fluid flow counts as finished. */
+static const double FLUID_EPSILON_BYTES = 1e-6;
+
+fluid_model::fluid_model() : has_fluid(false), last_update(0) { }
+
+/**
+ * Names the transmitter a flow uses on a link. Both directions of a
+ * half-duplex link share one.
+ */
+static pair<int, int> transmitterKey(const netlink *link, int dir) {
+	return make_pair(link->getId(), link->isFullDuplex() ? dir : 0);
+}
+
+bool fluid_model::findPath(netnode &source, netnode &destination,
+		int num_nodes, vector<netlink *> &links, vector<int> &dirs) {
+
+	// Breadth-first search from the source, remembering how each node was
+	// first reached. Links are tried in the order the nodes list them, so
+	// ties always break the same way.
+	vector<netlink *> reached_by(num_nodes, NULL);
+	vector<bool> seen(num_nodes, false);
+	queue<netnode *> frontier;
+	seen[source.getId()] = true;
+	frontier.push(&source);
+	while (!frontier.empty() && !seen[destination.getId()]) {
+		netnode *node = frontier.front();
+		frontier.pop();
+		const vector<netlink *> &node_links = node->getLinks();
+		for (vector<netlink *>::const_iterator it = node_links.begin();
+				it != node_links.end(); it++) {
+			netnode *next = node->getOtherNode(*it);
+			if (!seen[next->getId()]) {
+				seen[next->getId()] = true;
+				reached_by[next->getId()] = *it;
+				frontier.push(next);
+			}
+		}
+	}
+	if (!seen[destination.getId()]) {
+		return false;
+	}
+
+	// Walk back from the destination.
+	links.clear();
+	dirs.clear();
+	for (netnode *node = &destination; node != &source; ) {
+		netlink *link = reached_by[node->getId()];
+		links.insert(links.begin(), link);
+		dirs.insert(dirs.begin(), link->directionIndex(node));
+		node = node->getOtherNode(link);
+	}
+	return true;
+}
+
+void fluid_model::addFlow(netflow &flow, int num_nodes, double cap_mbps) {
+	path_flow entry;
+	entry.flow = &flow;
+	entry.fluid = flow.isFluid();
+	bool found = findPath(*flow.getSource(), *flow.getDestination(),
+			num_nodes, entry.links, entry.dirs);
+	assert(found);
+	(void) found;
+	entry.delay_ms = 0;
+	for (vector<netlink *>::iterator it = entry.links.begin();
+			it != entry.links.end(); it++) {
+		entry.delay_ms += (*it)->getDelay();
+	}
+	entry.cap_bpms = cap_mbps * BYTES_PER_MEGABIT / MS_PER_SEC;
+	entry.rate_bpms = 0;
+	entry.remaining_bytes = flow.getSizeMb() * BYTES_PER_MEGABIT;
+	flows.push_back(entry);
+	has_fluid = has_fluid || entry.fluid;
+}
+
+bool fluid_model::hasFluidFlows() const { return has_fluid; }
+
+double fluid_model::getFirstStartTime() const {
+	double first = numeric_limits<double>::max();
+	for (vector<path_flow>::const_iterator it = flows.begin();
+			it != flows.end(); it++) {
+		if (it->fluid) {
+			first = min(first, it->flow->getStartTimeMs());
+		}
+	}
+	return first;
+}
+
+bool fluid_model::isActive(path_flow &flow, double now) const {
+	if (flow.flow->getStartTimeMs() > now) {
+		return false;
+	}
+	return flow.fluid ? flow.remaining_bytes > FLUID_EPSILON_BYTES :
+			!flow.flow->doneTransmitting();
+}
+
+void fluid_model::solve(double now) {
+
+	// Resources are link transmitters, keyed by link ID and direction.
+	map<pair<int, int>, double> capacity;
+	map<pair<int, int>, int> unfrozen_count;
+	vector<path_flow *> unfrozen;
+	for (vector<path_flow>::iterator it = flows.begin(); it != flows.end();
+			it++) {
+		it->rate_bpms = 0;
+		if (!isActive(*it, now)) {
+			continue;
+		}
+		unfrozen.push_back(&*it);
+		for (size_t i = 0; i < it->links.size(); i++) {
+			pair<int, int> key = transmitterKey(it->links[i], it->dirs[i]);
+			if (capacity.find(key) == capacity.end()) {
+				capacity[key] = it->links[i]->getRateBytesPerMs() *
+						FLUID_MAX_UTILIZATION;
+			}
+			unfrozen_count[key]++;
+		}
+	}
+
+	while (!unfrozen.empty()) {
+
+		// Raise everyone's rate by the most the tightest constraint allows.
+		double step = numeric_limits<double>::max();
+		for (map<pair<int, int>, int>::iterator it = unfrozen_count.begin();
+				it != unfrozen_count.end(); it++) {
+			if (it->second > 0) {
+				step = min(step, capacity[it->first] / it->second);
+			}
+		}
+		for (vector<path_flow *>::iterator it = unfrozen.begin();
+				it != unfrozen.end(); it++) {
+			if ((*it)->cap_bpms > 0) {
+				step = min(step, (*it)->cap_bpms - (*it)->rate_bpms);
+			}
+		}
+		if (step == numeric_limits<double>::max()) {
+			break; // nothing limits what's left, i.e. it uses no links
+		}
+		for (vector<path_flow *>::iterator it = unfrozen.begin();
+				it != unfrozen.end(); it++) {
+			(*it)->rate_bpms += step;
+			for (size_t i = 0; i < (*it)->links.size(); i++) {
+				capacity[transmitterKey((*it)->links[i], (*it)->dirs[i])] -=
+						step;
+			}
+		}
+
+		// Freeze flows that hit their cap or cross a full link.
+		vector<path_flow *> still_unfrozen;
+		for (vector<path_flow *>::iterator it = unfrozen.begin();
+				it != unfrozen.end(); it++) {
+			path_flow *flow = *it;
+			bool frozen = flow->cap_bpms > 0 &&
+					flow->rate_bpms >= flow->cap_bpms * (1 - 1e-9);
+			for (size_t i = 0; i < flow->links.size() && !frozen; i++) {
+				pair<int, int> key =
+						transmitterKey(flow->links[i], flow->dirs[i]);
+				frozen = capacity[key] <=
+						flow->links[i]->getRateBytesPerMs() * 1e-9;
+			}
+			if (!frozen) {
+				still_unfrozen.push_back(flow);
+				continue;
+			}
+			for (size_t i = 0; i < flow->links.size(); i++) {
+				unfrozen_count[transmitterKey(flow->links[i],
+						flow->dirs[i])]--;
+			}
+		}
+		unfrozen.swap(still_unfrozen);
+	}
+
+	// The fluid flows' rates are the links' background load.
+	for (vector<netlink *>::iterator it = loaded_links.begin();
+			it != loaded_links.end(); it++) {
+		(*it)->setBackgroundRate(0, 0);
+		(*it)->setBackgroundRate(1, 0);
+	}
+	loaded_links.clear();
+	for (vector<path_flow>::iterator it = flows.begin(); it != flows.end();
+			it++) {
+		if (!it->fluid || it->rate_bpms == 0) {
+			continue;
+		}
+		for (size_t i = 0; i < it->links.size(); i++) {
+			netlink *link = it->links[i];
+			for (int dir = 0; dir < 2; dir++) {
+				if (dir == it->dirs[i] || !link->isFullDuplex()) {
+					link->setBackgroundRate(dir,
+							link->getBackgroundRate(dir) + it->rate_bpms);
+				}
+			}
+			loaded_links.push_back(link);
+		}
+	}
+}
+
+double fluid_model::update(double now) {
+	assert(now >= last_update);
+
+	// Credit fluid flows with what they sent since the last update.
+	double elapsed = now - last_update;
+	for (vector<path_flow>::iterator it = flows.begin(); it != flows.end();
+			it++) {
+		if (!it->fluid || it->rate_bpms == 0) {
+			continue;
+		}
+		double sent = min(it->rate_bpms * elapsed, it->remaining_bytes);
+		it->remaining_bytes -= sent;
+		if (it->remaining_bytes <= FLUID_EPSILON_BYTES) {
+			sent += it->remaining_bytes;
+			it->remaining_bytes = 0;
+		}
+		it->flow->receivedFluid(sent / BYTES_PER_MEGABIT, now + it->delay_ms);
+	}
+	last_update = now;
+
+	solve(now);
+
+	// Rates next change when a flow starts or a fluid flow finishes. Packet
+	// flows finishing can't be predicted, so check back now and then while
+	// any are sharing the network with fluid flows.
+	double next = numeric_limits<double>::max();
+	bool fluid_active = false, packets_active = false;
+	for (vector<path_flow>::iterator it = flows.begin(); it != flows.end();
+			it++) {
+		double start = it->flow->getStartTimeMs();
+		if (start > now) {
+			next = min(next, start);
+		}
+		else if (isActive(*it, now)) {
+			if (it->fluid) {
+				fluid_active = true;
+				next = min(next, now + it->remaining_bytes / it->rate_bpms);
+			}
+			else {
+				packets_active = true;
+			}
+		}
+	}
+	if (fluid_active && packets_active) {
+		next = min(next, now + FLUID_UPDATE_INTERVAL);
+	}
+	return next == numeric_limits<double>::max() ? -1 : next;
+}
+
+double fluid_model::getRateMbps(const netflow &flow) const {
+	for (vector<path_flow>::const_iterator it = flows.begin();
+			it != flows.end(); it++) {
+		if (it->flow == &flow) {
+			return it->rate_bpms * MS_PER_SEC / BYTES_PER_MEGABIT;
+		}
+	}
+	return 0;
+}
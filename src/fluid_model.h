@@ -0,0 +1,133 @@
+/**
+ * @file
+ *
+ * Contains the fluid model that carries bulk flows as rates instead of
+ * packets.
+ */
+
+#ifndef FLUID_MODEL_H
+#define FLUID_MODEL_H
+
+// Standard includes.
+#include <vector>
+
+// Custom headers.
+#include "network.h"
+
+using namespace std;
+
+// ------------------------------ fluid_model class ---------------------------
+
+/**
+ * Carries the simulation's fluid flows. A fluid flow sends no packets: it's
+ * a rate along a fixed shortest path, and its data arrives continuously at
+ * that rate. Rates are max-min fair and only change when a flow starts or
+ * finishes, so a fluid flow costs a few events however big it is.
+ *
+ * Packet-level flows compete for the same links. The model reserves each
+ * one a max-min fair share along its own shortest path, and the links carry
+ * the fluid flows' total rate as background load, which slows down packet
+ * transmissions accordingly. The packet flows' actual rates don't feed back
+ * into the fluid rates, and neither fluid flows' ACKs nor any queueing delay
+ * they'd cause are modeled.
+ */
+class fluid_model {
+
+private:
+
+	/** A flow the model knows about: fluid, or packet-level competition. */
+	struct path_flow {
+		/** The flow. */
+		netflow *flow;
+		/** True for fluid flows. */
+		bool fluid;
+		/** Links along the flow's path. */
+		vector<netlink *> links;
+		/** Index of each link's transmitter along the path. */
+		vector<int> dirs;
+		/** Sum of the links' propagation delays. */
+		double delay_ms;
+		/** Fluid flows: most bytes per ms the flow wants, or 0 for no cap. */
+		double cap_bpms;
+		/** Current rate or reserved share in bytes per ms. */
+		double rate_bpms;
+		/** Fluid flows: bytes left to send. */
+		double remaining_bytes;
+	};
+
+	/** Flows in the order they were added. */
+	vector<path_flow> flows;
+
+	/** True if any of @c flows is fluid. */
+	bool has_fluid;
+
+	/** Time in ms up to which fluid flows' progress has been counted. */
+	double last_update;
+
+	/** Links carrying background load, so it can be cleared. */
+	vector<netlink *> loaded_links;
+
+	/**
+	 * @param flow
+	 * @param now
+	 * @return true if the flow should have a rate at time @c now
+	 */
+	bool isActive(path_flow &flow, double now) const;
+
+	/**
+	 * Gives every active flow its max-min fair rate by progressive filling:
+	 * all unfrozen flows' rates go up together until a link fills or a flow
+	 * hits its cap, those flows are frozen, and so on.
+	 * @param now
+	 */
+	void solve(double now);
+
+public:
+
+	fluid_model();
+
+	/**
+	 * Finds a path with the fewest links from one node to another.
+	 * @param source
+	 * @param destination
+	 * @param num_nodes number of nodes in the network; IDs are below this
+	 * @param links set to the links along the path
+	 * @param dirs set to the index of each link's transmitter along it
+	 * @return false if there's no path
+	 */
+	static bool findPath(netnode &source, netnode &destination,
+			int num_nodes, vector<netlink *> &links, vector<int> &dirs);
+
+	/**
+	 * Adds a flow. Nodes must be numbered.
+	 * @param flow
+	 * @param num_nodes number of nodes in the network
+	 * @param cap_mbps fluid flows: most the flow may send, in megabits per
+	 * second, or 0 for no cap
+	 */
+	void addFlow(netflow &flow, int num_nodes, double cap_mbps = 0);
+
+	/** @return true if there are any fluid flows */
+	bool hasFluidFlows() const;
+
+	/** @return the earliest start time of any fluid flow, in ms */
+	double getFirstStartTime() const;
+
+	/**
+	 * Brings the model up to the given time: credits fluid flows with what
+	 * they've sent, finishes the ones that are done, starts the ones due,
+	 * and re-solves the rates.
+	 * @param now in ms; not before the last update
+	 * @return when to update next, or a negative number if there's no need
+	 */
+	double update(double now);
+
+	/**
+	 * @param flow
+	 * @return the flow's current rate or reserved share in megabits per
+	 * second, or 0 if the model doesn't know it
+	 */
+	double getRateMbps(const netflow &flow) const;
+};
+
+#endif // FLUID_MODEL_H
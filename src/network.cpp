@@ -4,18 +4,24 @@
 
 // Custom headers.
 #include "network.h"
+#include "congestion_control.h"
+#include "queue_discipline.h"
 #include "simulation.h"
 
 // ------------------------------ netelement class ----------------------------
 
-netelement::netelement() : name(""), nest_depth(0) { }
+netelement::netelement() : name(""), nest_depth(0), id(-1) { }
 
-netelement::netelement(string name) : name(name), nest_depth(0) { }
+netelement::netelement(string name) : name(name), nest_depth(0), id(-1) { }
 
 netelement::~netelement() { }
 
 const string &netelement::getName() const { return name; }
 
+int netelement::getId() const { return id; }
+
+void netelement::setId(int id) { this->id = id; }
+
 void netelement::setNestingDepth(int depth) { 
 	if (this) {
 		this->nest_depth = depth; 
@@ -52,14 +58,10 @@ bool netnode::isRoutingNode() const { return false; }
 
 netnode *netnode::getOtherNode(netlink *link) {
 	// Confirm that this node is indeed connected to input link
-	assert((strcmp(this->getName().c_str(),
-				   link->getEndpoint1()->getName().c_str()) == 0) ||
-		   (strcmp(this->getName().c_str(),
-				   link->getEndpoint2()->getName().c_str()) == 0));
+	assert(link->getEndpoint1() == this || link->getEndpoint2() == this);
 
 	netnode *other_node;
-	if (strcmp(link->getEndpoint1()->getName().c_str(),
-						       this->getName().c_str()) == 0) {
+	if (link->getEndpoint1() == this) {
 		other_node = link->getEndpoint2();
 	}
 	else {
@@ -111,58 +113,58 @@ void nethost::printHelper(ostream &os) const {
 
 // ------------------------------ netrouter class -----------------------------
 
-netrouter::netrouter () : netnode() { }
+netrouter::netrouter () : netnode(), rdistances(NULL), nodes(NULL) { }
 
-netrouter::netrouter (string name) : netnode(name) { }
+netrouter::netrouter (string name) :
+	netnode(name), rdistances(NULL), nodes(NULL) { }
 
 netrouter::netrouter (string name, vector<netlink *> links) :
-	netnode(name, links) { }
+	netnode(name, links), rdistances(NULL), nodes(NULL) { }
 
-bool netrouter::isRoutingNode() const { return true; }
+netrouter::~netrouter () {
+	if (rdistances != NULL) {
+		rdistances->release();
+	}
+}
 
-map<netlink *, packet> netrouter::receivePacket(double time, simulation &sim,
-		netflow &flow, packet &pkt) {
- 
-	map<netlink *, packet> link_pkt_map;	
-	netlink *link_to_use = rtable.at(pkt.getDestination());
-	link_pkt_map[link_to_use] = pkt;
+bool netrouter::isRoutingNode() const { return true; }
 
-	return link_pkt_map;
+netlink *netrouter::receivePacket(double time, simulation &sim,
+		netflow &flow, const packet &pkt) {
+	return rtable.at(pkt.getDestinationId());
 }
 
 void netrouter::receiveRoutingPacket(double time, simulation &sim, 
-			packet &pkt, netlink &link) {
+			const packet &pkt, netlink &link) {
 
 	// Update routing table as follows: For each destination,
 	// if distance reported by the packet is less than the distance
-	// stored in the router's rdistances map, update with the new
+	// stored in the router's rdistances table, update with the new
 	// distance and set the link_ptr in rtable to the link on
 	// which the packet arrived.
 
-	map<string, double> received_dist = pkt.getDistances();
-	map<string, double>::iterator it = received_dist.begin();
+	const vector<double> &received_dist = pkt.getDistances()->getDistances();
 	bool updated = false;
 	double travel_time = time - pkt.getTransmitTimestamp(); 			
 
-	while (it != received_dist.end()) {
-		string key = it->first;
+	for (unsigned int key = 0; key < received_dist.size(); key++) {
 
-		if (it->second + travel_time < rdistances[key]) {
+		if (received_dist[key] + travel_time <
+				rdistances->getDistances()[key]) {
 			updated = true;
 		
-			rdistances[key] = it->second + travel_time;
+			editDistances()[key] = received_dist[key] + travel_time;
 
 			// Set link_ptr in routing table to link this packet came from.
 			rtable[key] = &link;
 
 		}
-		it++;
 	}
 
 	if (updated) {
 		// Send routing packets to adjacent routers.
 
-		vector<netlink *> adj_links = getLinks();
+		const vector<netlink *> &adj_links = getLinks();
 		for (unsigned i = 0; i < adj_links.size(); i++) {
 
 			netnode *other_node = this->getOtherNode(adj_links[i]);
@@ -170,14 +172,13 @@ void netrouter::receiveRoutingPacket(double time, simulation &sim,
 			// Check if other_node points to router
 			if (other_node->isRoutingNode()) {
 
-				packet rpack = packet(ROUTING, this->getName(),
-						other_node->getName());
-				rpack.setDistances(rdistances); 
+				packet rpack = packet(ROUTING, *this, *other_node);
+				rpack.setDistances(rdistances);
 				rpack.setTransmitTimestamp(time); // Time that packet is sent
 
 				// Queue up new packet. Send_packet_event will check when the
 				// link is free.
-				send_packet_event *e = new send_packet_event(time, sim,
+				send_packet_event *e = new (sim) send_packet_event(time, sim,
 					rpack, *adj_links[i], *this);
 				sim.addEvent(e);
 
@@ -188,65 +189,75 @@ void netrouter::receiveRoutingPacket(double time, simulation &sim,
 
 }
 
-map<string, double> netrouter::getRDistances() const { return rdistances; }
+const vector<double> &netrouter::getRDistances() const {
+	return rdistances->getDistances();
+}
 
-void netrouter::resetDistances(map<string, nethost*> host_list, 
-							   map<string, netrouter*> router_list) {
-	// Reset distances to routers
-	for (map<string, netrouter*>::iterator it_r = router_list.begin();
-		 it_r != router_list.end(); it_r++) {
+const distance_vector *netrouter::getDistanceVector() const {
+	return rdistances;
+}
 
-		// Set distance to others = infinity
-		if (strcmp(it_r->first.c_str(), getName().c_str()) != 0) {
-			rdistances[it_r->first] = numeric_limits<double>::max();
-		}
+vector<double> &netrouter::editDistances() {
+	if (rdistances->isShared()) {
+		distance_vector *copy =
+				new distance_vector(rdistances->getDistances());
+		copy->retain();
+		rdistances->release();
+		rdistances = copy;
 	}
-	// Reset distances to hosts
-	for (map<string, nethost*>::iterator it_h = host_list.begin();
-		it_h != host_list.end(); it_h++) {
-		// Check if connected to this router
-		nethost *host = it_h->second;
+	return rdistances->getMutableDistances();
+}
+
+void netrouter::resetDistances() {
+	const double infinity = numeric_limits<double>::max();
+	for (unsigned int i = 0; i < nodes->size(); i++) {
+		netnode *node = (*nodes)[i];
+		bool reset;
 
-		if (strcmp(host->getOtherNode(host->getLink())->getName().c_str(),
-					getName().c_str()) != 0) {
-			rdistances[it_h->first] = numeric_limits<double>::max();
+		// Set distance to other routers = infinity
+		if (node->isRoutingNode()) {
+			reset = node != this;
+		}
+		// Same for hosts that aren't connected to this router
+		else {
+			nethost *host = dynamic_cast<nethost *>(node);
+			reset = host->getOtherNode(host->getLink()) != this;
+		}
+
+		// Only copy the distances if this actually changes them
+		if (reset && rdistances->getDistances()[i] != infinity) {
+			editDistances()[i] = infinity;
 		}
 	}
 }
 
-void netrouter::initializeTables(map<string, nethost*> host_list, 
-								 map<string, netrouter*> router_list) {
-	// Add routers
-	for (map<string, netrouter*>::iterator it_r = router_list.begin();
-		 it_r != router_list.end(); it_r++) {
+void netrouter::initializeTables(const vector<netnode *> &nodes) {
+	this->nodes = &nodes;
+	rtable.assign(nodes.size(), NULL);
+	vector<double> distances(nodes.size(), numeric_limits<double>::max());
 
-		rtable[it_r->first] = NULL;
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		netnode *node = nodes[i];
 
 		// Set distance to self = 0
-		if (strcmp(it_r->first.c_str(), getName().c_str()) == 0) {
-			rdistances[it_r->first] = 0;
+		if (node == this) {
+			distances[i] = 0;
 		}
-		// Set distance to others = infinity
-		else {
-			rdistances[it_r->first] = numeric_limits<double>::max();
+		// Hosts connected to this router are 0 away, down their only link
+		else if (!node->isRoutingNode()) {
+			nethost *host = dynamic_cast<nethost *>(node);
+			if (host->getOtherNode(host->getLink()) == this) {
+				rtable[i] = host->getLink();
+				distances[i] = 0;
+			}
 		}
 	}
-	// Add hosts
-	for (map<string, nethost*>::iterator it_h = host_list.begin();
-		it_h != host_list.end(); it_h++) {
-		// Check if connected to this router
-		nethost *host = it_h->second;
 
-		if (strcmp(host->getOtherNode(host->getLink())->getName().c_str(),
-					getName().c_str()) == 0) {
-			rtable[it_h->first] = host->getLink();
-			rdistances[it_h->first] = 0;
-		}
-		else {
-			rtable[it_h->first] = NULL;
-			rdistances[it_h->first] = numeric_limits<double>::max();
-		}
+	if (rdistances != NULL) {
+		rdistances->release();
 	}
+	rdistances = new distance_vector(distances);
+	rdistances->retain();
 }
 
 void netrouter::printHelper(ostream &os) const {
@@ -257,21 +268,19 @@ void netrouter::printHelper(ostream &os) const {
 		return;
 	}
 	os << "{ " << endl;
-	map<string, netlink *>::const_iterator itr;
-	for (itr = rtable.begin(); itr != rtable.end(); itr++) {
-		string link_name = (itr->second == NULL) ? 
-							"Out-link not set" : itr->second->getName();
+	for (unsigned int i = 0; i < rtable.size(); i++) {
+		string link_name = (rtable[i] == NULL) ? 
+							"Out-link not set" : rtable[i]->getName();
 		os << nestingPrefix(1) << "(" <<
-				itr->first << "<--" << link_name << ")" << endl;
+				(*nodes)[i]->getName() << "<--" << link_name << ")" << endl;
 	}
 	os << nestingPrefix(0) << "}";
 
 	os << "{ " << endl;
 	os << " <-- router. routing distances: " << endl;
-	map<string, double>::const_iterator itr_d;
-	for(itr_d = rdistances.begin(); itr_d != rdistances.end(); itr_d++) {
-		os << nestingPrefix(1) << "(" <<
-				itr_d->first << "<--" << itr_d->second << ")" << endl;
+	for (unsigned int i = 0; i < rtable.size(); i++) {
+		os << nestingPrefix(1) << "(" << (*nodes)[i]->getName() << "<--" <<
+				rdistances->getDistances()[i] << ")" << endl;
 	}
 	os << nestingPrefix(0) << "}";
 }
@@ -288,31 +297,32 @@ void netflow::constructorHelper (double start_time, double size_mb,
 	this->destination = &destination;
 	
 	this->amt_received_mb = 0;
-	this->pktTally = 0;
-	this->leftTime = start_time;
-	this->rightTime = start_time + RATE_INTERVAL;
 	
 	this->highest_received_ack_seqnum = 1;
+	this->rtts = seq_window<double>(1);
 	this->highest_sent_flow_seqnum = 0;
 	this->next_ack_seqnum = 1;
-	this->window_size = window_size;
 	this->window_start = 1;
 	this->num_duplicate_acks = 0;
 	this->timeout_length_ms = timeout_length_ms;
-	this->lin_growth_winsize_threshold = -1;
 	this->avg_RTT = -1;
 	this->std_RTT = -1;
 	this->min_RTT = numeric_limits<double>::max();
 	this->pkt_RTT = -1;
-	this->FAST_TCP = usingFAST;
+	this->congestion = congestion_control::makeCongestionControl(
+			usingFAST ? FAST_CC : TAHOE_CC, *this, window_size);
+	this->next_paced_time = 0;
+	this->traffic_class = 0;
+	this->fluid = false;
 	this->dont_send_duplicate_ack_until = -1;
 	this->waiting_for_seqnum_before_resuming = -1;
+	this->flow_timeout = NULL;
+	this->completion_time_ms = -1;
 	
 	this->sim = &sim;
-	
-	// initialize all values of received vector except index 0 to false
-	received = vector<bool> (getNumTotalPackets(), false);	
-	this->received[0] = true;
+
+	// Flow packets are numbered from 1.
+	this->received = seq_bitmap(1);
 }
 
 netflow::netflow (string name, double start_time, double size_mb,
@@ -330,6 +340,10 @@ netflow::netflow (string name, double start_time, double size_mb,
 			false, DEFAULT_INITIAL_TIMEOUT, sim);
 }
 
+netflow::~netflow() {
+	delete congestion;
+}
+
 double netflow::getStartTimeSec() const { return start_time_sec; }
 
 double netflow::getStartTimeMs() const { return start_time_sec * MS_PER_SEC; }
@@ -358,8 +372,8 @@ void netflow::setSource(nethost &source) {
 }
 
 
-int netflow::getPktTally() const {
-	return pktTally;
+int netflow::getPktTally(double time) const {
+	return received_bytes.getTotal(time) / FLOW_PACKET_SIZE;
 }
 
 double netflow::getAvgRTT() const {
@@ -370,58 +384,65 @@ double netflow::getMinRTT() const {
 	return min_RTT;
 }
 
-bool netflow::isUsingFAST() const {
-	return FAST_TCP;
+congestion_control &netflow::getCongestionControl() { return *congestion; }
+
+int netflow::getTrafficClass() const { return traffic_class; }
+
+void netflow::setTrafficClass(int traffic_class) {
+	this->traffic_class = traffic_class;
 }
 
+bool netflow::isFluid() const { return fluid; }
+
+void netflow::setFluid(bool fluid) { this->fluid = fluid; }
+
 void netflow::updatePktTally(double time) {
-	
-	// if receive_packet_event arrives within window
-	if ((time <= rightTime) && (time > leftTime)) {
-		pktTally++;
-	}
-	// if packet is ahead of window
-	else if (time > rightTime) {
-		pktTally = 0;		
-		leftTime = rightTime;
-		rightTime = rightTime + RATE_INTERVAL;
-		// keep adjusting if necessary so that receive pkt evt
-		// is within window
-		updatePktTally(time);
-	}
-	else { cout << "Should never hit this case" << endl; }
+	received_bytes.add(time, FLOW_PACKET_SIZE);
 }
 
-void netflow::setFASTWindowSize(double new_size) {
-	window_size = new_size;
+void netflow::setRateWindow(double window_ms, int num_buckets) {
+	received_bytes.setWindow(window_ms, num_buckets);
 }
-	
-double netflow::getLeftTime() const { return leftTime; }
 
-void netflow::setLeftTime(double newTime) {
-	leftTime = newTime;
+bool netflow::isPaced() const { return congestion->getPacingRate() > 0; }
+
+double netflow::pace(double ready_time) {
+	double rate = congestion->getPacingRate();
+	if (rate <= 0) {
+		return ready_time;
+	}
+	double send_time = max(ready_time, next_paced_time);
+	next_paced_time = send_time + 1 / rate;
+	if (send_time > ready_time && flow_timeout != NULL &&
+			flow_timeout->getTime() < send_time + timeout_length_ms) {
+		sim->armTimer(flow_timeout, send_time + timeout_length_ms);
+	}
+	return send_time;
 }
-	
-double netflow::getRightTime() const { return rightTime; }
 
-void netflow::setRightTime(double newTime) {
-	rightTime = newTime;
+void netflow::setCongestionControl(congestion_control *congestion) {
+	delete this->congestion;
+	this->congestion = congestion;
 }
 
 int netflow::getHighestAckSeqnum() const {
 	return highest_received_ack_seqnum;
 }
 
+int netflow::getHighestSentSeqnum() const {
+	return highest_sent_flow_seqnum;
+}
+
 int netflow::getNumDuplicateAcks() const {
 	return num_duplicate_acks;
 }
 
-const map<int, double>& netflow::getRoundTripTimes() const {
+const seq_window<double>& netflow::getRoundTripTimes() const {
 	return rtts;
 }
 
 double netflow::getWindowSize() const {
-	return window_size;
+	return congestion->getWindow();
 }
 
 int netflow::getWindowStart() const {
@@ -429,17 +450,16 @@ int netflow::getWindowStart() const {
 }
 
 double netflow::getLinGrowthWinsizeThreshold() const {
-	return lin_growth_winsize_threshold;
+	return congestion->getThreshold();
 }
 
-double netflow::getFlowRateBytesPerSec() const {
-	return getPktTally() * FLOW_PACKET_SIZE / RATE_INTERVAL;
+double netflow::getFlowRateBytesPerSec(double time) const {
+	return received_bytes.getRatePerMs(time) * MS_PER_SEC;
 }
 
 double netflow::getFlowRateMbps(double time) const {
-	// something seems fishy about this calculatiion dim-analysis wise
-	double bytes = (double) getPktTally() * FLOW_PACKET_SIZE / RATE_INTERVAL;
-	return bytes * BYTES_PER_MEGABIT;
+	// Same units as netlink::getRateMbps, so the two can be compared.
+	return getFlowRateBytesPerSec(time) * 8 / 1000000;
 }
 
 double netflow::getFlowPercentage() const {
@@ -460,11 +480,15 @@ bool netflow::doneTransmitting() {
 	else { return false; }
 }
 
+double netflow::getCompletionTimeMs() const { return completion_time_ms; }
+
 
-void netflow::registerAckEvent(int seq, double arrival_time, double sent_time) {
+void netflow::registerAckEvent(int seq, double arrival_time, double sent_time,
+		bool ecn_echo) {
 	// Update and queue up new ack_event
 	packet p = packet(ACK, *this, seq);
 	p.setTransmitTimestamp(sent_time);
+	p.setEcnEcho(ecn_echo);
 
 	// If we're sending a duplicate ACK then set the
 	// dont_send_duplicate_ack_until time for subsequent duplicate ACKs
@@ -473,7 +497,7 @@ void netflow::registerAckEvent(int seq, double arrival_time, double sent_time) {
 
 		if (arrival_time > dont_send_duplicate_ack_until) {
 			dont_send_duplicate_ack_until = arrival_time + avg_RTT;
-			ack_event *e = new ack_event(arrival_time, *sim, *this, p);
+			ack_event *e = new (*sim) ack_event(arrival_time, *sim, *this, p);
 			sim->addEvent(e);
 		}
 		// don't send a duplicate ACK if time hasn't gone past
@@ -481,7 +505,7 @@ void netflow::registerAckEvent(int seq, double arrival_time, double sent_time) {
 	}
 	else {
 		dont_send_duplicate_ack_until = -1;
-		ack_event *e = new ack_event(arrival_time, *sim, *this, p);
+		ack_event *e = new (*sim) ack_event(arrival_time, *sim, *this, p);
 		sim->addEvent(e);
 	}
 
@@ -493,7 +517,7 @@ vector<packet> netflow::peekOutstandingPackets() {
 
 	int window_end;
 	if (waiting_for_seqnum_before_resuming == -1) {
-		window_end = window_start + window_size;
+		window_end = window_start + congestion->getWindow();
 	}
 	else {
 		// so only send one packet (the lost one) until it's ACK'd
@@ -529,13 +553,17 @@ vector<packet> netflow::popOutstandingPackets(double start_time,
 	vector<packet> outstanding_pkts = peekOutstandingPackets();
 
 	// Iterate over the packets about to be sent, keeping their start times
-	// so round_trip_times can be computed later. Also making a timeout_event
-	// for each one, putting them on the out parameter and into the local map.
+	// so round_trip_times can be computed later. Packets already
+	// acknowledged needn't be kept any more, and a go-back can resend some
+	// that a cumulative ACK has since covered.
+	rtts.forgetBefore(highest_received_ack_seqnum);
 	vector<packet>::iterator it = outstanding_pkts.begin();
 	while(it != outstanding_pkts.end()) {
 
 		// Store start time.
-		rtts[it->getSeq()] = -start_time;
+		if (it->getSeq() >= highest_received_ack_seqnum) {
+			rtts.record(it->getSeq(), -start_time);
+		}
 
 		it++;
 	}
@@ -604,6 +632,12 @@ void netflow::receivedAck(packet &pkt, double end_time_ms,
 	 */
 	if (pkt.getSeq() == highest_received_ack_seqnum) {
 
+		// The packet that triggered it still got through, and may have
+		// been marked on the way.
+		if (pkt.isEcnEcho()) {
+			congestion->onEcnEcho(1, end_time_ms);
+		}
+
 		// Increment number of duplicate acks and check if more than
 		// allowed number. If so, do fast retransmit by changing last
 		// seen packet to current sequence number and halving window size
@@ -616,18 +650,14 @@ void netflow::receivedAck(packet &pkt, double end_time_ms,
 						<< endl;
 			}
 
+			congestion->onDupAck(num_duplicate_acks, end_time_ms);
 			highest_sent_flow_seqnum = pkt.getSeq()-1;
 			window_start = pkt.getSeq();
-			if (!FAST_TCP) {
-				lin_growth_winsize_threshold = window_size / 2;
-				window_size = 1;
-				//window_size = window_size / 2 > 1 ? window_size / 2 : 1;
-			}
 			num_duplicate_acks = 0;
 
 			waiting_for_seqnum_before_resuming = pkt.getSeq() + 1;
 
-			//delayFlowTimeout(end_time_ms + timeout_length_ms);
+			delayFlowTimeout(end_time_ms + timeout_length_ms);
 		}
 
 		// Got a duplicate ACK but don't have enough of them to do a fast
@@ -640,6 +670,8 @@ void netflow::receivedAck(packet &pkt, double end_time_ms,
 						"Num duplicates: " << num_duplicate_acks << endl;
 			}
 
+			congestion->onDupAck(num_duplicate_acks, end_time_ms);
+
 			// Don't push back the timeout (for now)
 		}
 	}
@@ -659,35 +691,42 @@ void netflow::receivedAck(packet &pkt, double end_time_ms,
 		int flow_seqnum = pkt.getSeq() - 1;
 
 		if (pkt.getTransmitTimestamp() != -1) {
-			updateTimeoutLength(end_time_ms - pkt.getTransmitTimestamp(),
-					 flow_seqnum);
+			double rtt = end_time_ms - pkt.getTransmitTimestamp();
+			updateTimeoutLength(rtt, flow_seqnum);
+			congestion->onRttSample(rtt, end_time_ms);
 		}
 
 		// Now adjust the window start and size. Since we just received
 		// an ACK for a successfully received packet we can slide the window
-		// start by one to the right, and we can adjust the window size
-		// by whether we're in exponential or linear growth mode.
+		// start by one to the right, and let the congestion control adjust
+		// the window size for each packet between the old received one and
+		// the new one.
 		window_start++;
-		
-		// Adjust the window size for each packet between the old received one
-		// and the new one.
-		for (int i = 0; i < diff; i++) {
-			if (!FAST_TCP) {
-				if (lin_growth_winsize_threshold < 0) { // hasn't been init'd
-													    // just do exp growth
-					window_size++;
-				}
-				else if (window_size < lin_growth_winsize_threshold) { // exp
-					window_size++;
-				}
-				else { // linear growth part
-					window_size += 1 / window_size;
-				}
-			}
+		// The echo is only about the packet that triggered this ACK, not
+		// the others it covers.
+		if (pkt.isEcnEcho()) {
+			congestion->onEcnEcho(1, end_time_ms);
 		}
+		congestion->onAck(diff, end_time_ms);
 
-		// Successfully received an ACK, so we push back the timeout.
-		//delayFlowTimeout(end_time_ms + timeout_length_ms);
+		// Successfully received an ACK, so we push back the timeout, or stop
+		// it if everything has been acknowledged.
+		if (highest_received_ack_seqnum > getNumTotalPackets()) {
+			cancelFlowTimeout();
+		}
+		else {
+			delayFlowTimeout(end_time_ms + timeout_length_ms);
+		}
+	}
+}
+
+void netflow::receivedFluid(double amount_mb, double arrival_time) {
+	assert(fluid);
+	bool was_done = doneTransmitting();
+	amt_received_mb += amount_mb;
+	if (!was_done && doneTransmitting()) {
+		completion_time_ms = arrival_time;
+		sim->flowCompleted(*this, arrival_time);
 	}
 }
 
@@ -698,33 +737,66 @@ void netflow::receivedFlowPacket(packet &pkt, double arrival_time) {
 	// Make the corresponding ACK packet and set the highest received flow
 	// sequence number.
 	
-	// set slot of received flow pkt to true, no effect if already true
-	if (!received[pkt.getSeq()]) {
+	// Mark the packet received; only count it the first time.
+	if (received.set(pkt.getSeq())) {
+		bool was_done = doneTransmitting();
 		amt_received_mb += ((double) FLOW_PACKET_SIZE) / BYTES_PER_MEGABIT;
-	}
-	received[pkt.getSeq()] = true;
 
-	// update next_ack_seqnum to next false slot after 		
-	while ((received[next_ack_seqnum] == true)	
-			&& (next_ack_seqnum <= getNumTotalPackets())) {
-		next_ack_seqnum++;	
+		// Tell the simulation the first time this packet pushes the flow
+		// over the line, so it doesn't have to poll every flow.
+		if (!was_done && doneTransmitting()) {
+			completion_time_ms = arrival_time;
+			sim->flowCompleted(*this, arrival_time);
+		}
 	}
+
+	// The next ACK asks for the first packet still missing.
+	next_ack_seqnum = received.getNextMissing();
 	double sent_time = (next_ack_seqnum == pkt.getSeq() + 1) ?
 			 pkt.getTransmitTimestamp() : -1;
 	// Make and queue (locally and on the simulation event queue) an immediate
-	// duplicate_ack_event.
-	registerAckEvent(next_ack_seqnum, arrival_time, sent_time);
+	// duplicate_ack_event. Every packet is acknowledged on its own, so the
+	// ACK can echo exactly whether it was marked.
+	registerAckEvent(next_ack_seqnum, arrival_time, sent_time,
+			pkt.isEcnMarked());
 }
 
 double netflow::getTimeoutLengthMs() const { return timeout_length_ms; }
 
 void netflow::timeoutOccurred() {
-	lin_growth_winsize_threshold = window_size / 2;
-	window_size = 1;
+	congestion->onTimeout();
 	window_start = highest_received_ack_seqnum;
 	num_duplicate_acks = 0;
 	//rtts.clear();
 	highest_sent_flow_seqnum = window_start - 1;
+
+	// A fast retransmit that was lost would otherwise wait forever.
+	waiting_for_seqnum_before_resuming = -1;
+
+	// Start pacing afresh rather than behind packets the go-back replaces.
+	next_paced_time = 0;
+
+	// Back off so a retransmission that's merely slow doesn't time out too.
+	timeout_length_ms *= 2;
+}
+
+void netflow::initFlowTimeout(double time) {
+	assert(flow_timeout == NULL);
+	flow_timeout = new (*sim) timeout_event(0, *sim, *this);
+	sim->armTimer(flow_timeout, time + timeout_length_ms);
+}
+
+void netflow::delayFlowTimeout(double time) {
+	if (flow_timeout != NULL) {
+		sim->armTimer(flow_timeout, time);
+	}
+}
+
+void netflow::cancelFlowTimeout() {
+	if (flow_timeout != NULL) {
+		sim->removeEvent(flow_timeout);
+		flow_timeout = NULL;
+	}
 }
 
 void netflow::printHelper(ostream &os) const {
@@ -744,13 +816,13 @@ void netflow::printHelper(ostream &os) const {
 			<< nestingPrefix(1) << "data received: " <<
 				amt_received_mb << " megabits," << endl
 			<< nestingPrefix(1) << "linear growth threshold: " <<
-				lin_growth_winsize_threshold << " packets," << endl
+				getLinGrowthWinsizeThreshold() << " packets," << endl
 			<< nestingPrefix(1) << "timeout length: " <<
 				timeout_length_ms << " ms," << endl
 			<< nestingPrefix(1) << "window start: " <<
 				window_start << "-th packet," << endl
 			<< nestingPrefix(1) << "window size: " <<
-				window_size << " packets," << endl
+				getWindowSize() << " packets," << endl
 			<< nestingPrefix(1) << "last seqnum sent: " <<
 				highest_sent_flow_seqnum << "-th packet," << endl
 			<< nestingPrefix(1) << "last ACK seen: " <<
@@ -761,26 +833,78 @@ void netflow::printHelper(ostream &os) const {
 // ------------------------------- netlink class ------------------------------
 
 void netlink::constructor_helper(double rate_mbps, int delay_ms, int buflen_kb,
-		netnode *endpoint1, netnode *endpoint2) {
+		netnode *endpoint1, netnode *endpoint2, bool full_duplex) {
 	this->rate_bpms = rate_mbps * BYTES_PER_MEGABIT / MS_PER_SEC;
 	this->delay_ms = delay_ms;
 	this->buffer_capacity = buflen_kb * BYTES_PER_KB;
 	this->endpoint1 = endpoint1 == NULL ? NULL : endpoint1;
 	this->endpoint2 = endpoint2 == NULL ? NULL : endpoint2;
 	destination_last_packet = NULL;
+
+	this->full_duplex = full_duplex;
+
+	// A half-duplex link only needs the one buffer. A full-duplex one also
+	// holds the packets on the wire until they arrive: at most a delay's
+	// worth of transmission, plus the one arriving as another goes out.
+	long smallest_packet = min(FLOW_PACKET_SIZE,
+			min(ACK_PACKET_SIZE, ROUTING_PACKET_SIZE));
+	long slots = buffer_capacity / smallest_packet;
+	if (full_duplex) {
+		slots += (long) ceil(rate_bpms * delay_ms / smallest_packet) + 2;
+	}
+	for (int i = 0; i < (full_duplex ? 2 : 1); i++) {
+		buffers[i].setCapacity(slots);
+	}
+	buffer_occupancy[0] = buffer_occupancy[1] = 0;
+	num_on_wire[0] = num_on_wire[1] = 0;
+	transmitter_free_at[0] = transmitter_free_at[1] = 0;
+
+	background_bpms[0] = background_bpms[1] = 0;
+	fill(packets_carried, packets_carried + NUM_PACKET_TYPES, 0);
+	ecn_threshold = -1;
+	packets_marked = 0;
+	qdiscs[0] = qdiscs[1] = NULL;
+	transmitting[0] = transmitting[1] = false;
+	last_arrival_time = 0;
 }
 
 netlink::netlink(string name, double rate_mbps, int delay_ms, int buflen_kb,
 		netnode &endpoint1, netnode &endpoint2) : netelement(name) {
 	constructor_helper(
-			rate_mbps, delay_ms, buflen_kb, &endpoint1, &endpoint2);
+			rate_mbps, delay_ms, buflen_kb, &endpoint1, &endpoint2, false);
+}
+
+netlink::netlink(string name, double rate_mbps, int delay_ms, int buflen_kb,
+		netnode &endpoint1, netnode &endpoint2, bool full_duplex) :
+				netelement(name) {
+	constructor_helper(rate_mbps, delay_ms, buflen_kb, &endpoint1, &endpoint2,
+			full_duplex);
 }
 
 netlink::netlink (string name, double rate_mbps, int delay_ms, int buflen_kb) :
 		 netelement(name) {
-	constructor_helper(rate_mbps, delay_ms, buflen_kb, NULL, NULL);
+	constructor_helper(rate_mbps, delay_ms, buflen_kb, NULL, NULL, false);
+}
+
+netlink::~netlink() {
+	delete qdiscs[0];
+	delete qdiscs[1];
+}
+
+int netlink::directionIndex(const netnode *destination) const {
+	return (full_duplex && destination == endpoint1) ? 1 : 0;
 }
 
+bool netlink::isFullDuplex() const { return full_duplex; }
+
+bool netlink::hasQueueDiscipline() const { return qdiscs[0] != NULL; }
+
+const queue_discipline *netlink::getQueueDiscipline(int dir) const {
+	return qdiscs[dir];
+}
+
+bool netlink::isTransmitting(int dir) const { return transmitting[dir]; }
+
 long netlink::getBuflen() const { return buffer_capacity; }
 
 long netlink::getBuflenKB() const { return buffer_capacity / BYTES_PER_KB; }
@@ -809,92 +933,305 @@ double netlink::getCapacityMbps() const {
 	return ((double) rate_bpms) / BYTES_PER_MEGABIT * MS_PER_SEC;
 }
 
-double netlink::getRateMbps() {
-	int flowsize =  FLOW_PACKET_SIZE * linkTraffic["flow"];
-	int acksize = ACK_PACKET_SIZE * linkTraffic["ack"];
-	int rtrsize = ROUTING_PACKET_SIZE * linkTraffic["rtr"];
-	return ((double) (flowsize + acksize + rtrsize)) * 8 / 1000000; 
+double netlink::getRateMbps(double time) const {
+	// Fluid flows' load counts too. A half-duplex link has the same load
+	// in both entries, since it keeps both directions busy, but carries it
+	// only once.
+	double bpms = carried_bytes.getRatePerMs(time) + background_bpms[0] +
+			(full_duplex ? background_bpms[1] : 0);
+	return bpms * MS_PER_SEC * 8 / 1000000;
 }
 
 double netlink::getTransmissionTimeMs(const packet &pkt) const {
 	return pkt.getSizeBytes() / rate_bpms;
 }
 
-double netlink::getLinkFreeAtTime() const {
-	if (buffer.size() == 0) {
+double netlink::getTransmissionTimeMs(const packet &pkt,
+		const netnode *destination) const {
+	return pkt.getSizeBytes() /
+			(rate_bpms - background_bpms[directionIndex(destination)]);
+}
+
+double netlink::getRateBytesPerMs() const { return rate_bpms; }
+
+double netlink::getBackgroundRate(int dir) const {
+	return background_bpms[dir];
+}
+
+void netlink::setBackgroundRate(int dir, double bpms) {
+	assert(bpms >= 0 && bpms < rate_bpms);
+	background_bpms[dir] = bpms;
+}
+
+void netlink::setEcnThreshold(double threshold_kb) {
+	ecn_threshold = threshold_kb < 0 ? -1 :
+			(long) (threshold_kb * BYTES_PER_KB);
+}
+
+double netlink::getLinkFreeAtTime(const netnode *departure_node) const {
+	const netnode *destination =
+			departure_node == endpoint1 ? endpoint2 : endpoint1;
+
+	// With a queue discipline this is only an estimate, since the queue may
+	// reorder or drop what's waiting.
+	const queue_discipline *qdisc = qdiscs[directionIndex(destination)];
+	if (qdisc != NULL) {
+		int dir = directionIndex(destination);
+		if (!transmitting[dir]) {
+			return 0;
+		}
+		return transmitter_free_at[dir] + qdisc->getBacklogBytes() / rate_bpms
+				+ delay_ms;
+	}
+
+	const ring_buffer<queued_packet> &buffer =
+			buffers[directionIndex(destination)];
+	if (buffer.empty()) {
 		return 0;
 	}
-	return buffer.rbegin()->first;
+	return buffer.back().arrival_time;
 }
 
 void netlink::printBuffer(ostream &os) {
 	os << nestingPrefix(0) << "Link buffer for \"" << getName() << "\""
 			<< endl;
-	map<double, packet>::iterator it;
-	for(it = buffer.begin(); it != buffer.end(); it++) {
-		os << nestingPrefix(1) << "(arrival time: " << it->first
-				<< ", " << it->second.getTypeString() << " packet #: "
-				<< it->second.getSeq() << ")" << endl;
+	for (int dir = 0; dir < (full_duplex ? 2 : 1); dir++) {
+		const ring_buffer<queued_packet> &buffer = buffers[dir];
+		if (full_duplex) {
+			os << nestingPrefix(0) << "toward " <<
+					(dir == 0 ? endpoint2 : endpoint1)->getName() << ":" << endl;
+		}
+		for(long i = 0; i < buffer.size(); i++) {
+			os << nestingPrefix(1) << "(arrival time: " <<
+					buffer[i].arrival_time << ", " <<
+					buffer[i].pkt.getTypeString() << " packet #: " <<
+					buffer[i].pkt.getSeq() << ")" << endl;
+		}
+		if (qdiscs[dir] != NULL) {
+			os << nestingPrefix(1) << qdiscs[dir]->getNumPackets() <<
+					" packets in queue discipline" << endl;
+		}
+		os << nestingPrefix(0) << "buffer size: " << buffer_occupancy[dir] +
+				(qdiscs[dir] == NULL ? 0 : qdiscs[dir]->getBacklogBytes())
+				<< endl;
+		os << nestingPrefix(0) << "free at: " <<
+				(buffer.empty() ? 0 : buffer.back().arrival_time) << endl;
 	}
-	os << nestingPrefix(0) << "buffer size: " << getBufferOccupancy() << endl;
-	os << nestingPrefix(0) << "free at: " << getLinkFreeAtTime() << endl;
 }
 
 long netlink::getBufferOccupancy() const {
-	long buffer_occupancy = 0;
-	map<double, packet>::const_iterator it;
-	for(it = buffer.begin(); it != buffer.end(); it++) {
-		buffer_occupancy += it->second.getSizeBytes();
+	long occupancy = buffer_occupancy[0] + buffer_occupancy[1];
+	for (int dir = 0; dir < 2; dir++) {
+		if (qdiscs[dir] != NULL) {
+			occupancy += qdiscs[dir]->getBacklogBytes();
+		}
+	}
+	return occupancy;
+}
+
+long netlink::getBufferOccupancy(double time) const {
+	long occupancy = getBufferOccupancy();
+	if (!full_duplex || hasQueueDiscipline()) {
+		return occupancy;
+	}
+	for (int dir = 0; dir < 2; dir++) {
+		const ring_buffer<queued_packet> &buffer = buffers[dir];
+		for (long i = num_on_wire[dir]; i < buffer.size() &&
+				getTransmittedTime(dir, i) <= time; i++) {
+			occupancy -= buffer[i].pkt.getSizeBytes();
+		}
 	}
-	return buffer_occupancy;
+	return occupancy;
 }
 
 int netlink::getPktLoss() const {
 	return packets_dropped;
 }
 
-map<string, int> netlink::getLinkTraffic() const {
-	return linkTraffic;
+long netlink::getPacketsCarried(packet_type type) const {
+	return packets_carried[type];
 }
 
+bool netlink::marksEcn() const { return ecn_threshold >= 0; }
+
+long netlink::getPacketsMarked() const { return packets_marked; }
+
 bool netlink::isSameDirectionAsLastPacket(netnode *destination) {
 	if(destination_last_packet == NULL) { // need to use link delay for first
 		return false;
 	}
 
-	// If names of destinations are the same, then same direction
-	if(strcmp(destination->getName().c_str(),
-			destination_last_packet->getName().c_str()) == 0) {
+	// If destinations are the same node, then same direction
+	if(destination == destination_last_packet) {
 		return true;
 	}
 	return false;
 }
 
-double netlink::getArrivalTime(const packet &pkt, bool useDelay, double time) {
-	return (useDelay ? getDelay() : 0) + getTransmissionTimeMs(pkt) +
-			(buffer.size() > 0 ? buffer.rbegin()->first : time);
+double netlink::getArrivalTime(const packet &pkt, const netnode *destination,
+		bool useDelay, double time) {
+
+	// Full-duplex: the packet goes on the wire once the transmitter has
+	// sent everything queued ahead of it that way, then propagates.
+	if (full_duplex) {
+		int dir = directionIndex(destination);
+		return max(time, transmitter_free_at[dir]) +
+				getTransmissionTimeMs(pkt, destination) + getDelay();
+	}
+
+	const ring_buffer<queued_packet> &buffer = buffers[0];
+	return (useDelay ? getDelay() : 0) +
+			getTransmissionTimeMs(pkt, destination) +
+			(buffer.empty() ? time : buffer.back().arrival_time);
+}
+
+void netlink::setQueueDiscipline(const queue_config &config,
+		unsigned seed) {
+	assert(getBufferOccupancy() == 0 && !hasQueueDiscipline());
+	if (config.type == DROP_TAIL_QUEUE) {
+		return;
+	}
+	for (int dir = 0; dir < (full_duplex ? 2 : 1); dir++) {
+		qdiscs[dir] = queue_discipline::makeQueueDiscipline(
+				config, buffer_capacity, rate_bpms, seed + dir);
+	}
+}
+
+bool netlink::markIfCongested(packet &pkt, long backlog_bytes) {
+	if (ecn_threshold < 0 || !pkt.isEcnCapable() ||
+			backlog_bytes < ecn_threshold) {
+		return false;
+	}
+	pkt.markEcn();
+	return true;
+}
+
+bool netlink::enqueuePacket(packet &pkt, const netnode *destination,
+		double time) {
+	assert(hasQueueDiscipline());
+	int heading = destination == endpoint1 ? 1 : 0;
+	queue_discipline *qdisc = qdiscs[directionIndex(destination)];
+	bool marked = markIfCongested(pkt, qdisc->getBacklogBytes());
+	if (!qdisc->enqueue(pkt, heading, time)) {
+		packets_dropped++;
+		return false;
+	}
+	if (marked) {
+		packets_marked++;
+	}
+	packets_dropped = 0;
+	return true;
+}
+
+bool netlink::startNextTransmission(int dir, double time, packet &pkt,
+		netnode *&destination, double &done_time, double &arrival_time) {
+	queue_discipline *qdisc = qdiscs[dir];
+	assert(qdisc != NULL);
+
+	// Count whatever the queue drops on the way out as lost here too.
+	long drops_before = qdisc->getDrops();
+	waiting_packet next;
+	bool got = qdisc->dequeue(time, next);
+	packets_dropped += qdisc->getDrops() - drops_before;
+	if (!got) {
+		transmitting[dir] = false;
+		return false;
+	}
+	pkt = next.pkt;
+	destination = next.direction == 1 ? endpoint1 : endpoint2;
+
+	// A half-duplex link can't turn around until the line is clear.
+	double start = max(time, transmitter_free_at[dir]);
+	if (!full_duplex && destination_last_packet != NULL &&
+			destination != destination_last_packet) {
+		start = max(start, last_arrival_time);
+	}
+	done_time = start + getTransmissionTimeMs(pkt, destination);
+	arrival_time = done_time + delay_ms;
+
+	transmitting[dir] = true;
+	transmitter_free_at[dir] = done_time;
+	destination_last_packet = destination;
+	last_arrival_time = arrival_time;
+	return true;
 }
 
-bool netlink::sendPacket(const packet &pkt, netnode *destination,
+long netlink::getWaitingBytes(int dir, double time) const {
+	// Packets go out in order, each as soon as the one before it is done,
+	// so the ones still waiting are at the back.
+	const ring_buffer<queued_packet> &buffer = buffers[dir];
+	long bytes = 0;
+	for (long i = buffer.size() - 1;
+			i > 0 && getTransmittedTime(dir, i - 1) > time; i--) {
+		bytes += buffer[i].pkt.getSizeBytes();
+	}
+	return bytes;
+}
+
+double netlink::getTransmittedTime(int dir, long i) const {
+	return buffers[dir][i].arrival_time - delay_ms;
+}
+
+void netlink::releaseTransmitted(int dir, double time) {
+	const ring_buffer<queued_packet> &buffer = buffers[dir];
+	while (num_on_wire[dir] < buffer.size() &&
+			getTransmittedTime(dir, num_on_wire[dir]) <= time) {
+		buffer_occupancy[dir] -= buffer[num_on_wire[dir]].pkt.getSizeBytes();
+		num_on_wire[dir]++;
+	}
+}
+
+bool netlink::sendPacket(packet &pkt, netnode *destination,
 		bool useDelay, double time) {
 
 	destination_last_packet = destination;
 
-	// Check if the buffer has space. If it doesn't then return false.
-	if (getBufferOccupancy() + pkt.getSizeBytes() > buffer_capacity) {
+	// Check if the buffer has space. If it doesn't then return false. On a
+	// full-duplex link, packets already on the wire don't take any.
+	int dir = directionIndex(destination);
+	if (full_duplex) {
+		releaseTransmitted(dir, time);
+	}
+	if (buffer_occupancy[dir] + pkt.getSizeBytes() > buffer_capacity) {
 		packets_dropped++;
 		return false;
 	}
-	buffer[getArrivalTime(pkt, useDelay, time)] = pkt;
+	// There's always a slot for a packet that fits in the byte budget.
+	assert(!buffers[dir].full());
+	if (marksEcn() &&
+			markIfCongested(pkt, getWaitingBytes(dir, time))) {
+		packets_marked++;
+	}
+	queued_packet entry =
+			{ getArrivalTime(pkt, destination, useDelay, time), pkt };
+	buffers[dir].push_back(entry);
+	buffer_occupancy[dir] += pkt.getSizeBytes();
+	if (full_duplex) {
+		transmitter_free_at[dir] = max(time, transmitter_free_at[dir]) +
+				getTransmissionTimeMs(pkt, destination);
+	}
 	packets_dropped = 0;
 	return true;
 }
 
-bool netlink::receivedPacket(long pkt_id) {
-	if(buffer.size() == 0 || buffer.begin()->second.getId() != pkt_id) {
+bool netlink::receivedPacket(long pkt_id, const netnode *destination) {
+	if (hasQueueDiscipline()) {
+		return true; // it left the queue when it went on the wire
+	}
+	int dir = directionIndex(destination);
+	ring_buffer<queued_packet> &buffer = buffers[dir];
+	if(buffer.empty() || buffer.front().pkt.getId() != pkt_id) {
 		return false;
 	}
-	buffer.erase(buffer.begin());
+	if (full_duplex) {
+		// It's arrived, so it's certainly been transmitted.
+		releaseTransmitted(dir, buffer.front().arrival_time);
+		num_on_wire[dir]--;
+	}
+	else {
+		buffer_occupancy[dir] -= buffer.front().pkt.getSizeBytes();
+	}
+	buffer.pop_front();
 	return true;
 }
 
@@ -913,93 +1250,101 @@ void netlink::printHelper(ostream &os) const {
 			<< nestingPrefix(1) << "endpoint 2: \"" <<
 				(endpoint2 == NULL ? "NULL" : endpoint2->getName()) <<
 				"\"," << endl
+			<< (full_duplex ? nestingPrefix(1) + "full-duplex,\n" : "")
 			<< nestingPrefix(1) << "number of packets in buffer: " <<
-				buffer.size() << " packets," << endl
+				buffers[0].size() + buffers[1].size() << " packets," << endl
 			<< nestingPrefix(1) << "occupancy: " <<
 				getBufferOccupancy() << " bytes" << endl
 			<< nestingPrefix(1) << "free at: " <<
-				getLinkFreeAtTime() << " ms" << endl
+				(buffers[0].empty() ? 0 : buffers[0].back().arrival_time) <<
+				" ms" << endl
 			<< nestingPrefix(0) << "}";
 }
 
-void netlink::resetLinkTraffic() {
-	linkTraffic["ack"] = 0;
-	linkTraffic["flow"] = 0;
-	linkTraffic["rtr"] = 0;
+void netlink::updateLinkTraffic(double time, const packet &pkt) {
+	packets_carried[pkt.getType()]++;
+	carried_bytes.add(time, pkt.getSizeBytes());
 }
 
-void netlink::updateLinkTraffic(int time, packet_type type) {
-	// if receive_packet_event arrives within window
-	if ((time <= rightTime) && (time > leftTime)) {
-		if (type == FLOW)
-			{ linkTraffic["flow"]++; }
-		else if (type == ACK) 
-			{ linkTraffic["ack"]++; }
-		else if (type == ROUTING)
-			{ linkTraffic["rtr"]++; }
-		else 
-			{ cerr << "should never get to this case" << endl; }
-	}
-	// if packet is ahead of window
-	else if (time > rightTime) {
-		this->resetLinkTraffic();		
-		leftTime = rightTime;
-		rightTime = rightTime + RATE_INTERVAL;
-		// keep adjusting if necessary so that receive pkt evt
-		// is within window
-		updateLinkTraffic(time, type);
+void netlink::setRateWindow(double window_ms, int num_buckets) {
+	carried_bytes.setWindow(window_ms, num_buckets);
+}
+
+// ---------------------------- distance_vector class -------------------------
+
+distance_vector::distance_vector(const vector<double> &distances) :
+		distances(distances), refs(0) { }
+
+const vector<double> &distance_vector::getDistances() const {
+	return distances;
+}
+
+vector<double> &distance_vector::getMutableDistances() {
+	assert(!isShared());
+	return distances;
+}
+
+bool distance_vector::isShared() const { return refs > 1; }
+
+void distance_vector::retain() const { refs++; }
+
+void distance_vector::release() const {
+	assert(refs > 0);
+	if (--refs == 0) {
+		delete this;
 	}
-	else { cout << "Should never hit this case" << endl; }
 }
 
 // -------------------------------- packet class ------------------------------
 
-long packet::id_gen = 1;
+static_assert(is_trivially_copyable<packet>::value,
+		"packets are copied around by value and must stay plain records");
+static_assert(sizeof(packet) <= 48, "packets should stay small");
 
-void packet::constructorHelper(packet_type type, const string &source_ip,
-			   const string &dest_ip, int seqnum,
-			   netflow *parent_flow, double size) {
+thread_local long packet::id_gen = 1;
+
+void packet::constructorHelper(packet_type type, int source, int destination,
+		int seqnum, netflow *parent_flow) {
 	this->type = type;
-	this->source_ip = source_ip;
-	this->dest_ip = dest_ip;
+	this->source = source;
+	this->destination = destination;
 	this->seqnum = seqnum;
 	this->parent_flow = parent_flow;
-	this->size = size;
+	this->distances = NULL;
+	this->transmit_timestamp = -1;
+	this->ecn_capable = false;
+	this->ecn_marked = false;
+	this->ecn_echo = false;
 	this->pkt_id = id_gen++;
 }
 
 packet::packet() :
-		netelement(), pkt_id(0), type(FLOW), source_ip(""), dest_ip(""),
-		parent_flow(NULL), size(FLOW_PACKET_SIZE), seqnum(0),
-		transmit_timestamp(-1) { }
+		pkt_id(0), parent_flow(NULL), distances(NULL), transmit_timestamp(-1),
+		type(FLOW), ecn_capable(false), ecn_marked(false), ecn_echo(false),
+		seqnum(0), source(-1), destination(-1) { }
 
-packet::packet(packet_type type, const string &source_ip,
-		const string &dest_ip) : netelement("") {
+packet::packet(packet_type type, const netnode &source,
+		const netnode &destination) {
 	switch (type) {
 	case ROUTING:
-		constructorHelper(type, source_ip, dest_ip, SEQNUM_FOR_NONFLOWS,
-				NULL, ((double)ROUTING_PACKET_SIZE) / BYTES_PER_MEGABIT);
+		constructorHelper(type, source.getId(), destination.getId(),
+				SEQNUM_FOR_NONFLOWS, NULL);
 		break;
 	default:
 		assert(type == ROUTING); // other types not allowed in this constructor
 	}
 }
 
-packet::packet(packet_type type, netflow &parent_flow, int seqnum) :
-		netelement("") {
+packet::packet(packet_type type, netflow &parent_flow, int seqnum) {
 
 	switch (type) {
 	case FLOW:
-		constructorHelper(type, parent_flow.getSource()->getName(),
-				parent_flow.getDestination()->getName(), seqnum,
-						&parent_flow,
-						((double)FLOW_PACKET_SIZE) / BYTES_PER_MEGABIT);
+		constructorHelper(type, parent_flow.getSource()->getId(),
+				parent_flow.getDestination()->getId(), seqnum, &parent_flow);
 		break;
 	case ACK:
-		constructorHelper(type, parent_flow.getDestination()->getName(),
-				parent_flow.getSource()->getName(), seqnum,
-						&parent_flow,
-						((double)ACK_PACKET_SIZE) / BYTES_PER_MEGABIT);
+		constructorHelper(type, parent_flow.getDestination()->getId(),
+				parent_flow.getSource()->getId(), seqnum, &parent_flow);
 		break;
 	default:
 		assert(type == FLOW || type == ACK); // no other packets types allowed
@@ -1008,18 +1353,28 @@ packet::packet(packet_type type, netflow &parent_flow, int seqnum) :
 
 bool packet::isNullPacket() const { return pkt_id == 0 ? true : false; }
 
-string packet::getSource() const { return source_ip; }
+int packet::getSourceId() const { return source; }
 
-string packet::getDestination() const { return dest_ip; }
+int packet::getDestinationId() const { return destination; }
 
 int packet::getSeq() const { return seqnum; }
 
-const map<string, double> &packet::getDistances() const {
-	return distance_vec;
+const distance_vector *packet::getDistances() const { return distances; }
+
+void packet::setDistances(const distance_vector *distances) {
+	this->distances = distances;
+}
+
+void packet::retainPayload() const {
+	if (distances != NULL) {
+		distances->retain();
+	}
 }
 
-void packet::setDistances(map<string, double> distances) {
-	this->distance_vec = distances;
+void packet::releasePayload() const {
+	if (distances != NULL) {
+		distances->release();
+	}
 }
 
 netflow *packet::getParentFlow() const { return parent_flow; }
@@ -1028,9 +1383,20 @@ long packet::getId() const { return pkt_id; }
 
 packet_type packet::getType() const { return type; }
 
-double packet::getSizeMb() const { return size; }
+double packet::getSizeMb() const {
+	return ((double) getSizeBytes()) / BYTES_PER_MEGABIT;
+}
 
-long packet::getSizeBytes() const { return size * BYTES_PER_MEGABIT; }
+long packet::getSizeBytes() const {
+	switch (type) {
+	case ACK:
+		return ACK_PACKET_SIZE;
+	case ROUTING:
+		return ROUTING_PACKET_SIZE;
+	default:
+		return FLOW_PACKET_SIZE;
+	}
+}
 
 string packet::getTypeString() const {
 	switch(type) {
@@ -1053,15 +1419,24 @@ double packet::getTransmitTimestamp() const { return transmit_timestamp; }
 
 void packet::setTransmitTimestamp(double time) { transmit_timestamp = time; }
 
-void packet::printHelper(ostream &os) const {
-	netelement::printHelper(os);
+bool packet::isEcnCapable() const { return ecn_capable; }
 
-	os << " <-- packet. {" << endl
-			<< nestingPrefix(1) << "source: \"" << source_ip << "\"," << endl
-			<< nestingPrefix(1) << "destination: \"" <<
-				dest_ip << "\"," << endl
-			<< nestingPrefix(1) << "type: " << getTypeString() << "," << endl
-			<< nestingPrefix(1) << "size: " << getSizeBytes() << endl
-			<< nestingPrefix(1) << "sequence number: " << getSeq() << endl
-			<< nestingPrefix(0) << "}";
+void packet::setEcnCapable(bool capable) { ecn_capable = capable; }
+
+bool packet::isEcnMarked() const { return ecn_marked; }
+
+void packet::markEcn() { ecn_marked = true; }
+
+bool packet::isEcnEcho() const { return ecn_echo; }
+
+void packet::setEcnEcho(bool echo) { ecn_echo = echo; }
+
+void packet::printHelper(ostream &os) const {
+	os << "packet. id: " << pkt_id << " {" << endl
+			<< "  source: node " << source << "," << endl
+			<< "  destination: node " << destination << "," << endl
+			<< "  type: " << getTypeString() << "," << endl
+			<< "  size: " << getSizeBytes() << endl
+			<< "  sequence number: " << getSeq() << endl
+			<< "}";
 }
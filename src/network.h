@@ -13,14 +13,20 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <type_traits>
 #include <map>
 #include <queue>
 #include <cmath>
 #include <limits>
 #include <set>
+#include <algorithm>
 
 // Custom headers
 #include "util.h"
+#include "ring_buffer.h"
+#include "rate_counter.h"
+#include "seq_window.h"
+#include "seq_bitmap.h"
 
 // Forward declarations.
 class netevent;
@@ -30,6 +36,11 @@ class netnode;
 class nethost;
 class netrouter;
 class packet;
+class distance_vector;
+struct queued_packet;
+class queue_discipline;
+class congestion_control;
+struct queue_config;
 class router_discovery_event;
 class start_flow_event;
 class send_packet_event;
@@ -63,6 +74,13 @@ private:
 	/** Printouts nested to this depth, 2 spaces per nesting level. */
 	int nest_depth;
 
+	/**
+	 * Dense index of this element among the simulation's elements of the
+	 * same kind, or -1 if the simulation hasn't numbered it. Used instead of
+	 * the name wherever the simulation needs to look an element up quickly.
+	 */
+	int id;
+
 public:
 
 	/** Default constructor. Sets nesting depth to 0, name to empty string. */
@@ -83,6 +101,18 @@ public:
 	 */
 	const string &getName() const;
 
+	/**
+	 * Getter for the ID the simulation gave this element.
+	 * @return ID, or -1 if it hasn't been numbered
+	 */
+	int getId() const;
+
+	/**
+	 * Setter for the ID. Only the simulation should call this.
+	 * @param id
+	 */
+	void setId(int id);
+
 	/**
 	 * Setter for the nesting depth.
 	 * @param depth
@@ -255,18 +285,36 @@ class netrouter : public netnode {
 private:
 
 	/**
-	 * Routing table implemented as map from destination names to
-	 * next-hop link.
+	 * Routing table implemented as a vector from destination node IDs to
+	 * next-hop links.
 	 */
-	map<string, netlink *> rtable;
+	vector<netlink *> rtable;
 
 	/**
-	 * Table of distances from this router to each node in the network.
-	 * Distance to self and adjacent hosts are initialized to 0. Distance
-	 * to other routers are initialized to max double, which is defined in
-	 * @c climits.
+	 * Table of distances from this router to each node in the network,
+	 * indexed by node ID. Distance to self and adjacent hosts are
+	 * initialized to 0. Distance to other routers are initialized to max
+	 * double, which is defined in @c climits.
+	 *
+	 * Routing packets this router sends carry this same object rather than
+	 * a copy, so it's only copied when it changes while packets still hold
+	 * it; see @c editDistances. NULL until @c initializeTables.
+	 */
+	distance_vector *rdistances;
+
+	/**
+	 * Every node in the network, indexed by ID; set by
+	 * @c initializeTables. Used to find adjacent hosts and to print node
+	 * names.
 	 */
-	map<string, double> rdistances;
+	const vector<netnode *> *nodes;
+
+	/**
+	 * Gets @c rdistances ready for writing, first replacing it with a
+	 * private copy if any routing packet still holds it.
+	 * @return distances indexed by node ID, safe to change
+	 */
+	vector<double> &editDistances();
 
 public:
 
@@ -290,6 +338,9 @@ public:
 	 */
 	netrouter (string name, vector<netlink *> links);
 
+	/** Destructor. Lets go of the distances. */
+	~netrouter ();
+
 	/**
 	 * Returns true, since this is a router.
 	 * @return true
@@ -297,20 +348,20 @@ public:
 	virtual bool isRoutingNode() const;
 
 	/**
-	 * This function forwards it along the best link for it to get to its
-	 * destination as determined by the routing table. Note that it's the
-	 * caller's responsibility to generate the actual send_packet_events based
-	 * on the returned map.
+	 * Looks up the best link for the given packet to get to its destination
+	 * as determined by the routing table. Note that it's the caller's
+	 * responsibility to generate the actual send_packet_event down that
+	 * link.
 	 * @param time of packet receipt
 	 * @param sim
 	 * @param flow parent flow, NULL if ROUTING type
 	 * @param pkt the arriving packet
-	 * @return a map from the links to use to the corresponding packets
+	 * @return the link to forward the packet on
 	 * @warning deprecated for use with ROUTING packets! Use
 	 * @c receiveRoutingPacket instead.
 	 */
-	map<netlink *, packet> receivePacket(double time, simulation &sim,
-			netflow &flow, packet &pkt);
+	netlink *receivePacket(double time, simulation &sim, netflow &flow,
+			const packet &pkt);
 
 	/**
 	 * If this is a ROUTING packet, this function will update the router's
@@ -323,13 +374,20 @@ public:
 	 * @param link it was received on
 	 */
 	void receiveRoutingPacket(double time, simulation &sim, 
-			packet &pkt, netlink &link);
+			const packet &pkt, netlink &link);
 
 	/**
 	 * Getter for the node distances collection.
-	 * @return collection of the distances of this router from all other nodes
+	 * @return distances of this router from all other nodes, indexed by
+	 * node ID
 	 */
-	map<string, double> getRDistances() const;
+	const vector<double> &getRDistances() const;
+
+	/**
+	 * Getter for the shared distances object, for routing packets to carry.
+	 * @return this router's current distances
+	 */
+	const distance_vector *getDistanceVector() const;
 
 	/**
 	 * Called once at the beginning of the simulation, after parsing in an
@@ -337,20 +395,16 @@ public:
 	 * Sets the correct link to adjacent hosts since each host
 	 * has only one outgoing link. Sets other links to NULL.
 	 *
-	 * @param host_list list of all hosts
-	 * @param router_list list of all routers
+	 * @param nodes every host and router, indexed by node ID. Must outlive
+	 * this router.
 	 */
-	void initializeTables(map<string, nethost*> host_list, 
-						  map<string, netrouter*> router_list);
+	void initializeTables(const vector<netnode *> &nodes);
 
 	/**
 	 * Called from each router_discovery_event before recalculating distances.
 	 * Sets distances to all other routers and nonadjacent hosts to infinity.
-	 * @param host_list list of all hosts
-	 * @param router_list list of all routers
 	 */
-	void resetDistances(map<string, nethost*> host_list, 
-						map<string, netrouter*> router_list);
+	void resetDistances();
 
 	/**
 	 * Print helper function which partially overrides the one in @c netdevice.
@@ -384,14 +438,8 @@ private:
 	/** Pointer to the other end of this flow. */
 	nethost *destination;
 	
-	/** For plotting, number of flow packets received by destination */
-	int pktTally;
-	
-	/** For plotting, start time of the packet count interval */
-	double leftTime;
-	
-	/** For plotting, end time of the packet count interval */
-	double rightTime;
+	/** For plotting, FLOW bytes received by destination lately. */
+	rate_counter received_bytes;
 
 	/** Highest received ACK sequence number (at source). */
 	int highest_received_ack_seqnum;
@@ -400,21 +448,18 @@ private:
 	int highest_sent_flow_seqnum;
 	
 	/**
-	 * Vector keeping track of which flow packets have/have not been
-	 * received. The value at index i indicates whether flow packet 
-	 * i has been received at the destination.
+	 * Which flow packets have been received at the destination. Only the
+	 * packets past the first one missing take up space, so this grows with
+	 * the window rather than the flow.
 	 */
-	vector<bool> received;
+	seq_bitmap received;
 
 	/**
-	 * Seqnum of next ack to be received. This should be the first empty slot
-	 * after a contiguous sequence in the received vector.
+	 * Seqnum of next ack to be received. This is the first packet missing
+	 * from @c received.
 	 */
 	int next_ack_seqnum;
 
-	/** The TCP protocol's window size. */
-	double window_size;
-
 	/** Sequence number at which the current transmission window starts. */
 	int window_start;
 
@@ -431,18 +476,28 @@ private:
 	double timeout_length_ms;
 
 	/**
-	 * Half of the window size when a timeout happens; remembered so that in
-	 * the next window resizing phase exponential growth happens until this
-	 * threshold then linear growth happens after. If this is negative then
-	 * it hasn't been set due to a timeout.
+	 * Decides the window size. Tahoe or FAST as the constructor says unless
+	 * it's replaced. Owned by this flow.
+	 */
+	congestion_control *congestion;
+
+	/**
+	 * Earliest time in ms the flow's next packet may go out when it's
+	 * paced.
 	 */
-	double lin_growth_winsize_threshold;
+	double next_paced_time;
 
 	/**
-	 * Flag that is true if this flow is using FAST TCP for congestion
-	 * control. 
+	 * Traffic class, for links that schedule between classes of flows.
+	 * Zero unless the input says otherwise.
 	 */
-	bool FAST_TCP;
+	int traffic_class;
+
+	/**
+	 * True if this flow is carried by the simulation's fluid model as a
+	 * rate rather than as packets.
+	 */
+	bool fluid;
 
 	/**
 	 * Average round-trip time for a packet in this flow. If zero should be
@@ -469,21 +524,26 @@ private:
 	double pkt_RTT;
 
 	/**
-	 * Pointer to the timer associated with the flow. Each time an ack is
-	 * received, the timer is pushed back by removing this timeout event 
-	 * from the events queue and replacing it with a new timeout event. The
-	 * new event's timer extends the previous event's timer by
-	 * timeout_length_ms.
+	 * Pointer to the retransmission timer associated with the flow, or NULL
+	 * if it hasn't been started or has been cancelled. Each time an ACK
+	 * makes progress the timer is pushed back to timeout_length_ms after the
+	 * ACK's arrival by re-arming it in the simulation's timer wheel. While
+	 * it's armed or queued the simulation owns it.
 	 */
 	timeout_event *flow_timeout;
 
 	/**
-	 * Map from sequence numbers to round-trip times of those packets. If a
-	 * value is negative then it's the FLOW packet departure time; the
-	 * corresponding ACK hasn't arrived yet. When it does its arrival
-	 * time will be added to the negative number.
+	 * Time in milliseconds at which the last needed flow packet reached the
+	 * destination, or -1 if the flow isn't done yet.
+	 */
+	double completion_time_ms;
+
+	/**
+	 * Negated departure times of the FLOW packets in flight, by sequence
+	 * number. Packets are forgotten once they're acknowledged, so this only
+	 * grows with the window.
 	 */
-	map<int, double> rtts;
+	seq_window<double> rtts;
 
 	/**
 	 * Don't send a duplicate ACK until this time. This time should be set to
@@ -567,6 +627,15 @@ public:
 	netflow (string name, double start_time, double size_mb,
 			nethost &source, nethost &destination, simulation &sim);
 
+	/** Destructor. Deletes the congestion control. */
+	~netflow();
+
+	/** Not copyable, since it owns its congestion control. */
+	netflow(const netflow &) = delete;
+
+	/** Not copyable, since it owns its congestion control. */
+	netflow &operator=(const netflow &) = delete;
+
 	// --------------------------- Accessors ----------------------------------
 
 	/**
@@ -601,22 +670,11 @@ public:
 
 	/**
 	 * Getter for the count of flow packets received by destination within the
-	 * interval.
+	 * rate window ending at the given time.
+	 * @param time
 	 * @return number of flow packets received
 	 */
-	int getPktTally() const;
-	
-	/**
-	 * Getter for the start time of the packet count interval.
-	 * @return left side of pkt count interval
-	 */
-	double getLeftTime() const;
-	
-	/**
-	 * Getter for the ending time of the packet count interval.
-	 * @return right side of pkt count interval
-	 */
-	double getRightTime() const;
+	int getPktTally(double time) const;
 
 	/**
 	 * Getter for number of packets used in a flawless transmission of this
@@ -639,6 +697,12 @@ public:
 	 */
 	int getHighestAckSeqnum() const;
 
+	/**
+	 * Getter for the sequence number of the last FLOW packet sent.
+	 * @return highest sequence number sent since the last go-back
+	 */
+	int getHighestSentSeqnum() const;
+
 	/**
 	 * Getter for the number of duplicate ACKs seen so far.
 	 * @return num duplicate ACKs
@@ -658,19 +722,30 @@ public:
 	double getMinRTT() const;
 
 	/**
-	 * True if using TCP FAST, false if Tahoe.
-	 * @return true for FAST, false for Tahoe
+	 * Getter for the congestion control, e.g. for periodic updates.
+	 * @return this flow's congestion control
+	 */
+	congestion_control &getCongestionControl();
+
+	/**
+	 * Getter for the traffic class.
+	 * @return traffic class
+	 */
+	int getTrafficClass() const;
+
+	/**
+	 * True if this flow is a rate in the fluid model rather than packets.
+	 * @return true if fluid
 	 */
-	bool isUsingFAST() const;
+	bool isFluid() const;
 
 	/**
-	 * Getter for a const reference to the round-trip times map. This map
-	 * stores the start time for packets in transit; when packets arrive
-	 * their arrival times are added to their (negated) start times to get
-	 * the round trip time, then their entries are removed from the RTT map.
-	 * @return const reference to round trip times map
+	 * Getter for a const reference to the round-trip times table. It
+	 * stores the (negated) start times of packets in transit, by sequence
+	 * number; packets that have been acknowledged drop out of it.
+	 * @return const reference to round trip times table
 	 */
-	const map<int, double>& getRoundTripTimes() const;
+	const seq_window<double>& getRoundTripTimes() const;
 
 	/**
 	 * Getter for the current window size
@@ -700,13 +775,17 @@ public:
 	virtual void printHelper(ostream &os) const;
 	
 	/**
-	 * Getter for the flow rate in bytes per second.
+	 * Getter for the flow rate in bytes per second over the rate window
+	 * ending at the given time.
+	 * @param time
 	 * @return flow rate in bytes/sec.
 	 */
-	double getFlowRateBytesPerSec() const;
+	double getFlowRateBytesPerSec(double time) const;
 
 	/**
-	 * Getter for the flow rate in megabits per second.
+	 * Getter for the flow rate in megabits per second over the rate window
+	 * ending at the given time.
+	 * @param time
 	 * @return flow rate.
 	 */
 	double getFlowRateMbps(double time) const;
@@ -731,6 +810,12 @@ public:
 	 */
 	bool doneTransmitting();
 
+	/**
+	 * Getter for the time at which the flow finished transmitting.
+	 * @return completion time in milliseconds, or -1 if not done yet
+	 */
+	double getCompletionTimeMs() const;
+
 	// --------------------------- Mutators -----------------------------------
 
 	/**
@@ -744,32 +829,54 @@ public:
 	 * @param destination
 	 */
 	void setDestination(nethost &destination);
+
+	/**
+	 * Setter for the traffic class.
+	 * @param traffic_class
+	 */
+	void setTrafficClass(int traffic_class);
+
+	/**
+	 * Makes this a fluid flow, or not. Call before the simulation runs.
+	 * @param fluid
+	 */
+	void setFluid(bool fluid);
 	
 	/**
-	 * Updates packet tally depending on whether @c receive_packet_event
-	 * occurs during rate_interval.
-	 * @param time
+	 * Counts a FLOW packet the destination received towards the flow rate.
+	 * @param time of arrival
 	 */
 	void updatePktTally(double time);
 
 	/**
-	 * Changes a flow's window size during an update_window_event. Used only
-	 * if the flow is using FAST TCP for congestion control.
-	 * @param new_size
+	 * Changes the window the flow rate is measured over.
+	 * @param window_ms length of the window in ms
+	 * @param num_buckets number of steps the window slides in
 	 */
-	void setFASTWindowSize(double new_size);
-	
+	void setRateWindow(double window_ms, int num_buckets);
+
 	/**
-	 * Sets left time.
-	 * @param newTime
+	 * True if the congestion control wants packets spaced out at a rate.
+	 * @return true if paced
 	 */
-	void setLeftTime(double newTime);
-	
+	bool isPaced() const;
+
 	/**
-	 * Sets right time.
-	 * @param newTime
+	 * Picks the time a packet goes out: when it's ready, or later if the
+	 * flow is paced and the packet before went out too recently. A packet
+	 * held back holds back the retransmission timer with it, so it gets a
+	 * whole timeout length once it's on its way.
+	 * @param ready_time earliest time in ms the packet could go out
+	 * @return time in ms to send it at
 	 */
-	void setRightTime(double newTime);
+	double pace(double ready_time);
+
+	/**
+	 * Replaces the congestion control. Call before the simulation runs.
+	 * @param congestion made for this flow; this flow takes ownership
+	 */
+	void setCongestionControl(congestion_control *congestion);
+
 
 	/**
 	 * Makes an @c ack_event and puts it on the simulation's event queue.
@@ -777,8 +884,10 @@ public:
 	 * sequence number
 	 * @param arrival_time 
 	 * @param sent_time 
+	 * @param ecn_echo true if the packet being acknowledged was marked
 	 */
-	void registerAckEvent(int seq, double arrival_time, double sent_time);
+	void registerAckEvent(int seq, double arrival_time, double sent_time,
+			bool ecn_echo = false);
 
 	/**
 	 * Gets all the packets in this window that must be sent. This function
@@ -832,13 +941,41 @@ public:
 	 */
 	void receivedFlowPacket(packet &pkt, double arrival_time);
 
+	/**
+	 * Fluid flows only: counts data the fluid model says has arrived, and
+	 * tells the simulation if that finishes the flow.
+	 * @param amount_mb how much arrived, in the same units as the size
+	 * @param arrival_time when it finished arriving
+	 */
+	void receivedFluid(double amount_mb, double arrival_time);
+
 	/**
 	 * This function should be called after a timeout so the window size can
-	 * change accordingly and so the old timeout_event can be cancelled. It's
-	 * the caller's responsibility to make and queue a new send_packet_event
-	 * and a new timeout_event.
+	 * change accordingly. It also doubles the timeout length until the next
+	 * RTT sample recomputes it. It's the caller's responsibility to make and
+	 * queue a new send_packet_event and to re-arm the timer.
 	 */
 	void timeoutOccurred();
+
+	/**
+	 * Makes this flow's retransmission timer and queues it to go off one
+	 * timeout length after the given time.
+	 * @param time at which the flow starts sending, in milliseconds
+	 */
+	void initFlowTimeout(double time);
+
+	/**
+	 * Moves this flow's retransmission timer to the given time, requeueing
+	 * it if it has just run. Does nothing if the timer was cancelled.
+	 * @param time at which the timer should go off, in milliseconds
+	 */
+	void delayFlowTimeout(double time);
+
+	/**
+	 * Takes this flow's retransmission timer off the event queue for good.
+	 * Called when there's nothing left to retransmit.
+	 */
+	void cancelFlowTimeout();
 };
 
 // ------------------------------- netlink class ------------------------------
@@ -866,14 +1003,72 @@ private:
 	netnode *endpoint2;
 
 	/**
-	 * This link's FIFO buffer. Note that packets don't have real payloads
-	 * so the size of this buffer in memory is small even though packets are
-	 * stored by value. The keys are arrival times and the values are the
-	 * actual packets in the link buffer; to get arrival time for a new
-	 * packet about to be placed on the buffer add transmission (and possibly
-	 * delay) time to the arrival time of the last element in the buffer.
+	 * True if packets can go both ways at once. A full-duplex link has a
+	 * transmit queue per direction and every packet pays the propagation
+	 * delay; a half-duplex link has one queue for both directions and
+	 * only pays the delay when the direction changes.
+	 */
+	bool full_duplex;
+
+	/**
+	 * This link's FIFO buffers, one per direction: index 0 holds packets
+	 * headed for @c endpoint2 and index 1 those headed for @c endpoint1. A
+	 * half-duplex link only uses index 0, for both directions. Note that
+	 * packets don't have real payloads so the size of these buffers in
+	 * memory is small even though packets are stored by value. Each packet
+	 * is stored with its arrival time; to get arrival time for a new
+	 * packet about to be placed on a half-duplex buffer add transmission
+	 * (and possibly delay) time to the arrival time of the last element in
+	 * the buffer. Each has room for a buffer's worth of the smallest
+	 * packets, so it never fills up before @c buffer_capacity does.
+	 */
+	ring_buffer<queued_packet> buffers[2];
+
+	/**
+	 * Bytes of the packets in each of @c buffers that take up buffer space:
+	 * all of them on a half-duplex link, and on a full-duplex link only
+	 * those that haven't finished transmitting.
+	 */
+	long buffer_occupancy[2];
+
+	/**
+	 * Full-duplex only: for each direction, how many packets at the front
+	 * of @c buffers are known to have finished transmitting. They're on the
+	 * wire, and no longer count in @c buffer_occupancy.
+	 */
+	long num_on_wire[2];
+
+	/**
+	 * Full-duplex only: for each direction, the time at which the
+	 * transmitter finishes putting the last queued packet on the wire.
+	 */
+	double transmitter_free_at[2];
+
+	/**
+	 * Queue disciplines, indexed like @c buffers, or NULL for a plain
+	 * drop-tail link. A link with a queue discipline doesn't use
+	 * @c buffers: packets wait in the queue discipline until the
+	 * transmitter is free, and only then get an arrival time.
+	 */
+	queue_discipline *qdiscs[2];
+
+	/**
+	 * Links with a queue discipline only: for each transmitter, true while
+	 * it's putting a packet on the wire.
 	 */
-	map<double, packet> buffer;
+	bool transmitting[2];
+
+	/**
+	 * Half-duplex links with a queue discipline only: when the last packet
+	 * sent arrives, which is when the link can turn around.
+	 */
+	double last_arrival_time;
+
+	/**
+	 * Bytes per ms of each transmitter's capacity taken by fluid flows,
+	 * indexed like @c buffers. Packets get what's left.
+	 */
+	double background_bpms[2];
 
 	/**
 	 * Represents packet loss. Since assuming nothing happens to the packet
@@ -882,28 +1077,67 @@ private:
 	 */
 	int packets_dropped = 0;
 	
+	/** For plotting link rate, bytes that went through the link lately. */
+	rate_counter carried_bytes;
+
+	/** Number of packets of each type that went through the link. */
+	long packets_carried[NUM_PACKET_TYPES];
+
 	/**
-	 * For plotting link rate. Keeps track of how many packets of each type
-	 * were passing through link during given time interval. Key is a string
-	 * instead of packet_type for easier printing.
-	 */ 
-	map<string, int> linkTraffic = { {"ack", 0}, {"flow", 0}, {"rtr", 0} };
+	 * Bytes already queued in a packet's direction at or above which an
+	 * arriving ECN-capable packet gets marked, or -1 to never mark.
+	 */
+	long ecn_threshold;
 
-	/** For plotting, start time of the packet count interval */
-	double leftTime;
-	
-	/** For plotting, end time of the packet count interval */
-	double rightTime;
+	/** Number of packets this link has marked. */
+	long packets_marked;
 
 	/** Destination of last packet added to the buffer. */
 	netnode *destination_last_packet;
 
+	/**
+	 * Marks a packet if it's ECN-capable and the queue it's joining is at
+	 * least @c ecn_threshold bytes long.
+	 * @param pkt
+	 * @param backlog_bytes bytes queued ahead of it that the transmitter
+	 * hasn't started on
+	 * @return true if marked
+	 */
+	bool markIfCongested(packet &pkt, long backlog_bytes);
+
+	/**
+	 * Drop-tail only: what a queue discipline's backlog would be.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @param time
+	 * @return bytes in @c buffers[dir] that the transmitter hasn't started
+	 * on by @c time
+	 */
+	long getWaitingBytes(int dir, double time) const;
+
+	/**
+	 * Drop-tail only.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @param i position in @c buffers[dir]
+	 * @return when that packet finishes transmitting. On a half-duplex
+	 * link, whose packets only pay the delay when the direction changes,
+	 * when the next one can start.
+	 */
+	double getTransmittedTime(int dir, long i) const;
+
+	/**
+	 * Full-duplex only: frees the buffer space of the packets that have
+	 * finished transmitting by @c time.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @param time
+	 */
+	void releaseTransmitted(int dir, double time);
+
 	/**
 	 * Helper for the constructors. Converts the buffer length from kilobytes
 	 * to bytes and the rate from megabits per second to bytes per second.
 	 */
 	void constructor_helper(double rate_mbps, int delay, int buflen_kb,
-			netnode *endpoint1, netnode *endpoint2);
+			netnode *endpoint1, netnode *endpoint2, bool full_duplex);
 
 public:
 
@@ -920,6 +1154,21 @@ public:
 	netlink(string name, double rate_mbps, int delay_ms, int buflen_kb,
 			netnode &endpoint1, netnode &endpoint2);
 
+	/**
+	 * Same as the other constructor with endpoints, but lets the link be
+	 * full-duplex.
+	 * @param name of this link
+	 * @param rate_mbps link rate in megabits per second, each way
+	 * @param delay_ms link delay in milliseconds
+	 * @param buflen_kb the size of each buffer on this link in kilobytes.
+	 * A full-duplex link has one buffer per direction.
+	 * @param endpoint1 the host or router on one side of this link
+	 * @param endpoint2 the host or router on the other side of this link
+	 * @param full_duplex true if packets can go both ways at once
+	 */
+	netlink(string name, double rate_mbps, int delay_ms, int buflen_kb,
+			netnode &endpoint1, netnode &endpoint2, bool full_duplex);
+
 	/**
 	 * Use this when endpoints are not known at construction time.
 	 * @param name of this link
@@ -930,6 +1179,9 @@ public:
 	 */
 	netlink (string name, double rate_mbps, int delay_ms, int buflen_kb);
 
+	/** Destructor. Frees the queue disciplines, if any. */
+	~netlink();
+
 	// --------------------------- Accessors ----------------------------------
 
 	/**
@@ -977,10 +1229,12 @@ public:
 	double getCapacityMbps() const;
 
 	/**
-	 * Getter for the current rate of the link in megabits per second.
+	 * Getter for the rate of the link in megabits per second over the rate
+	 * window ending at the given time.
+	 * @param time
 	 * @return current link rate (mbps)
 	 */
-	double getRateMbps();
+	double getRateMbps(double time) const;
 
 	/**
 	 * Getter for end-to-end time in milliseconds for the given packet on this
@@ -990,22 +1244,90 @@ public:
 	 */
 	double getTransmissionTimeMs(const packet &pkt) const;
 
+	/**
+	 * Like the other overload, but at the rate left over by fluid flows on
+	 * the transmitter the packet goes through.
+	 * @param pkt
+	 * @param destination endpoint the packet is headed for
+	 * @return time to put the packet on the wire (ms)
+	 */
+	double getTransmissionTimeMs(const packet &pkt,
+			const netnode *destination) const;
+
+	/**
+	 * Getter for the link's full rate.
+	 * @return rate in bytes per millisecond
+	 */
+	double getRateBytesPerMs() const;
+
+	/**
+	 * Getter for the load fluid flows put on a transmitter.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @return background rate in bytes per millisecond
+	 */
+	double getBackgroundRate(int dir) const;
+
+	/**
+	 * True if packets can go both ways at once on this link.
+	 * @return true if full-duplex, false if half-duplex
+	 */
+	bool isFullDuplex() const;
+
+	/**
+	 * @param destination endpoint a packet is headed for
+	 * @return index of the buffer, and transmitter, the packet goes through
+	 */
+	int directionIndex(const netnode *destination) const;
+
+	/**
+	 * True if this link queues packets in a queue discipline, in which case
+	 * packets go through @c enqueuePacket and @c startNextTransmission
+	 * instead of @c sendPacket and @c receivedPacket.
+	 * @return true if there's a queue discipline
+	 */
+	bool hasQueueDiscipline() const;
+
+	/**
+	 * Getter for a transmitter's queue discipline.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @return the queue discipline, or NULL if there's none
+	 */
+	const queue_discipline *getQueueDiscipline(int dir) const;
+
+	/**
+	 * True while a transmitter is putting a packet on the wire.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @return true if busy
+	 */
+	bool isTransmitting(int dir) const;
+
 	/**
 	 * Getter for the absolute time in milliseconds when this link will be
-	 * available for the next packet.
+	 * available for the next packet sent from the given endpoint, i.e. when
+	 * the last packet queued ahead of it arrives.
+	 * @param departure_node endpoint the next packet is sent from
 	 * @return time at which link will be available for next-queued packet
 	 * @warning if zero need to substitute current time in for free at time!
 	 * the link doesn't know the current time, so it can't tell you when
 	 * the link is free if there's nothing in the buffer.
 	 */
-	double getLinkFreeAtTime() const;
+	double getLinkFreeAtTime(const netnode *departure_node) const;
 
 	/**
-	 * Getter for the number of bytes of the link buffer than are in-use.
-	 * @return the buffer occupancy (bytes)
+	 * Getter for the number of bytes of the link buffers than are in-use.
+	 * On a full-duplex link, as of the last packet sent or received.
+	 * @return the buffer occupancy (bytes), both directions together
 	 */
 	long getBufferOccupancy() const;
 
+	/**
+	 * Like @c getBufferOccupancy, but also leaves out the packets that a
+	 * full-duplex link has finished transmitting by @c time.
+	 * @param time
+	 * @return the buffer occupancy (bytes), both directions together
+	 */
+	long getBufferOccupancy(double time) const;
+
 	/**
 	 * Gette for the packet loss, which is number of packets dropped since
 	 * we are assuming nothing happens to a packet while in transit.
@@ -1013,11 +1335,24 @@ public:
 	 */
 	int getPktLoss() const;
 
-	/** 
-	 * Getter for the link traffic.
-	 * @return linkTraffic
+	/**
+	 * Getter for how many packets of a type went through the link so far.
+	 * @param type
+	 * @return number of packets
 	 */
-	map<string, int> getLinkTraffic() const;
+	long getPacketsCarried(packet_type type) const;
+
+	/**
+	 * True if this link marks ECN-capable packets when it's congested.
+	 * @return true if there's a marking threshold
+	 */
+	bool marksEcn() const;
+
+	/**
+	 * Getter for how many packets this link has marked so far.
+	 * @return number of packets
+	 */
+	long getPacketsMarked() const;
 
 	/**
 	 * This function is critical for our half-duplex implementation.
@@ -1035,11 +1370,13 @@ public:
 	/**
 	 * Gets the arrival time of a packet on the other end of the link.
 	 * @param pkt
-	 * @param useDelay
+	 * @param destination endpoint the packet is headed for
+	 * @param useDelay ignored for full-duplex links, which always use it
 	 * @param time of the triggered event
 	 * @return arrival time
 	 */
-	double getArrivalTime(const packet &pkt, bool useDelay, double time);
+	double getArrivalTime(const packet &pkt, const netnode *destination,
+			bool useDelay, double time);
 
 	/**
 	 * Prints the contents and size of the buffer to the given stream.
@@ -1067,20 +1404,75 @@ public:
 	 * @param endpoint1
 	 */
 	void setEndpoint2(netnode &endpoint2);
-	
+
+	/**
+	 * Has this link queue packets in the given queue discipline, one per
+	 * transmitter, instead of its plain drop-tail buffers. Drop-tail
+	 * configurations keep the plain buffers. Call before any packets are
+	 * sent.
+	 * @param config
+	 * @param seed for the queue discipline's random choices
+	 */
+	void setQueueDiscipline(const queue_config &config, unsigned seed);
+
+	/**
+	 * Setter for the load fluid flows put on a transmitter. Must leave
+	 * some of the link's rate for packets.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @param bpms background rate in bytes per millisecond
+	 */
+	void setBackgroundRate(int dir, double bpms);
+
+	/**
+	 * Has this link mark ECN-capable packets that arrive to find at least
+	 * the given backlog in their queue, as DCTCP expects, rather than
+	 * leaving them for the queue to drop.
+	 * @param threshold_kb backlog in kilobytes; negative to stop marking
+	 */
+	void setEcnThreshold(double threshold_kb);
+
+	/**
+	 * Links with a queue discipline only: offers a packet to the queue for
+	 * its direction. The caller should start the transmitter if it's idle.
+	 * @param pkt marked in place if the link is congested
+	 * @param destination endpoint the packet is headed for
+	 * @param time now
+	 * @return true if queued, false if dropped
+	 */
+	bool enqueuePacket(packet &pkt, const netnode *destination,
+			double time);
+
+	/**
+	 * Links with a queue discipline only: takes the next packet off a
+	 * transmitter's queue and puts it on the wire. The caller is handed the
+	 * queue's hold on the packet's payload and must release it.
+	 * @param dir transmitter index; see @c directionIndex
+	 * @param time now; the transmitter must not be busy
+	 * @param pkt set to the packet sent
+	 * @param destination set to the endpoint it's headed for
+	 * @param done_time set to when it's on the wire and the transmitter
+	 * can start on the next one
+	 * @param arrival_time set to when it arrives
+	 * @return false, leaving the transmitter idle, if nothing was queued
+	 */
+	bool startNextTransmission(int dir, double time, packet &pkt,
+			netnode *&destination, double &done_time, double &arrival_time);
+
 	/**
 	 * If the link buffer has space the given packet is added to the buffer
 	 * and the rolling wait time and buffer occupancy are increased.
 	 *
-	 * @param pkt the packet to add to the buffer
+	 * @param pkt the packet to add to the buffer, marked in place if the
+	 * link is congested
 	 * @param destination of the packet
 	 * @param useDelay true if link delay should be used to sum into the
-	 * buffer's wait time. Should be used ONCE per window
+	 * buffer's wait time. Should be used ONCE per window. Ignored for
+	 * full-duplex links.
 	 * @param time at which we're trying to send this packet
 	 *
 	 * @return true if added to buffer successfully, false if dropped
 	 */
-	bool sendPacket(const packet &pkt, netnode *destination,
+	bool sendPacket(packet &pkt, netnode *destination,
 			bool useDelay, double time);
 
 	/**
@@ -1089,11 +1481,12 @@ public:
 	 *
 	 * @param pkt_id the given packet ID number must match the ID of the
 	 * packet about to be dequeued.
+	 * @param destination endpoint the packet arrived at
 	 *
 	 * @return true if the packet was dequeued (i.e. the given id matched
 	 * and the buffer wasn't empty)
 	 */
-	bool receivedPacket(long pkt_id);
+	bool receivedPacket(long pkt_id, const netnode *destination);
 
 	/**
 	 * Call this instead of @c receivedLonePacket when an arriving packet
@@ -1113,16 +1506,71 @@ public:
 	bool receivedPacketInWindow(long pkt_id, bool first_packet);
 
 	/**
-	 * Resets all values in linkTraffic map to 0.
+	 * Counts a packet that went through the link towards the link rate.
+	 * @param time at which it came out the other end
+	 * @param pkt
 	 */
-	void resetLinkTraffic();	
-	
+	void updateLinkTraffic(double time, const packet &pkt);
+
 	/**
-	 * Updates value of linkTraffic accordingly
-	 * @param time
-	 * @param type
+	 * Changes the window the link rate is measured over.
+	 * @param window_ms length of the window in ms
+	 * @param num_buckets number of steps the window slides in
 	 */
-	void updateLinkTraffic(int time, packet_type type);
+	void setRateWindow(double window_ms, int num_buckets);
+};
+
+// ---------------------------- distance_vector class -------------------------
+
+/**
+ * A router's distances to every node, indexed by node ID, as carried by a
+ * ROUTING packet. Kept out of line so that packets stay small and cheap to
+ * copy. The router and the events holding its routing packets share one of
+ * these through a reference count, and the last one to let go deletes it.
+ * Once shared it never changes: the router copies it before writing.
+ */
+class distance_vector {
+
+private:
+
+	/** Distance to each node, indexed by node ID. */
+	vector<double> distances;
+
+	/** Number of holders. */
+	mutable long refs;
+
+public:
+
+	/**
+	 * Copies the given distances. Starts with no holders.
+	 * @param distances indexed by node ID
+	 */
+	distance_vector(const vector<double> &distances);
+
+	/**
+	 * Getter for the distances.
+	 * @return distances indexed by node ID
+	 */
+	const vector<double> &getDistances() const;
+
+	/**
+	 * Getter for the distances, for writing.
+	 * @return distances indexed by node ID
+	 * @pre @c isShared is false
+	 */
+	vector<double> &getMutableDistances();
+
+	/**
+	 * @return true if more than one holder could be looking at the
+	 * distances
+	 */
+	bool isShared() const;
+
+	/** Adds a holder. */
+	void retain() const;
+
+	/** Removes a holder, deleting this object if it was the last one. */
+	void release() const;
 };
 
 // -------------------------------- packet class ------------------------------
@@ -1131,56 +1579,67 @@ public:
  * Describes a packet in the simulated network, which can be one of the types
  * in the enumerated type @c packetType. Note that a real packet would have a
  * payload but this class doesn't provide for one.
+ *
+ * Packets are copied into every event and link buffer they pass through, so
+ * this is a plain, trivially copyable record: nodes are referred to by ID
+ * and a ROUTING packet's distances live out of line in a
+ * @c distance_vector. Whoever keeps a routing packet around should hold on
+ * to its distances with @c retainPayload and @c releasePayload.
  */
-class packet : public netelement {
+class packet {
 
 private:
 
 	/** Unique ID number for this packet. */
 	long pkt_id;
 
+	/** Flow to which this packet belongs. */
+	netflow *parent_flow;
+
+	/** Distance vector for use in routing messages, NULL for others. */
+	const distance_vector *distances;
+
+	/** Transmit time (stored as double), for calculating link costs. */
+	double transmit_timestamp;
+
 	/**
 	 * Type of packet: either payload transmission, acknowledgement, or
 	 * routing.
 	 */
 	packet_type type;
 
-	/**
-	 * IP address of source host, which is just the name of the source
-	 * host in our simulation.
-	 */
-	string source_ip;
-
-	/** IP address of destination host, which is similarly just a name. */
-	string dest_ip;
+	/** True if the sender understands ECN, so links may mark the packet. */
+	bool ecn_capable;
 
-	/** Flow to which this packet belongs. */
-	netflow *parent_flow;
+	/** True if a link marked the packet congestion experienced (ECN CE). */
+	bool ecn_marked;
 
-	/** Packet size in megabits (to be consistent with flow) */
-	double size;
+	/** ACKs: true if the packet acknowledged was marked (ECN-Echo). */
+	bool ecn_echo;
 
 	/** Sequence number of packet */
 	int seqnum;
 
-	/** Distance vector for use in routing messages. **/
-	map<string, double> distance_vec;
+	/** ID of the node that sent this packet. */
+	int source;
 
-	/** Transmit time (stored as double), for calculating link costs. */
-	double transmit_timestamp;
+	/** ID of the node this packet is going to. */
+	int destination;
 
 	/**
 	 * Constructor helper. Does naive assignments; logic should be in the
 	 * calling constructors.
 	 */
-	void constructorHelper(packet_type type, const string &source_ip,
-				   const string &dest_ip, int seqnum,
-				   netflow *parent_flow, double size);
+	void constructorHelper(packet_type type, int source, int destination,
+			int seqnum, netflow *parent_flow);
 
 public:
 
-	/** Unique ID number generator. Initialized in corresponding cpp file. */
-	static long id_gen;
+	/**
+	 * Unique ID number generator. Initialized in corresponding cpp file.
+	 * One per thread, like @c event::id_generator.
+	 */
+	static thread_local long id_gen;
 
 	/**
 	 * Default contructor. Sets everything to dummy values.
@@ -1188,20 +1647,18 @@ public:
 	packet();
 
 	/**
-	 * This constructor infers the size of a packet from the given type, which
-	 * must be ROUTING since there's no parent flow and no sequence number.
+	 * This constructor makes a ROUTING packet, since there's no parent flow
 	 * and no sequence number.
 	 *
 	 * @param type one of the values of the @c packet_type enum, but must
 	 * be ROUTING for this constructor
-	 * @param source_ip the NAME (since this simulation uses names, not IPs)
-	 * of the original source which must be a router
-	 * @param dest_ip the NAME of the ultimate destination, which must be a
-	 * router
+	 * @param source the router sending the packet
+	 * @param destination the router the packet is for
 	 *
 	 * @warning assertion triggered if the packet type isn't ROUTING
 	 */
-	packet(packet_type type, const string &source_ip, const string &dest_ip);
+	packet(packet_type type, const netnode &source,
+			const netnode &destination);
 
 	/**
 	 * This constructor infers the size of a packet from the given type, which
@@ -1231,16 +1688,16 @@ public:
 	bool isNullPacket() const;
 
 	/**
-	 * Getter for the source host of this packet.
-	 * @return source host name
+	 * Getter for the source node of this packet.
+	 * @return source node ID
 	 */
-	string getSource() const;
+	int getSourceId() const;
 
 	/**
-	 * Getter for the destination host of this packet.
-	 * @return destination host name
+	 * Getter for the destination node of this packet.
+	 * @return destination node ID
 	 */
-	string getDestination() const;
+	int getDestinationId() const;
 
 	/**
 	 * Getter for the sequence number of this packet.
@@ -1255,16 +1712,22 @@ public:
 	long getId() const;
 
 	/**
-	 * Getter for the distances map.
-	 * @return distnaces map
+	 * Getter for the distances.
+	 * @return distances, or NULL if this isn't a ROUTING packet
 	 */
-	const map<string, double> &getDistances() const;
+	const distance_vector *getDistances() const;
 
 	/**
-	 * Setter for the distances map.
+	 * Setter for the distances. Doesn't retain them.
 	 * @param distances
 	 */
-	void setDistances(map<string, double> distances);
+	void setDistances(const distance_vector *distances);
+
+	/** Adds a holder to this packet's distances, if it has any. */
+	void retainPayload() const;
+
+	/** Removes a holder from this packet's distances, if it has any. */
+	void releasePayload() const;
 
 	/**
 	 * Getter for the parent flow of this packet.
@@ -1285,7 +1748,8 @@ public:
 	double getSizeMb() const;
 
 	/**
-	 * Getter for the size in bytes of this packet.
+	 * Getter for the size in bytes of this packet, which depends only on its
+	 * type.
 	 * @return size in bytes.
 	 */
 	long getSizeBytes() const;
@@ -1308,11 +1772,59 @@ public:
 	 */
 	void setTransmitTimestamp(double time);
 
+	/** @return true if links may mark this packet instead of dropping it */
+	bool isEcnCapable() const;
+
 	/**
-	 * Print helper function which partially overrides the one in @c netdevice.
+	 * Setter for whether the sender understands ECN.
+	 * @param capable
+	 */
+	void setEcnCapable(bool capable);
+
+	/** @return true if a link has marked this packet */
+	bool isEcnMarked() const;
+
+	/** Marks this packet as having gone through a congested queue. */
+	void markEcn();
+
+	/** @return true if this ACK echoes a mark on the packet it answers */
+	bool isEcnEcho() const;
+
+	/**
+	 * Setter for the ECN-Echo bit of an ACK.
+	 * @param echo
+	 */
+	void setEcnEcho(bool echo);
+
+	/**
+	 * Print helper function.
 	 * @param os The output stream to which to write.
 	 */
-	virtual void printHelper(ostream &os) const;
+	void printHelper(ostream &os) const;
+};
+
+/**
+ * Output operator override for printing contents of the given packet to an
+ * output stream.
+ * @param os The output stream to which to write.
+ * @param pkt The @c packet to write.
+ * @return The same output stream for operator chaining.
+ */
+inline ostream & operator<<(ostream &os, const packet &pkt) {
+	pkt.printHelper(os);
+	return os;
+}
+
+// ---------------------------- queued_packet struct --------------------------
+
+/** A packet in a link buffer, with the time it will reach the far end. */
+struct queued_packet {
+
+	/** Time in ms at which the packet arrives at the other endpoint. */
+	double arrival_time;
+
+	/** The packet. */
+	packet pkt;
 };
 
 #endif // NETWORK_H
@@ -0,0 +1,659 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+#include <cmath>
+
+// Custom headers.
+#include "queue_discipline.h"
+
+/**
+ * Most packets that can fit in the given number of bytes, i.e. how many
+ * slots a queue needs so it never runs out before its byte budget does.
+ */
+static long slotsFor(long capacity_bytes) {
+	return capacity_bytes / min(FLOW_PACKET_SIZE,
+			min(ACK_PACKET_SIZE, ROUTING_PACKET_SIZE));
+}
+
+// ------------------------------ queue_config --------------------------------
+
+queue_config::queue_config() :
+		type(DROP_TAIL_QUEUE), red_min_th_kb(0), red_max_th_kb(0),
+		red_max_p(0.1), red_weight(0.002), codel_target_ms(5),
+		codel_interval_ms(100), fq_flows(1024),
+		fq_quantum_bytes(FLOW_PACKET_SIZE), classify(CLASS_BY_TYPE),
+		num_classes(4) { }
+
+// --------------------------- queue_discipline class -------------------------
+
+queue_discipline::queue_discipline(long capacity_bytes) :
+		capacity_bytes(capacity_bytes), backlog_bytes(0), num_packets(0),
+		drops(0) { }
+
+queue_discipline::~queue_discipline() { }
+
+queue_discipline *queue_discipline::makeQueueDiscipline(
+		const queue_config &config, long capacity_bytes, double rate_bpms,
+		unsigned seed) {
+	switch (config.type) {
+	case DROP_TAIL_QUEUE:
+		return new fifo_queue(capacity_bytes);
+	case RED_QUEUE:
+		return new red_queue(config, capacity_bytes, rate_bpms, seed);
+	case CODEL_QUEUE:
+		return new codel_queue(config, capacity_bytes);
+	case FQ_CODEL_QUEUE:
+		return new fq_codel_queue(config, capacity_bytes);
+	case PRIO_QUEUE:
+		return new prio_queue(config, capacity_bytes);
+	case DRR_QUEUE:
+		return new drr_queue(config, capacity_bytes);
+	default:
+		assert(false);
+	}
+	return NULL;
+}
+
+bool queue_discipline::parseQueueType(const string &name, queue_type &type) {
+	if (name == "droptail") {
+		type = DROP_TAIL_QUEUE;
+		return true;
+	}
+	if (name == "red") {
+		type = RED_QUEUE;
+		return true;
+	}
+	if (name == "codel") {
+		type = CODEL_QUEUE;
+		return true;
+	}
+	if (name == "fq_codel") {
+		type = FQ_CODEL_QUEUE;
+		return true;
+	}
+	if (name == "prio") {
+		type = PRIO_QUEUE;
+		return true;
+	}
+	if (name == "drr") {
+		type = DRR_QUEUE;
+		return true;
+	}
+	return false;
+}
+
+void queue_discipline::dropHeld(const packet &pkt) {
+	drops++;
+	pkt.releasePayload();
+}
+
+long queue_discipline::getBacklogBytes() const { return backlog_bytes; }
+
+long queue_discipline::getNumPackets() const { return num_packets; }
+
+long queue_discipline::getDrops() const { return drops; }
+
+// ------------------------------ fifo_queue class ----------------------------
+
+fifo_queue::fifo_queue(long capacity_bytes) :
+		queue_discipline(capacity_bytes) {
+	fifo.setCapacity(slotsFor(capacity_bytes));
+}
+
+fifo_queue::~fifo_queue() {
+	while (!fifo.empty()) {
+		fifo.front().pkt.releasePayload();
+		fifo.pop_front();
+	}
+}
+
+bool fifo_queue::push(const packet &pkt, int direction, double now) {
+	if (backlog_bytes + pkt.getSizeBytes() > capacity_bytes) {
+		drops++;
+		return false;
+	}
+	waiting_packet entry = { now, pkt, direction };
+	bool pushed = fifo.push_back(entry);
+	assert(pushed);
+	(void) pushed;
+	pkt.retainPayload();
+	backlog_bytes += pkt.getSizeBytes();
+	num_packets++;
+	return true;
+}
+
+bool fifo_queue::pop(waiting_packet &out) {
+	if (fifo.empty()) {
+		return false;
+	}
+	out = fifo.front();
+	fifo.pop_front();
+	backlog_bytes -= out.pkt.getSizeBytes();
+	num_packets--;
+	return true;
+}
+
+bool fifo_queue::enqueue(const packet &pkt, int direction, double now) {
+	return push(pkt, direction, now);
+}
+
+bool fifo_queue::dequeue(double now, waiting_packet &out) {
+	return pop(out);
+}
+
+// ------------------------------- red_queue class ----------------------------
+
+red_queue::red_queue(const queue_config &config, long capacity_bytes,
+		double rate_bpms, unsigned seed) :
+		fifo_queue(capacity_bytes), avg_bytes(0), count(-1), idle_since(0),
+		max_p(config.red_max_p), weight(config.red_weight),
+		rate_bpms(rate_bpms), rng(seed) {
+	min_th = config.red_min_th_kb > 0 ?
+			config.red_min_th_kb * BYTES_PER_KB : capacity_bytes / 4.0;
+	max_th = config.red_max_th_kb > 0 ?
+			config.red_max_th_kb * BYTES_PER_KB : 3 * min_th;
+	assert(min_th < max_th);
+}
+
+bool red_queue::enqueue(const packet &pkt, int direction, double now) {
+
+	// Update the average. After the queue has sat empty, age the average
+	// as if one small packet's worth of empty samples had been taken for
+	// every packet the link could have sent in the meantime.
+	if (fifo.empty() && idle_since >= 0) {
+		double idle_packets =
+				(now - idle_since) * rate_bpms / FLOW_PACKET_SIZE;
+		avg_bytes *= pow(1 - weight, idle_packets);
+		idle_since = -1;
+	}
+	else {
+		avg_bytes += weight * (backlog_bytes - avg_bytes);
+	}
+
+	// Decide whether to drop early.
+	bool drop = false;
+	if (avg_bytes < min_th) {
+		count = -1;
+	}
+	else if (avg_bytes >= max_th) {
+		drop = true;
+	}
+	else {
+		count++;
+		double pb = max_p * (avg_bytes - min_th) / (max_th - min_th);
+		double pa = count * pb >= 1 ? 1 : pb / (1 - count * pb);
+		drop = uniform_real_distribution<double>(0, 1)(rng) < pa;
+	}
+	if (drop) {
+		count = 0;
+		drops++;
+		return false;
+	}
+	return push(pkt, direction, now);
+}
+
+bool red_queue::dequeue(double now, waiting_packet &out) {
+	bool popped = pop(out);
+	if (fifo.empty()) {
+		idle_since = now;
+	}
+	return popped;
+}
+
+double red_queue::getAverageBacklog() const { return avg_bytes; }
+
+// ------------------------------ codel state ---------------------------------
+
+codel_state::codel_state() :
+		first_above_time(0), drop_next(0), count(0), lastcount(0),
+		dropping(false) { }
+
+/**
+ * Takes the head packet off a queue and says whether CoDel could drop it,
+ * i.e. whether packets have been waiting longer than @c target for at least
+ * @c interval. This is @c dodequeue in RFC 8289.
+ * @param state the queue's control state
+ * @param queue_bytes the queue's backlog, as @c pop leaves it
+ * @param pop takes the head packet off the queue; @c bool(waiting_packet &)
+ * @param out set to the head packet
+ * @param ok_to_drop set to true if CoDel could drop it
+ * @return false if the queue was empty
+ */
+template <typename Pop>
+static bool codelPop(codel_state &state, double target, double interval,
+		double now, const long &queue_bytes, Pop pop, waiting_packet &out,
+		bool &ok_to_drop) {
+	ok_to_drop = false;
+	if (!pop(out)) {
+		state.first_above_time = 0;
+		return false;
+	}
+	double sojourn = now - out.enqueue_time;
+	if (sojourn < target || queue_bytes <= FLOW_PACKET_SIZE) {
+		state.first_above_time = 0;
+	}
+	else if (state.first_above_time == 0) {
+		state.first_above_time = now + interval;
+	}
+	else if (now >= state.first_above_time) {
+		ok_to_drop = true;
+	}
+	return true;
+}
+
+/**
+ * CoDel's dequeue: hands out the next packet that CoDel doesn't drop,
+ * dropping at intervals of @c interval / sqrt(count) while the delay stays
+ * above @c target. This is @c dequeue in RFC 8289.
+ * @param drop lets go of a dropped packet; @c void(const packet &)
+ * @return false if the queue ran out
+ */
+template <typename Pop, typename Drop>
+static bool codelDequeue(codel_state &state, double target, double interval,
+		double now, const long &queue_bytes, Pop pop, Drop drop,
+		waiting_packet &out) {
+	bool ok_to_drop;
+	bool got = codelPop(state, target, interval, now, queue_bytes, pop, out,
+			ok_to_drop);
+	if (!got) {
+		state.dropping = false;
+		return false;
+	}
+
+	if (state.dropping) {
+		if (!ok_to_drop) {
+			state.dropping = false;
+		}
+		while (state.dropping && now >= state.drop_next) {
+			drop(out.pkt);
+			state.count++;
+			got = codelPop(state, target, interval, now, queue_bytes, pop,
+					out, ok_to_drop);
+			if (!ok_to_drop) {
+				state.dropping = false;
+			}
+			else {
+				state.drop_next += interval / sqrt(state.count);
+			}
+		}
+	}
+	else if (ok_to_drop) {
+		drop(out.pkt);
+		got = codelPop(state, target, interval, now, queue_bytes, pop, out,
+				ok_to_drop);
+		state.dropping = true;
+
+		// If we were dropping not long ago, pick up close to the old drop
+		// rate rather than starting over.
+		long delta = state.count - state.lastcount;
+		state.count = (delta > 1 && now - state.drop_next < 16 * interval) ?
+				delta : 1;
+		state.drop_next = now + interval / sqrt(state.count);
+		state.lastcount = state.count;
+	}
+	return got;
+}
+
+// ------------------------------ codel_queue class ---------------------------
+
+codel_queue::codel_queue(const queue_config &config, long capacity_bytes) :
+		fifo_queue(capacity_bytes), target(config.codel_target_ms),
+		interval(config.codel_interval_ms) { }
+
+bool codel_queue::dequeue(double now, waiting_packet &out) {
+	return codelDequeue(state, target, interval, now, backlog_bytes,
+			[this](waiting_packet &head) { return pop(head); },
+			[this](const packet &pkt) { dropHeld(pkt); }, out);
+}
+
+// ----------------------------- fq_codel_queue class -------------------------
+
+const long fq_codel_queue::NONE;
+
+fq_codel_queue::fq_codel_queue(const queue_config &config,
+		long capacity_bytes) :
+		queue_discipline(capacity_bytes),
+		slots(slotsFor(capacity_bytes)), slot_next(slots.size()),
+		flows(config.fq_flows), new_head(NONE), new_tail(NONE),
+		old_head(NONE), old_tail(NONE), target(config.codel_target_ms),
+		interval(config.codel_interval_ms),
+		quantum(config.fq_quantum_bytes) {
+	assert(config.fq_flows > 0 && quantum > 0);
+
+	// Chain every slot into the free list.
+	for (long i = 0; i < (long) slots.size(); i++) {
+		slot_next[i] = i + 1 < (long) slots.size() ? i + 1 : NONE;
+	}
+	free_slot = slots.empty() ? NONE : 0;
+
+	for (vector<flow_queue>::iterator it = flows.begin(); it != flows.end();
+			it++) {
+		it->head = it->tail = NONE;
+		it->bytes = it->deficit = 0;
+		it->list = NOT_LISTED;
+		it->next = NONE;
+	}
+}
+
+fq_codel_queue::~fq_codel_queue() {
+	waiting_packet entry;
+	for (long q = 0; q < (long) flows.size(); q++) {
+		while (pop(q, entry)) {
+			entry.pkt.releasePayload();
+		}
+	}
+}
+
+long fq_codel_queue::flowIndex(const packet &pkt) const {
+	unsigned long key = pkt.getSourceId();
+	key = key * 31 + pkt.getDestinationId();
+	key = key * 31 + pkt.getType();
+	if (pkt.getParentFlow() != NULL) {
+		key = key * 31 + pkt.getParentFlow()->getId();
+	}
+
+	// Fibonacci hashing spreads nearby keys over the whole table.
+	key *= 0x9E3779B97F4A7C15UL;
+	return (key >> 32) % flows.size();
+}
+
+void fq_codel_queue::append(long q, int list) {
+	long &head = list == NEW_LIST ? new_head : old_head;
+	long &tail = list == NEW_LIST ? new_tail : old_tail;
+	flows[q].list = list;
+	flows[q].next = NONE;
+	if (tail == NONE) {
+		head = q;
+	}
+	else {
+		flows[tail].next = q;
+	}
+	tail = q;
+}
+
+void fq_codel_queue::popFront(long q) {
+	long &head = flows[q].list == NEW_LIST ? new_head : old_head;
+	long &tail = flows[q].list == NEW_LIST ? new_tail : old_tail;
+	assert(head == q);
+	head = flows[q].next;
+	if (head == NONE) {
+		tail = NONE;
+	}
+	flows[q].list = NOT_LISTED;
+	flows[q].next = NONE;
+}
+
+bool fq_codel_queue::pop(long q, waiting_packet &out) {
+	flow_queue &flow = flows[q];
+	if (flow.head == NONE) {
+		return false;
+	}
+	long slot = flow.head;
+	out = slots[slot];
+	flow.head = slot_next[slot];
+	if (flow.head == NONE) {
+		flow.tail = NONE;
+	}
+	slot_next[slot] = free_slot;
+	free_slot = slot;
+	flow.bytes -= out.pkt.getSizeBytes();
+	backlog_bytes -= out.pkt.getSizeBytes();
+	num_packets--;
+	return true;
+}
+
+bool fq_codel_queue::enqueue(const packet &pkt, int direction, double now) {
+	if (backlog_bytes + pkt.getSizeBytes() > capacity_bytes ||
+			free_slot == NONE) {
+		drops++;
+		return false;
+	}
+	pkt.retainPayload();
+
+	long slot = free_slot;
+	free_slot = slot_next[slot];
+	waiting_packet entry = { now, pkt, direction };
+	slots[slot] = entry;
+	slot_next[slot] = NONE;
+
+	long q = flowIndex(pkt);
+	flow_queue &flow = flows[q];
+	if (flow.tail == NONE) {
+		flow.head = slot;
+	}
+	else {
+		slot_next[flow.tail] = slot;
+	}
+	flow.tail = slot;
+	flow.bytes += pkt.getSizeBytes();
+	backlog_bytes += pkt.getSizeBytes();
+	num_packets++;
+
+	// A queue that wasn't waiting for a turn goes to the front of the line.
+	if (flow.list == NOT_LISTED) {
+		append(q, NEW_LIST);
+		flow.deficit = quantum;
+	}
+	return true;
+}
+
+bool fq_codel_queue::dequeue(double now, waiting_packet &out) {
+	while (true) {
+		long q;
+		if (new_head != NONE) {
+			q = new_head;
+		}
+		else if (old_head != NONE) {
+			q = old_head;
+		}
+		else {
+			return false;
+		}
+		flow_queue &flow = flows[q];
+
+		// Out of credit: top it up and send it to the back of the line.
+		if (flow.deficit <= 0) {
+			flow.deficit += quantum;
+			popFront(q);
+			append(q, OLD_LIST);
+			continue;
+		}
+
+		bool got = codelDequeue(flow.codel, target, interval, now,
+				flow.bytes,
+				[this, q](waiting_packet &head) { return pop(q, head); },
+				[this](const packet &pkt) { dropHeld(pkt); }, out);
+		if (!got) {
+			// A new queue that empties goes behind the old ones once, so a
+			// flow can't stay "new" by sending one packet at a time.
+			bool was_new = flow.list == NEW_LIST;
+			popFront(q);
+			if (was_new && old_head != NONE) {
+				append(q, OLD_LIST);
+			}
+			continue;
+		}
+		flow.deficit -= out.pkt.getSizeBytes();
+		return true;
+	}
+}
+
+// ------------------------------ class_stats ---------------------------------
+
+class_stats::class_stats() :
+		packets_sent(0), bytes_sent(0), drops(0), num_packets(0),
+		backlog_bytes(0) { }
+
+// ------------------------------ class_queue class ---------------------------
+
+const int class_queue::NONE;
+
+class_queue::class_queue(const queue_config &config, long capacity_bytes) :
+		queue_discipline(capacity_bytes), key(config.classify),
+		queues(config.classify == CLASS_BY_TYPE ? 3 : config.num_classes),
+		stats(queues.size()) {
+	assert(queues.size() > 0);
+	for (long cls = 0; cls < (long) queues.size(); cls++) {
+		queues[cls].setCapacity(slotsFor(capacity_bytes));
+	}
+}
+
+class_queue::~class_queue() {
+	for (long cls = 0; cls < (long) queues.size(); cls++) {
+		while (!queues[cls].empty()) {
+			queues[cls].front().pkt.releasePayload();
+			queues[cls].pop_front();
+		}
+	}
+}
+
+int class_queue::classify(const packet &pkt) const {
+	if (key == CLASS_BY_TYPE) {
+		switch (pkt.getType()) {
+		case ROUTING:
+			return 0;
+		case ACK:
+			return 1;
+		default:
+			return 2;
+		}
+	}
+	if (pkt.getType() == ROUTING || pkt.getParentFlow() == NULL) {
+		return 0;
+	}
+	int cls = 1 + pkt.getParentFlow()->getTrafficClass();
+	return min(max(cls, 0), (int) queues.size() - 1);
+}
+
+void class_queue::popClass(int cls, waiting_packet &out) {
+	out = queues[cls].front();
+	queues[cls].pop_front();
+	long size = out.pkt.getSizeBytes();
+	backlog_bytes -= size;
+	num_packets--;
+	stats[cls].backlog_bytes -= size;
+	stats[cls].num_packets--;
+	stats[cls].packets_sent++;
+	stats[cls].bytes_sent += size;
+}
+
+bool class_queue::enqueue(const packet &pkt, int direction, double now) {
+	int cls = classify(pkt);
+	long size = pkt.getSizeBytes();
+	if (backlog_bytes + size > capacity_bytes) {
+		drops++;
+		stats[cls].drops++;
+		return false;
+	}
+	waiting_packet entry = { now, pkt, direction };
+	bool pushed = queues[cls].push_back(entry);
+	assert(pushed);
+	(void) pushed;
+	pkt.retainPayload();
+	backlog_bytes += size;
+	num_packets++;
+	stats[cls].backlog_bytes += size;
+	stats[cls].num_packets++;
+	if (queues[cls].size() == 1) {
+		activate(cls);
+	}
+	return true;
+}
+
+int class_queue::getNumClasses() const { return queues.size(); }
+
+const class_stats &class_queue::getClassStats(int cls) const {
+	return stats[cls];
+}
+
+string class_queue::getClassName(int cls) const {
+	if (key == CLASS_BY_TYPE) {
+		const char *names[] = { "routing", "ack", "flow" };
+		return names[cls];
+	}
+	return cls == 0 ? "routing" : "flow class " + to_string(cls - 1);
+}
+
+// ------------------------------- prio_queue class ---------------------------
+
+prio_queue::prio_queue(const queue_config &config, long capacity_bytes) :
+		class_queue(config, capacity_bytes), busy(0) {
+	assert(queues.size() <= 32);
+}
+
+void prio_queue::activate(int cls) { busy |= 1u << cls; }
+
+bool prio_queue::dequeue(double now, waiting_packet &out) {
+	if (busy == 0) {
+		return false;
+	}
+	int cls = __builtin_ctz(busy);
+	popClass(cls, out);
+	if (queues[cls].empty()) {
+		busy &= ~(1u << cls);
+	}
+	return true;
+}
+
+// ------------------------------- drr_queue class ----------------------------
+
+drr_queue::drr_queue(const queue_config &config, long capacity_bytes) :
+		class_queue(config, capacity_bytes), quanta(queues.size()),
+		deficits(queues.size(), 0), next(queues.size(), NONE), head(NONE),
+		tail(NONE) {
+	for (long cls = 0; cls < (long) quanta.size(); cls++) {
+		quanta[cls] = cls < (long) config.quanta.size() ?
+				config.quanta[cls] : FLOW_PACKET_SIZE;
+		assert(quanta[cls] > 0);
+	}
+}
+
+void drr_queue::append(int cls) {
+	next[cls] = NONE;
+	if (tail == NONE) {
+		head = cls;
+	}
+	else {
+		next[tail] = cls;
+	}
+	tail = cls;
+}
+
+void drr_queue::popFront() {
+	int cls = head;
+	head = next[cls];
+	if (head == NONE) {
+		tail = NONE;
+	}
+	next[cls] = NONE;
+}
+
+void drr_queue::activate(int cls) {
+	deficits[cls] = quanta[cls];
+	append(cls);
+}
+
+bool drr_queue::dequeue(double now, waiting_packet &out) {
+	while (head != NONE) {
+		int cls = head;
+
+		// Out of credit: top it up and send it to the back of the line.
+		if (deficits[cls] <= 0) {
+			deficits[cls] += quanta[cls];
+			popFront();
+			append(cls);
+			continue;
+		}
+
+		popClass(cls, out);
+		deficits[cls] -= out.pkt.getSizeBytes();
+		if (queues[cls].empty()) {
+			popFront();
+		}
+		return true;
+	}
+	return false;
+}
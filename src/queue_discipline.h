@@ -0,0 +1,614 @@
+/**
+ * @file
+ *
+ * Contains the declarations of the queue disciplines a link can use to
+ * decide which packets to drop and which to send next: plain drop-tail,
+ * RED, CoDel, and FQ-CoDel. Every enqueue and dequeue decision is O(1).
+ */
+
+#ifndef QUEUE_DISCIPLINE_H
+#define QUEUE_DISCIPLINE_H
+
+// Standard includes.
+#include <random>
+#include <string>
+#include <vector>
+
+// Custom headers.
+#include "network.h"
+#include "ring_buffer.h"
+
+using namespace std;
+
+/** Kinds of queue disciplines a link can be configured to use. */
+enum queue_type {
+	DROP_TAIL_QUEUE,
+	RED_QUEUE,
+	CODEL_QUEUE,
+	FQ_CODEL_QUEUE,
+	PRIO_QUEUE,
+	DRR_QUEUE
+};
+
+/** How multi-class queue disciplines sort packets into classes. */
+enum class_key {
+	/** Routing, then ACK, then FLOW packets. */
+	CLASS_BY_TYPE,
+	/**
+	 * Routing packets, then each flow's class as set in the input, so a
+	 * flow of class c and its ACKs go in class c + 1.
+	 */
+	CLASS_BY_FLOW
+};
+
+/**
+ * A link's queue settings as given in the input file. Anything not given
+ * keeps the default from the constructor.
+ */
+struct queue_config {
+
+	/** Which discipline to use. */
+	queue_type type;
+
+	/** RED: average backlog in KB below which nothing is dropped early. */
+	double red_min_th_kb;
+
+	/** RED: average backlog in KB above which everything is dropped. */
+	double red_max_th_kb;
+
+	/** RED: drop probability as the average backlog reaches the max. */
+	double red_max_p;
+
+	/** RED: weight of each new sample in the average backlog. */
+	double red_weight;
+
+	/** CoDel: acceptable standing queue delay in ms. */
+	double codel_target_ms;
+
+	/** CoDel: window in ms over which the delay must stay above target. */
+	double codel_interval_ms;
+
+	/** FQ-CoDel: number of flow queues packets are hashed into. */
+	int fq_flows;
+
+	/** FQ-CoDel: bytes each flow queue may send per round. */
+	long fq_quantum_bytes;
+
+	/** Priority and DRR: how packets are sorted into classes. */
+	class_key classify;
+
+	/**
+	 * Priority and DRR by flow: number of classes, including the one for
+	 * routing packets; four unless the input says otherwise. Sorting by
+	 * type always makes three.
+	 */
+	int num_classes;
+
+	/**
+	 * DRR: bytes each class may send per round, by class. Classes past the
+	 * end get one FLOW packet's worth.
+	 */
+	vector<long> quanta;
+
+	/**
+	 * Drop-tail, with RED thresholds at a quarter and three quarters of the
+	 * buffer, CoDel and FQ-CoDel settings from RFCs 8289 and 8290, and
+	 * classes by packet type.
+	 */
+	queue_config();
+};
+
+/** A packet waiting in a queue discipline. */
+struct waiting_packet {
+
+	/** Time in ms at which the packet was queued. */
+	double enqueue_time;
+
+	/** The packet. */
+	packet pkt;
+
+	/**
+	 * Which way the packet is headed, for the link's benefit; the queue
+	 * discipline just hands it back.
+	 */
+	int direction;
+};
+
+// --------------------------- queue_discipline class -------------------------
+
+/**
+ * Interface for a link's packet queue. Decides which arriving packets to
+ * turn away and which waiting packet the link sends next, dropping some
+ * on the way out if it likes.
+ *
+ * While a packet waits in the queue the queue holds on to its routing
+ * payload, if any. A packet handed out by @c dequeue comes with that hold,
+ * which the caller must release.
+ */
+class queue_discipline {
+
+protected:
+
+	/** Capacity in bytes. */
+	long capacity_bytes;
+
+	/** Bytes waiting. */
+	long backlog_bytes;
+
+	/** Packets waiting. */
+	long num_packets;
+
+	/** Packets dropped so far, on the way in or out. */
+	long drops;
+
+	/**
+	 * Counts a packet as dropped and lets go of its payload.
+	 * @param pkt a packet this queue held
+	 */
+	void dropHeld(const packet &pkt);
+
+public:
+
+	/**
+	 * Makes an empty queue.
+	 * @param capacity_bytes most bytes that can wait at once
+	 */
+	queue_discipline(long capacity_bytes);
+
+	/** Destructor. Subclasses let go of whatever is still waiting. */
+	virtual ~queue_discipline();
+
+	/**
+	 * Makes a queue discipline of the configured type.
+	 * @param config settings; see @c queue_config
+	 * @param capacity_bytes most bytes that can wait at once
+	 * @param rate_bpms rate the queue is drained at, in bytes per ms
+	 * @param seed for any random choices, so runs are repeatable
+	 * @return the new queue discipline, which the caller owns
+	 */
+	static queue_discipline *makeQueueDiscipline(const queue_config &config,
+			long capacity_bytes, double rate_bpms, unsigned seed);
+
+	/**
+	 * Looks up a queue type by the name used in the input file: "droptail",
+	 * "red", "codel", "fq_codel", "prio", or "drr".
+	 * @param name
+	 * @param type set if the name is known
+	 * @return true if the name is known
+	 */
+	static bool parseQueueType(const string &name, queue_type &type);
+
+	/**
+	 * Offers a packet to the queue.
+	 * @param pkt packet arriving at the link
+	 * @param direction which way it's headed; see @c waiting_packet
+	 * @param now current time in ms
+	 * @return true if queued, false if dropped
+	 */
+	virtual bool enqueue(const packet &pkt, int direction, double now) = 0;
+
+	/**
+	 * Takes the next packet to send out of the queue.
+	 * @param now current time in ms
+	 * @param out set to the packet to send
+	 * @return false if there's nothing to send
+	 */
+	virtual bool dequeue(double now, waiting_packet &out) = 0;
+
+	/** @return bytes waiting */
+	long getBacklogBytes() const;
+
+	/** @return packets waiting */
+	long getNumPackets() const;
+
+	/** @return packets dropped so far */
+	long getDrops() const;
+};
+
+// ------------------------------ fifo_queue class ----------------------------
+
+/**
+ * Single first-in first-out queue that drops arriving packets when it's
+ * full, i.e. drop-tail. Also the base of RED and CoDel, which change what
+ * happens on the way in and out respectively.
+ */
+class fifo_queue : public queue_discipline {
+
+protected:
+
+	/** Waiting packets, oldest first. */
+	ring_buffer<waiting_packet> fifo;
+
+	/**
+	 * Queues a packet if it fits.
+	 * @return false, having dropped it, if it didn't
+	 */
+	bool push(const packet &pkt, int direction, double now);
+
+	/**
+	 * Takes the oldest packet out.
+	 * @param out set to the oldest packet
+	 * @return false if there were none
+	 */
+	bool pop(waiting_packet &out);
+
+public:
+
+	/** @param capacity_bytes most bytes that can wait at once */
+	fifo_queue(long capacity_bytes);
+
+	/** Destructor. Lets go of the waiting packets' payloads. */
+	~fifo_queue();
+
+	bool enqueue(const packet &pkt, int direction, double now);
+
+	bool dequeue(double now, waiting_packet &out);
+};
+
+// ------------------------------- red_queue class ----------------------------
+
+/**
+ * Random Early Detection (Floyd and Jacobson, 1993). Keeps an exponentially
+ * weighted average of the backlog and, between the two thresholds, drops
+ * arriving packets with a probability that grows with the average and with
+ * the number of packets let in since the last drop, so drops are spread
+ * out evenly.
+ */
+class red_queue : public fifo_queue {
+
+private:
+
+	/** Average backlog in bytes. */
+	double avg_bytes;
+
+	/** Packets let in since the last early drop, or -1 below min_th. */
+	long count;
+
+	/** When the queue last went empty, or -1 if it isn't. */
+	double idle_since;
+
+	/** Thresholds on the average backlog, in bytes. */
+	double min_th, max_th;
+
+	/** See @c queue_config. */
+	double max_p, weight;
+
+	/** Drain rate in bytes per ms, to age the average over idle time. */
+	double rate_bpms;
+
+	/** Source of the drop decisions. */
+	minstd_rand rng;
+
+public:
+
+	/**
+	 * @param config thresholds, max drop probability and averaging weight
+	 * @param capacity_bytes most bytes that can wait at once
+	 * @param rate_bpms drain rate in bytes per ms
+	 * @param seed for the drop decisions
+	 */
+	red_queue(const queue_config &config, long capacity_bytes,
+			double rate_bpms, unsigned seed);
+
+	bool enqueue(const packet &pkt, int direction, double now);
+
+	bool dequeue(double now, waiting_packet &out);
+
+	/** @return the average backlog in bytes */
+	double getAverageBacklog() const;
+};
+
+// ------------------------------ codel state ---------------------------------
+
+/** CoDel's per-queue control state; see RFC 8289. */
+struct codel_state {
+
+	/** When the delay first went above target, or 0 if it's below. */
+	double first_above_time;
+
+	/** When to drop next while in the dropping state. */
+	double drop_next;
+
+	/** Drops since entering the dropping state. */
+	long count;
+
+	/** @c count when the dropping state was last left. */
+	long lastcount;
+
+	/** True while the queue is being drained by drops. */
+	bool dropping;
+
+	codel_state();
+};
+
+// ------------------------------ codel_queue class ---------------------------
+
+/**
+ * Controlled Delay (Nichols and Jacobson, 2012). Tail-drops only when the
+ * buffer is full; otherwise drops from the head when packets have spent
+ * longer than the target in the queue for a whole interval, dropping more
+ * often the longer that lasts.
+ */
+class codel_queue : public fifo_queue {
+
+private:
+
+	/** Target and interval in ms. */
+	double target, interval;
+
+	/** Control state. */
+	codel_state state;
+
+public:
+
+	/**
+	 * @param config target and interval
+	 * @param capacity_bytes most bytes that can wait at once
+	 */
+	codel_queue(const queue_config &config, long capacity_bytes);
+
+	bool dequeue(double now, waiting_packet &out);
+};
+
+// ----------------------------- fq_codel_queue class -------------------------
+
+/**
+ * FQ-CoDel (RFC 8290). Packets are hashed by flow into separate queues,
+ * each with its own CoDel state, which take turns by deficit round robin.
+ * Queues that just became busy go ahead of ones that have been busy for a
+ * while, so sparse flows like ACKs and routing updates don't wait behind
+ * bulk ones.
+ *
+ * All the flow queues share one pool of slots, linked into per-queue
+ * lists, so memory is bounded by the buffer rather than the number of
+ * queues. When the buffer is full the arriving packet is dropped, rather
+ * than one from the longest queue as Linux does, since finding that queue
+ * isn't O(1).
+ */
+class fq_codel_queue : public queue_discipline {
+
+private:
+
+	/** Marks the end of a list of slots or of flow queues. */
+	static const long NONE = -1;
+
+	/** One flow queue. */
+	struct flow_queue {
+		/** First and last slot of the queue's packets. */
+		long head, tail;
+		/** Bytes waiting in this queue. */
+		long bytes;
+		/** Bytes this queue may still send this round. */
+		long deficit;
+		/** Which of the new and old lists it's on, if any. */
+		int list;
+		/** Next flow queue on the same list. */
+		long next;
+		/** CoDel control state. */
+		codel_state codel;
+	};
+
+	/** Values of @c flow_queue::list. */
+	enum { NOT_LISTED, NEW_LIST, OLD_LIST };
+
+	/** Packet slots, shared by all flow queues. */
+	vector<waiting_packet> slots;
+
+	/** Next slot in the same flow queue, or in the free list. */
+	vector<long> slot_next;
+
+	/** First free slot. */
+	long free_slot;
+
+	/** The flow queues. */
+	vector<flow_queue> flows;
+
+	/** First and last flow queue on the new and old lists. */
+	long new_head, new_tail, old_head, old_tail;
+
+	/** Target and interval in ms. */
+	double target, interval;
+
+	/** Bytes per round. */
+	long quantum;
+
+	/**
+	 * @param pkt
+	 * @return index of the flow queue the packet belongs in
+	 */
+	long flowIndex(const packet &pkt) const;
+
+	/** Adds a flow queue to the back of the new or old list. */
+	void append(long q, int list);
+
+	/** Takes the flow queue at the front of its list off that list. */
+	void popFront(long q);
+
+	/**
+	 * Takes the oldest packet out of a flow queue.
+	 * @return false if it was empty
+	 */
+	bool pop(long q, waiting_packet &out);
+
+public:
+
+	/**
+	 * @param config number of flow queues, quantum, target and interval
+	 * @param capacity_bytes most bytes that can wait at once, all queues
+	 * together
+	 */
+	fq_codel_queue(const queue_config &config, long capacity_bytes);
+
+	/** Destructor. Lets go of the waiting packets' payloads. */
+	~fq_codel_queue();
+
+	bool enqueue(const packet &pkt, int direction, double now);
+
+	bool dequeue(double now, waiting_packet &out);
+};
+
+// ------------------------------ class_stats ---------------------------------
+
+/** What a multi-class queue discipline has done with one class. */
+struct class_stats {
+
+	/** Packets and bytes sent. */
+	long packets_sent, bytes_sent;
+
+	/** Packets dropped because the buffer was full. */
+	long drops;
+
+	/** Packets and bytes waiting. */
+	long num_packets, backlog_bytes;
+
+	class_stats();
+};
+
+// ------------------------------ class_queue class ---------------------------
+
+/**
+ * Base of the queue disciplines that keep a drop-tail FIFO per traffic
+ * class and choose between the classes on the way out. The classes share
+ * the link's buffer. Subclasses keep track of which classes have packets
+ * waiting and pick one of them in @c dequeue.
+ */
+class class_queue : public queue_discipline {
+
+protected:
+
+	/** Marks the end of a list of classes. */
+	static const int NONE = -1;
+
+	/** How packets are sorted into classes. */
+	class_key key;
+
+	/** Waiting packets by class, oldest first. */
+	vector<ring_buffer<waiting_packet> > queues;
+
+	/** Counters by class. */
+	vector<class_stats> stats;
+
+	/**
+	 * @param pkt
+	 * @return the packet's class
+	 */
+	int classify(const packet &pkt) const;
+
+	/**
+	 * Takes the oldest packet out of a class, counting it as sent.
+	 * @pre the class has a packet waiting
+	 */
+	void popClass(int cls, waiting_packet &out);
+
+	/**
+	 * Called when a class that had nothing waiting gets a packet.
+	 * @param cls
+	 */
+	virtual void activate(int cls) = 0;
+
+public:
+
+	/**
+	 * @param config how to classify and how many classes
+	 * @param capacity_bytes most bytes that can wait at once, all classes
+	 * together
+	 */
+	class_queue(const queue_config &config, long capacity_bytes);
+
+	/** Destructor. Lets go of the waiting packets' payloads. */
+	~class_queue();
+
+	bool enqueue(const packet &pkt, int direction, double now);
+
+	/** @return number of classes */
+	int getNumClasses() const;
+
+	/**
+	 * @param cls
+	 * @return the class's counters
+	 */
+	const class_stats &getClassStats(int cls) const;
+
+	/**
+	 * @param cls
+	 * @return the class's name for logs, e.g. "ack" or "flow class 2"
+	 */
+	string getClassName(int cls) const;
+};
+
+// ------------------------------- prio_queue class ---------------------------
+
+/**
+ * Strict priority: always sends from the lowest-numbered class with
+ * packets waiting, so routing updates never wait behind data. A bitmap of
+ * the busy classes makes finding it a single bit scan.
+ */
+class prio_queue : public class_queue {
+
+private:
+
+	/** Bit i is set while class i has packets waiting. */
+	unsigned busy;
+
+protected:
+
+	void activate(int cls);
+
+public:
+
+	/**
+	 * @param config how to classify and how many classes, at most 32
+	 * @param capacity_bytes most bytes that can wait at once
+	 */
+	prio_queue(const queue_config &config, long capacity_bytes);
+
+	bool dequeue(double now, waiting_packet &out);
+};
+
+// ------------------------------- drr_queue class ----------------------------
+
+/**
+ * Deficit round robin (Shreedhar and Varghese, 1995): the busy classes take
+ * turns, each sending up to its quantum of bytes per round, so they share
+ * the link in proportion to their quanta whatever their packet sizes.
+ * Classes with a credit left go first, and one that runs out of credit or
+ * packets moves to the back of the line, so each packet is O(1).
+ */
+class drr_queue : public class_queue {
+
+private:
+
+	/** Bytes per round by class. */
+	vector<long> quanta;
+
+	/** Bytes each class may still send this round. */
+	vector<long> deficits;
+
+	/** Next busy class in line after each busy class. */
+	vector<int> next;
+
+	/** First and last busy class in line. */
+	int head, tail;
+
+	/** Puts a class at the back of the line. */
+	void append(int cls);
+
+	/** Takes the class at the front out of the line. */
+	void popFront();
+
+protected:
+
+	void activate(int cls);
+
+public:
+
+	/**
+	 * @param config how to classify, how many classes, and their quanta
+	 * @param capacity_bytes most bytes that can wait at once
+	 */
+	drr_queue(const queue_config &config, long capacity_bytes);
+
+	bool dequeue(double now, waiting_packet &out);
+};
+
+#endif // QUEUE_DISCIPLINE_H
@@ -0,0 +1,75 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+#include <cmath>
+
+// Custom headers.
+#include "rate_counter.h"
+#include "util.h"
+
+rate_counter::rate_counter() { setWindow(RATE_INTERVAL, RATE_BUCKETS); }
+
+rate_counter::rate_counter(double window_ms, int num_buckets) {
+	setWindow(window_ms, num_buckets);
+}
+
+void rate_counter::setWindow(double window_ms, int num_buckets) {
+	assert(window_ms > 0 && num_buckets > 0);
+	buckets.assign(num_buckets, 0);
+	bucket_ms = window_ms / num_buckets;
+	newest = 0;
+	total = 0;
+}
+
+double rate_counter::getWindowMs() const {
+	return bucket_ms * buckets.size();
+}
+
+long rate_counter::bucketOf(double time) const {
+	return (long) floor(time / bucket_ms);
+}
+
+void rate_counter::add(double time, long amount) {
+	assert(time >= 0);
+	long bucket = bucketOf(time);
+	long size = buckets.size();
+
+	// Slide the window forward, clearing the buckets it passes over.
+	if (bucket - newest >= size) {
+		buckets.assign(size, 0);
+		total = 0;
+		newest = bucket;
+	}
+	while (newest < bucket) {
+		newest++;
+		total -= buckets[newest % size];
+		buckets[newest % size] = 0;
+	}
+
+	if (newest - bucket < size) {
+		buckets[bucket % size] += amount;
+		total += amount;
+	}
+}
+
+long rate_counter::getTotal(double time) const {
+	long bucket = bucketOf(time);
+	long size = buckets.size();
+	if (bucket - newest >= size) {
+		return 0;
+	}
+
+	// Leave out the buckets the window would slide past by then.
+	long result = total;
+	for (long i = newest + 1; i <= bucket; i++) {
+		result -= buckets[i % size];
+	}
+	return result;
+}
+
+double rate_counter::getRatePerMs(double time) const {
+	return getTotal(time) / getWindowMs();
+}
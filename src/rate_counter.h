@@ -0,0 +1,94 @@
+/**
+ * @file
+ *
+ * Contains the sliding-window counter behind the link and flow rate
+ * metrics.
+ */
+
+#ifndef RATE_COUNTER_H
+#define RATE_COUNTER_H
+
+// Standard includes.
+#include <vector>
+
+using namespace std;
+
+// ------------------------------ rate_counter class --------------------------
+
+/**
+ * Counts how much of something (bytes, packets) went by in the last
+ * window of time. The window is split into a ring of equal sub-buckets, and
+ * a running total over the ring is kept up to date, so adding and reading
+ * are O(1) apart from clearing buckets that slid out of the window, of
+ * which there are never more than the ring holds. A long idle gap just
+ * clears the ring.
+ *
+ * The count covers the current, partly filled bucket and the ones before
+ * it, so it moves in steps of one bucket instead of jumping to zero at the
+ * end of every window.
+ */
+class rate_counter {
+
+private:
+
+	/** Amount counted in each bucket. */
+	vector<long> buckets;
+
+	/** Width of each bucket in ms. */
+	double bucket_ms;
+
+	/** Index of the newest bucket, counting buckets from time zero. */
+	long newest;
+
+	/** Sum of @c buckets. */
+	long total;
+
+	/**
+	 * @param time in ms
+	 * @return index of the bucket holding that time, counting from zero
+	 */
+	long bucketOf(double time) const;
+
+public:
+
+	/** Makes a counter with a window of @c RATE_INTERVAL ms. */
+	rate_counter();
+
+	/**
+	 * @param window_ms length of the window in ms
+	 * @param num_buckets number of buckets it's split into
+	 */
+	rate_counter(double window_ms, int num_buckets);
+
+	/**
+	 * Changes the window and forgets everything counted so far.
+	 * @param window_ms length of the window in ms
+	 * @param num_buckets number of buckets it's split into
+	 */
+	void setWindow(double window_ms, int num_buckets);
+
+	/** @return length of the window in ms */
+	double getWindowMs() const;
+
+	/**
+	 * Counts an amount at a time. Times should mostly go forward; an
+	 * amount for a time older than the window is ignored.
+	 * @param time in ms
+	 * @param amount
+	 */
+	void add(double time, long amount);
+
+	/**
+	 * @param time in ms; no earlier than the last @c add
+	 * @return amount counted in the window ending at that time
+	 */
+	long getTotal(double time) const;
+
+	/**
+	 * @param time in ms; no earlier than the last @c add
+	 * @return amount per ms over the window ending at that time
+	 */
+	double getRatePerMs(double time) const;
+};
+
+#endif // RATE_COUNTER_H
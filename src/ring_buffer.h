@@ -0,0 +1,121 @@
+/**
+ * @file
+ *
+ * Contains the fixed-capacity FIFO that backs a link's packet buffer.
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+// Standard includes.
+#include <cassert>
+#include <vector>
+
+using namespace std;
+
+// ------------------------------ ring_buffer class ---------------------------
+
+/**
+ * First-in first-out queue over a circular array whose size is fixed when
+ * the queue is set up. Pushing, popping and looking at either end are O(1)
+ * and never allocate.
+ *
+ * @tparam T element type; must be default-constructible and copyable
+ */
+template <typename T>
+class ring_buffer {
+
+private:
+
+	/** Element storage. Its size is the capacity. */
+	vector<T> slots;
+
+	/** Index of the oldest element. */
+	long head;
+
+	/** Number of elements queued. */
+	long count;
+
+	/**
+	 * @param i position counting from the oldest element
+	 * @return index of that position in @c slots
+	 */
+	long slotIndex(long i) const {
+		long index = head + i;
+		return index >= (long) slots.size() ? index - slots.size() : index;
+	}
+
+public:
+
+	/** Makes an empty queue with no room; see @c setCapacity. */
+	ring_buffer() : head(0), count(0) { }
+
+	/**
+	 * Makes room for the given number of elements. Drops anything queued.
+	 * @param capacity maximum number of elements
+	 */
+	void setCapacity(long capacity) {
+		slots.assign(capacity, T());
+		head = 0;
+		count = 0;
+	}
+
+	/** @return maximum number of elements */
+	long capacity() const { return slots.size(); }
+
+	/** @return number of elements queued */
+	long size() const { return count; }
+
+	/** @return true if nothing is queued */
+	bool empty() const { return count == 0; }
+
+	/** @return true if there's no room for another element */
+	bool full() const { return count == (long) slots.size(); }
+
+	/**
+	 * Adds an element at the back.
+	 * @param element to copy in
+	 * @return false, leaving the queue alone, if it was full
+	 */
+	bool push_back(const T &element) {
+		if (full()) {
+			return false;
+		}
+		slots[slotIndex(count)] = element;
+		count++;
+		return true;
+	}
+
+	/**
+	 * Removes the oldest element.
+	 * @pre not empty
+	 */
+	void pop_front() {
+		assert(count > 0);
+		head = slotIndex(1);
+		count--;
+	}
+
+	/** @return the oldest element. @pre not empty */
+	const T &front() const {
+		assert(count > 0);
+		return slots[head];
+	}
+
+	/** @return the newest element. @pre not empty */
+	const T &back() const {
+		assert(count > 0);
+		return slots[slotIndex(count - 1)];
+	}
+
+	/**
+	 * @param i position counting from the oldest element
+	 * @return element at that position
+	 */
+	const T &operator[](long i) const {
+		assert(i >= 0 && i < count);
+		return slots[slotIndex(i)];
+	}
+};
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,446 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Custom headers.
+#include "scheduler.h"
+
+// ---------------------------- event_scheduler class -------------------------
+
+event_scheduler::~event_scheduler() { }
+
+event_scheduler *event_scheduler::makeScheduler(scheduler_type type) {
+	switch (type) {
+	case MULTIMAP_SCHEDULER:
+		return new multimap_scheduler();
+	case CALENDAR_SCHEDULER:
+		return new calendar_scheduler();
+	case HEAP_SCHEDULER:
+		return new heap_scheduler();
+	default:
+		assert(false);
+	}
+	return NULL;
+}
+
+bool event_scheduler::parseSchedulerType(const string &name,
+		scheduler_type &type) {
+	if (name == "multimap") {
+		type = MULTIMAP_SCHEDULER;
+		return true;
+	}
+	if (name == "calendar") {
+		type = CALENDAR_SCHEDULER;
+		return true;
+	}
+	if (name == "heap") {
+		type = HEAP_SCHEDULER;
+		return true;
+	}
+	return false;
+}
+
+void event_scheduler::reschedule(event *e, double time) {
+	remove(e);
+	e->setTime(time);
+	push(e);
+}
+
+bool event_scheduler::runsBefore(const event *a, const event *b) {
+	if (a->getTime() != b->getTime()) {
+		return a->getTime() < b->getTime();
+	}
+	return a->getId() < b->getId();
+}
+
+// --------------------------- multimap_scheduler class -----------------------
+
+void multimap_scheduler::push(event *e) {
+	assert(!e->isQueued());
+	e->setQueueSlot(0);
+	events.insert(pair<pair<double, long>, event *> (
+			pair<double, long> (e->getTime(), e->getId()), e));
+}
+
+event *multimap_scheduler::pop() {
+	if (events.empty()) {
+		return NULL;
+	}
+	multimap<pair<double, long>, event *>::iterator it = events.begin();
+	event *e = it->second;
+	events.erase(it);
+	e->setQueueSlot(event::NOT_SCHEDULED);
+	return e;
+}
+
+event *multimap_scheduler::peek() {
+	return events.empty() ? NULL : events.begin()->second;
+}
+
+bool multimap_scheduler::remove(event *e) {
+	if (!e->isQueued()) {
+		return false;
+	}
+
+	// Keys are unique since IDs are.
+	multimap<pair<double, long>, event *>::iterator it =
+			events.find(pair<double, long> (e->getTime(), e->getId()));
+	assert(it != events.end() && it->second == e);
+	events.erase(it);
+	e->setQueueSlot(event::NOT_SCHEDULED);
+	return true;
+}
+
+bool multimap_scheduler::empty() const { return events.empty(); }
+
+long multimap_scheduler::size() const { return events.size(); }
+
+// --------------------------- calendar_scheduler class -----------------------
+
+const unsigned long calendar_scheduler::MIN_BUCKETS;
+
+const unsigned long calendar_scheduler::WIDTH_SAMPLE_SIZE;
+
+constexpr double calendar_scheduler::MIN_SEPARATION;
+
+/**
+ * Orders events so that later ones come first; buckets are sorted this way
+ * so the earliest event sits at the back.
+ * @param a
+ * @param b
+ * @return true if @c a runs after @c b
+ */
+static bool runsAfter(const event *a, const event *b) {
+	return event_scheduler::runsBefore(b, a);
+}
+
+calendar_scheduler::calendar_scheduler() :
+		buckets(MIN_BUCKETS), bucket_width(1.0), num_events(0),
+		current_day(0), current_bucket(0), last_time(0) { }
+
+long calendar_scheduler::dayOf(double time) const {
+	return (long) floor(time / bucket_width);
+}
+
+void calendar_scheduler::insert(event *e) {
+	unsigned long index =
+			(unsigned long) dayOf(e->getTime()) & (buckets.size() - 1);
+	vector<event *> &bucket = buckets[index];
+	vector<event *>::iterator pos =
+			lower_bound(bucket.begin(), bucket.end(), e, runsAfter);
+	bucket.insert(pos, e);
+	e->setQueueSlot(index);
+}
+
+void calendar_scheduler::push(event *e) {
+	assert(!e->isQueued());
+	insert(e);
+	num_events++;
+
+	// Events are normally never scheduled in the past, but if one is then
+	// rewind so the next pop finds it.
+	long day = dayOf(e->getTime());
+	if (day < current_day) {
+		current_day = day;
+		current_bucket = (unsigned long) day & (buckets.size() - 1);
+	}
+
+	if ((unsigned long) num_events > 2 * buckets.size()) {
+		resize(2 * buckets.size());
+	}
+}
+
+unsigned long calendar_scheduler::findEarliest() {
+
+	// Scan at most one year forward from the current day for an event that
+	// falls on the day being looked at.
+	unsigned long num_buckets = buckets.size();
+	for (unsigned long i = 0; i < num_buckets; i++) {
+		vector<event *> &bucket = buckets[current_bucket];
+		if (!bucket.empty() && dayOf(bucket.back()->getTime()) <= current_day) {
+			return current_bucket;
+		}
+		current_day++;
+		current_bucket = (current_bucket + 1) & (num_buckets - 1);
+	}
+
+	// The events are sparse relative to the year length, so jump straight to
+	// the earliest one.
+	event *earliest = NULL;
+	for (unsigned long i = 0; i < num_buckets; i++) {
+		if (!buckets[i].empty() && (earliest == NULL ||
+				runsBefore(buckets[i].back(), earliest))) {
+			earliest = buckets[i].back();
+			current_bucket = i;
+		}
+	}
+	current_day = dayOf(earliest->getTime());
+	return current_bucket;
+}
+
+event *calendar_scheduler::pop() {
+
+	if (num_events == 0) {
+		return NULL;
+	}
+
+	unsigned long index = findEarliest();
+	event *e = buckets[index].back();
+	buckets[index].pop_back();
+	num_events--;
+	last_time = e->getTime();
+	e->setQueueSlot(event::NOT_SCHEDULED);
+
+	unsigned long num_buckets = buckets.size();
+	if ((unsigned long) num_events < num_buckets / 2 &&
+			num_buckets > MIN_BUCKETS) {
+		resize(num_buckets / 2);
+	}
+	return e;
+}
+
+event *calendar_scheduler::peek() {
+	if (num_events == 0) {
+		return NULL;
+	}
+	return buckets[findEarliest()].back();
+}
+
+bool calendar_scheduler::remove(event *e) {
+	if (!e->isQueued()) {
+		return false;
+	}
+	vector<event *> &bucket = buckets[e->getQueueSlot()];
+	vector<event *>::iterator it =
+			lower_bound(bucket.begin(), bucket.end(), e, runsAfter);
+	assert(it != bucket.end() && *it == e);
+	bucket.erase(it);
+	num_events--;
+	e->setQueueSlot(event::NOT_SCHEDULED);
+	return true;
+}
+
+bool calendar_scheduler::empty() const { return num_events == 0; }
+
+long calendar_scheduler::size() const { return num_events; }
+
+unsigned long calendar_scheduler::getNumBuckets() const {
+	return buckets.size();
+}
+
+double calendar_scheduler::getBucketWidth() const { return bucket_width; }
+
+double calendar_scheduler::estimateWidth(
+		const vector<event *> &all_events) const {
+
+	if (all_events.size() < 2) {
+		return bucket_width;
+	}
+
+	// Get the times of the earliest few events in order.
+	vector<double> times;
+	times.reserve(all_events.size());
+	for (unsigned long i = 0; i < all_events.size(); i++) {
+		times.push_back(all_events[i]->getTime());
+	}
+	unsigned long num_samples = all_events.size() < WIDTH_SAMPLE_SIZE ?
+			all_events.size() : WIDTH_SAMPLE_SIZE;
+	nth_element(times.begin(), times.begin() + (num_samples - 1), times.end());
+	sort(times.begin(), times.begin() + num_samples);
+
+	// Average separation, then average again without the outliers as
+	// recommended by Brown. Simultaneous events (including the bursts that
+	// are spaced by netflow::TIME_EPSILON) don't tell us anything about
+	// spacing so they're skipped.
+	double total = 0;
+	int count = 0;
+	for (unsigned long i = 1; i < num_samples; i++) {
+		double sep = times[i] - times[i - 1];
+		if (sep > MIN_SEPARATION) {
+			total += sep;
+			count++;
+		}
+	}
+	if (count == 0) {
+		return bucket_width;
+	}
+	double avg = total / count;
+
+	total = 0;
+	count = 0;
+	for (unsigned long i = 1; i < num_samples; i++) {
+		double sep = times[i] - times[i - 1];
+		if (sep > MIN_SEPARATION && sep <= 2 * avg) {
+			total += sep;
+			count++;
+		}
+	}
+	if (count == 0) {
+		return bucket_width;
+	}
+	return 3 * total / count;
+}
+
+void calendar_scheduler::resize(unsigned long new_num_buckets) {
+
+	// Take every event out of the calendar. Walking each bucket back to front
+	// means the events are reinserted mostly in running order, which is the
+	// cheap case for insert.
+	vector<event *> all_events;
+	all_events.reserve(num_events);
+	double earliest = last_time;
+	for (unsigned long i = 0; i < buckets.size(); i++) {
+		for (unsigned long j = buckets[i].size(); j > 0; j--) {
+			event *e = buckets[i][j - 1];
+			if (e->getTime() < earliest) {
+				earliest = e->getTime();
+			}
+			all_events.push_back(e);
+		}
+	}
+
+	bucket_width = estimateWidth(all_events);
+	buckets.assign(new_num_buckets, vector<event *>());
+	current_day = dayOf(earliest);
+	current_bucket = (unsigned long) current_day & (new_num_buckets - 1);
+
+	for (unsigned long i = 0; i < all_events.size(); i++) {
+		insert(all_events[i]);
+	}
+}
+
+// ----------------------------- heap_scheduler class -------------------------
+
+const unsigned long heap_scheduler::ARITY;
+
+bool heap_scheduler::entryBefore(const heap_entry &a, const heap_entry &b) {
+	if (a.time != b.time) {
+		return a.time < b.time;
+	}
+	return a.id < b.id;
+}
+
+void heap_scheduler::place(unsigned long index, const heap_entry &entry) {
+	heap[index] = entry;
+	entry.e->setQueueSlot(index);
+}
+
+void heap_scheduler::siftUp(unsigned long index) {
+	heap_entry moving = heap[index];
+	while (index > 0) {
+		unsigned long parent = (index - 1) / ARITY;
+		if (!entryBefore(moving, heap[parent])) {
+			break;
+		}
+		place(index, heap[parent]);
+		index = parent;
+	}
+	place(index, moving);
+}
+
+void heap_scheduler::siftDown(unsigned long index) {
+	heap_entry moving = heap[index];
+	unsigned long n = heap.size();
+	while (true) {
+
+		// Find the child that runs first.
+		unsigned long first_child = ARITY * index + 1;
+		if (first_child >= n) {
+			break;
+		}
+		unsigned long last_child = first_child + ARITY < n ?
+				first_child + ARITY : n;
+		unsigned long best = first_child;
+		for (unsigned long c = first_child + 1; c < last_child; c++) {
+			if (entryBefore(heap[c], heap[best])) {
+				best = c;
+			}
+		}
+
+		if (!entryBefore(heap[best], moving)) {
+			break;
+		}
+		place(index, heap[best]);
+		index = best;
+	}
+	place(index, moving);
+}
+
+void heap_scheduler::restore(unsigned long index) {
+	if (index > 0 && entryBefore(heap[index], heap[(index - 1) / ARITY])) {
+		siftUp(index);
+	}
+	else {
+		siftDown(index);
+	}
+}
+
+void heap_scheduler::removeAt(unsigned long index) {
+	heap[index].e->setQueueSlot(event::NOT_SCHEDULED);
+	heap_entry last = heap.back();
+	heap.pop_back();
+	if (index == heap.size()) {
+		return;
+	}
+
+	// Fill the hole with the last entry and move it to wherever it belongs.
+	heap[index] = last;
+	restore(index);
+}
+
+void heap_scheduler::push(event *e) {
+	assert(!e->isQueued());
+	heap_entry entry;
+	entry.time = e->getTime();
+	entry.id = e->getId();
+	entry.e = e;
+	heap.push_back(entry);
+	siftUp(heap.size() - 1);
+}
+
+event *heap_scheduler::pop() {
+	if (heap.empty()) {
+		return NULL;
+	}
+	event *e = heap[0].e;
+	removeAt(0);
+	return e;
+}
+
+event *heap_scheduler::peek() {
+	return heap.empty() ? NULL : heap[0].e;
+}
+
+bool heap_scheduler::remove(event *e) {
+	if (!e->isQueued()) {
+		return false;
+	}
+	unsigned long index = e->getQueueSlot();
+	assert(index < heap.size() && heap[index].e == e);
+	removeAt(index);
+	return true;
+}
+
+void heap_scheduler::reschedule(event *e, double time) {
+	if (!e->isQueued()) {
+		e->setTime(time);
+		push(e);
+		return;
+	}
+
+	// Change the time in place then let the entry float up or sink down.
+	unsigned long index = e->getQueueSlot();
+	assert(index < heap.size() && heap[index].e == e);
+	e->setTime(time);
+	heap[index].time = time;
+	restore(index);
+}
+
+bool heap_scheduler::empty() const { return heap.empty(); }
+
+long heap_scheduler::size() const { return heap.size(); }
@@ -0,0 +1,364 @@
+/**
+ * @file
+ *
+ * Contains the declarations of the event schedulers, i.e. the priority queues
+ * that hold a simulation's pending events in order of their times. The
+ * simulation talks to its scheduler only through the @c event_scheduler
+ * interface so the implementation can be picked at runtime.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Standard includes.
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Custom headers.
+#include "events.h"
+
+// Forward declarations.
+class event;
+
+using namespace std;
+
+/** Kinds of event schedulers a simulation can be configured to use. */
+enum scheduler_type {
+	MULTIMAP_SCHEDULER,
+	CALENDAR_SCHEDULER,
+	HEAP_SCHEDULER
+};
+
+// ---------------------------- event_scheduler class -------------------------
+
+/**
+ * Interface for the simulation's event queue. Schedulers do not own the
+ * events they hold; whoever pops or removes an event is responsible for it.
+ * An event can be in at most one scheduler at a time since schedulers keep
+ * their bookkeeping in the event's queue slot.
+ *
+ * Every implementation pops events in increasing order of time and breaks
+ * ties between simultaneous events by increasing @c event::getId(). Since
+ * IDs are handed out in creation order this makes the order in which
+ * simultaneous events run a property of the simulation itself rather than of
+ * the container, so runs are reproducible across schedulers, builds, and
+ * standard libraries.
+ */
+class event_scheduler {
+
+public:
+
+	/** Destructor. Does not delete queued events. */
+	virtual ~event_scheduler();
+
+	/**
+	 * Adds an event to the queue.
+	 * @param e event to add
+	 */
+	virtual void push(event *e) = 0;
+
+	/**
+	 * Removes and returns the event with the smallest time.
+	 * @return earliest event, or NULL if the queue is empty
+	 */
+	virtual event *pop() = 0;
+
+	/**
+	 * Returns the event with the smallest time without removing it.
+	 * @return earliest event, or NULL if the queue is empty
+	 */
+	virtual event *peek() = 0;
+
+	/**
+	 * Removes the given event from the queue if it's in there. Uses the
+	 * event's queue slot so nothing has to be searched for.
+	 * @param e event to remove
+	 * @return true if the event was found and removed
+	 */
+	virtual bool remove(event *e) = 0;
+
+	/**
+	 * Moves an event to a new time, queueing it if it isn't queued already.
+	 * The default just removes and pushes the event again; schedulers that
+	 * can move an event in place override this.
+	 * @param e event to move
+	 * @param time new time for the event
+	 */
+	virtual void reschedule(event *e, double time);
+
+	/**
+	 * Checks if there are any pending events.
+	 * @return true if the queue is empty
+	 */
+	virtual bool empty() const = 0;
+
+	/**
+	 * Getter for the number of pending events.
+	 * @return number of events in the queue
+	 */
+	virtual long size() const = 0;
+
+	/**
+	 * Makes a new scheduler of the given type. The caller owns it.
+	 * @param type kind of scheduler to make
+	 * @return the new scheduler
+	 */
+	static event_scheduler *makeScheduler(scheduler_type type);
+
+	/**
+	 * The order every scheduler pops events in.
+	 * @param a
+	 * @param b
+	 * @return true if @c a should run before @c b
+	 */
+	static bool runsBefore(const event *a, const event *b);
+
+	/**
+	 * Parses the name of a scheduler type, e.g. "calendar" or "heap".
+	 * @param name of the scheduler type
+	 * @param type out parameter, set if the name is recognized
+	 * @return true if the name was recognized
+	 */
+	static bool parseSchedulerType(const string &name, scheduler_type &type);
+};
+
+// --------------------------- multimap_scheduler class -----------------------
+
+/**
+ * Reference scheduler implemented with a multimap sorted on event times and
+ * IDs. Every operation is O(log n) and allocates a tree node per event. It's
+ * kept around so that faster schedulers can be checked against it. The queue
+ * slot is only used as a flag here.
+ */
+class multimap_scheduler : public event_scheduler {
+
+private:
+
+	/** Pending events keyed by (time in milliseconds, event ID). */
+	multimap<pair<double, long>, event *> events;
+
+public:
+
+	void push(event *e);
+
+	event *pop();
+
+	event *peek();
+
+	bool remove(event *e);
+
+	bool empty() const;
+
+	long size() const;
+};
+
+// --------------------------- calendar_scheduler class -----------------------
+
+/**
+ * Calendar queue (R. Brown, 1988). Time is cut into "days" of width
+ * @c bucket_width and day d is stored in bucket d mod (number of buckets), so
+ * a bucket holds the events of one day out of every "year". Dequeueing scans
+ * forward from the current day. The number of buckets doubles or halves as
+ * the queue grows or shrinks and the day width is re-estimated from the
+ * spacing of the earliest events, which keeps buckets short and makes push,
+ * pop, and remove amortized O(1). An event's queue slot is its bucket index.
+ */
+class calendar_scheduler : public event_scheduler {
+
+private:
+
+	/**
+	 * The buckets. Each is sorted in reverse running order so that the
+	 * earliest event is at the back and can be popped without shifting
+	 * anything.
+	 */
+	vector<vector<event *> > buckets;
+
+	/** Width in milliseconds of one day, i.e. of one bucket. */
+	double bucket_width;
+
+	/** Number of events in all buckets. */
+	long num_events;
+
+	/** Day currently being dequeued from. */
+	long current_day;
+
+	/** Bucket index of the current day. */
+	unsigned long current_bucket;
+
+	/** Time of the last popped event; used to re-anchor after resizes. */
+	double last_time;
+
+	/** Never shrink below this many buckets. */
+	static const unsigned long MIN_BUCKETS = 2;
+
+	/** Max number of events sampled to estimate a new day width. */
+	static const unsigned long WIDTH_SAMPLE_SIZE = 25;
+
+	/**
+	 * Events closer together than this (in milliseconds) are treated as
+	 * simultaneous when estimating the day width.
+	 */
+	static constexpr double MIN_SEPARATION = 0.000001;
+
+	/**
+	 * Computes the day on which an event at the given time falls.
+	 * @param time in milliseconds
+	 * @return day number
+	 */
+	long dayOf(double time) const;
+
+	/**
+	 * Moves the current day forward to the earliest event's day. The queue
+	 * must not be empty.
+	 * @return index of the bucket holding the earliest event at its back
+	 */
+	unsigned long findEarliest();
+
+	/**
+	 * Inserts an event into its bucket without touching the counters or
+	 * triggering a resize.
+	 * @param e event to insert
+	 */
+	void insert(event *e);
+
+	/**
+	 * Rebuilds the calendar with the given number of buckets and a new day
+	 * width estimated from the events currently queued.
+	 * @param new_num_buckets must be a power of two
+	 */
+	void resize(unsigned long new_num_buckets);
+
+	/**
+	 * Estimates a good day width from the spacing between the earliest
+	 * queued events.
+	 * @param all_events every queued event
+	 * @return new day width, or the current one if no estimate could be made
+	 */
+	double estimateWidth(const vector<event *> &all_events) const;
+
+public:
+
+	/** Starts with the minimum number of buckets, each a millisecond wide. */
+	calendar_scheduler();
+
+	void push(event *e);
+
+	event *pop();
+
+	event *peek();
+
+	bool remove(event *e);
+
+	bool empty() const;
+
+	long size() const;
+
+	/**
+	 * Getter for the current number of buckets. Exposed for tests.
+	 * @return number of buckets
+	 */
+	unsigned long getNumBuckets() const;
+
+	/**
+	 * Getter for the current day width. Exposed for tests.
+	 * @return day width in milliseconds
+	 */
+	double getBucketWidth() const;
+};
+
+// ----------------------------- heap_scheduler class -------------------------
+
+/**
+ * Implicit 4-ary min-heap stored in one flat vector. Each entry keeps a copy
+ * of its event's time and ID next to the pointer, so comparisons while
+ * sifting never have to follow the pointer, and a node's four children sit
+ * next to each other in memory. Compared with a binary heap the tree is half
+ * as deep, which roughly halves the cache misses of a pop. Push and pop are
+ * O(log n) and allocate nothing once the vector has grown. An event's queue
+ * slot is its index in the heap, so remove and reschedule are O(log n) too.
+ */
+class heap_scheduler : public event_scheduler {
+
+private:
+
+	/** One slot in the heap. */
+	struct heap_entry {
+
+		/** Copy of the event's time. */
+		double time;
+
+		/** Copy of the event's ID; breaks ties between equal times. */
+		long id;
+
+		/** The event itself. */
+		event *e;
+	};
+
+	/** Number of children per node. */
+	static const unsigned long ARITY = 4;
+
+	/** The heap, rooted at index 0. */
+	vector<heap_entry> heap;
+
+	/**
+	 * Compares two entries in the same order as @c runsBefore.
+	 * @param a
+	 * @param b
+	 * @return true if @c a should run before @c b
+	 */
+	static bool entryBefore(const heap_entry &a, const heap_entry &b);
+
+	/**
+	 * Moves the entry at the given index up until its parent runs before it.
+	 * @param index
+	 */
+	void siftUp(unsigned long index);
+
+	/**
+	 * Moves the entry at the given index down until it runs before all of its
+	 * children.
+	 * @param index
+	 */
+	void siftDown(unsigned long index);
+
+	/**
+	 * Puts an entry at the given index and tells its event where it is.
+	 * @param index
+	 * @param entry
+	 */
+	void place(unsigned long index, const heap_entry &entry);
+
+	/**
+	 * Moves the entry at the given index up or down, whichever restores the
+	 * heap property.
+	 * @param index
+	 */
+	void restore(unsigned long index);
+
+	/**
+	 * Takes the entry at the given index out of the heap.
+	 * @param index
+	 */
+	void removeAt(unsigned long index);
+
+public:
+
+	void push(event *e);
+
+	event *pop();
+
+	event *peek();
+
+	bool remove(event *e);
+
+	void reschedule(event *e, double time);
+
+	bool empty() const;
+
+	long size() const;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,88 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+
+// Custom headers.
+#include "seq_bitmap.h"
+
+const int seq_bitmap::WORD_BITS;
+
+seq_bitmap::seq_bitmap(int first) : words(1, 0), head(0), next(first) {
+	base = first - ((first % WORD_BITS) + WORD_BITS) % WORD_BITS;
+}
+
+uint64_t &seq_bitmap::wordOf(int seq) {
+	size_t word = (seq - base) / WORD_BITS;
+	return words[(head + word) & (words.size() - 1)];
+}
+
+void seq_bitmap::growTo(int seq) {
+	size_t needed = (seq - base) / WORD_BITS + 1;
+	if (needed <= words.size()) {
+		return;
+	}
+	size_t size = words.size();
+	while (size < needed) {
+		size *= 2;
+	}
+
+	// Unroll the ring so the head word comes first again.
+	vector<uint64_t> grown(size, 0);
+	for (size_t i = 0; i < words.size(); i++) {
+		grown[i] = words[(head + i) & (words.size() - 1)];
+	}
+	words.swap(grown);
+	head = 0;
+}
+
+void seq_bitmap::advance() {
+	while (true) {
+		uint64_t missing = ~words[head] >> (next - base);
+		if (missing != 0) {
+			next += __builtin_ctzll(missing);
+			return;
+		}
+
+		// Everything left in the head word has arrived; recycle it.
+		words[head] = 0;
+		head = (head + 1) & (words.size() - 1);
+		base += WORD_BITS;
+		next = base;
+	}
+}
+
+bool seq_bitmap::set(int seq) {
+	if (seq < next) {
+		return false;
+	}
+	growTo(seq);
+	uint64_t bit = (uint64_t) 1 << ((seq - base) % WORD_BITS);
+	uint64_t &word = wordOf(seq);
+	if (word & bit) {
+		return false;
+	}
+	word |= bit;
+	if (seq == next) {
+		advance();
+	}
+	return true;
+}
+
+bool seq_bitmap::test(int seq) const {
+	if (seq < next) {
+		return true;
+	}
+	size_t word = (seq - base) / WORD_BITS;
+	if (word >= words.size()) {
+		return false;
+	}
+	uint64_t bits = words[(head + word) & (words.size() - 1)];
+	return (bits >> ((seq - base) % WORD_BITS)) & 1;
+}
+
+int seq_bitmap::getNextMissing() const { return next; }
+
+size_t seq_bitmap::capacity() const { return words.size() * WORD_BITS; }
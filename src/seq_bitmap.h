@@ -0,0 +1,91 @@
+/**
+ * @file
+ *
+ * Contains the bitmap a flow's destination uses to track which packets
+ * have arrived.
+ */
+
+#ifndef SEQ_BITMAP_H
+#define SEQ_BITMAP_H
+
+// Standard includes.
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// ------------------------------- seq_bitmap class ---------------------------
+
+/**
+ * Set of sequence numbers that have arrived, kept as everything below the
+ * first one missing plus a sliding bitmap of what's arrived beyond it. The
+ * bitmap is a circular array of 64-bit words that starts at the word
+ * holding the first missing sequence number, so its size follows how far
+ * ahead of that packets arrive--the outstanding window--not the flow's
+ * length. When the first missing packet arrives, the next one missing is
+ * found a word at a time by counting trailing ones, and the words left
+ * behind are reused.
+ */
+class seq_bitmap {
+
+private:
+
+	/** Number of sequence numbers per word. */
+	static const int WORD_BITS = 64;
+
+	/** Bitmap words. Their number is a power of two. */
+	vector<uint64_t> words;
+
+	/** Index in @c words of the word holding @c base. */
+	size_t head;
+
+	/** Sequence number of the head word's lowest bit; @c next rounded down. */
+	int base;
+
+	/** Lowest sequence number that hasn't arrived. */
+	int next;
+
+	/**
+	 * @param seq no lower than @c base and inside the bitmap
+	 * @return the word holding that sequence number's bit
+	 */
+	uint64_t &wordOf(int seq);
+
+	/**
+	 * Makes the bitmap big enough to hold the given sequence number.
+	 * @param seq
+	 */
+	void growTo(int seq);
+
+	/** Moves @c next up to the first sequence number that hasn't arrived. */
+	void advance();
+
+public:
+
+	/**
+	 * Makes an empty set.
+	 * @param first lowest sequence number there is
+	 */
+	seq_bitmap(int first = 0);
+
+	/**
+	 * Marks a sequence number as arrived.
+	 * @param seq no lower than the first
+	 * @return false if it had already arrived
+	 */
+	bool set(int seq);
+
+	/**
+	 * @param seq
+	 * @return true if it has arrived
+	 */
+	bool test(int seq) const;
+
+	/** @return lowest sequence number that hasn't arrived */
+	int getNextMissing() const;
+
+	/** @return number of sequence numbers the bitmap can hold now */
+	size_t capacity() const;
+};
+
+#endif // SEQ_BITMAP_H
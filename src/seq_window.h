@@ -0,0 +1,134 @@
+/**
+ * @file
+ *
+ * Contains the table that keeps a value per sequence number for the
+ * packets a flow has in flight.
+ */
+
+#ifndef SEQ_WINDOW_H
+#define SEQ_WINDOW_H
+
+// Standard includes.
+#include <cassert>
+#include <vector>
+
+using namespace std;
+
+// ------------------------------- seq_window class ---------------------------
+
+/**
+ * Values keyed by a sliding range of sequence numbers, stored in a circular
+ * array indexed by sequence number modulo its size. Only the range from the
+ * oldest sequence number still of interest up to the highest one recorded
+ * is kept, so the array is as big as the most packets ever in flight at
+ * once, rounded up to a power of two, however long the flow. Recording,
+ * looking up and forgetting are O(1); recording only allocates when the
+ * range outgrows the array.
+ *
+ * @tparam T value type; must be default-constructible and copyable
+ */
+template <typename T>
+class seq_window {
+
+private:
+
+	/** Value storage. Its size is a power of two. */
+	vector<T> slots;
+
+	/** Lowest sequence number kept. */
+	int lowest;
+
+	/** Highest sequence number recorded, or @c lowest - 1 if none. */
+	int highest;
+
+	/**
+	 * @param seq
+	 * @return index of that sequence number's slot
+	 */
+	size_t slotIndex(int seq) const { return seq & (slots.size() - 1); }
+
+	/**
+	 * Makes the array big enough to hold the range up to the given
+	 * sequence number, moving the values kept to their new slots.
+	 * @param seq
+	 */
+	void growTo(int seq) {
+		size_t needed = seq - lowest + 1;
+		if (needed <= slots.size()) {
+			return;
+		}
+		size_t size = slots.size();
+		while (size < needed) {
+			size *= 2;
+		}
+		vector<T> old;
+		old.swap(slots);
+		slots.assign(size, T());
+		for (int i = lowest; i <= highest; i++) {
+			slots[slotIndex(i)] = old[i & (old.size() - 1)];
+		}
+	}
+
+public:
+
+	/**
+	 * Makes an empty window.
+	 * @param first lowest sequence number that will be recorded
+	 * @param capacity initial size; a power of two
+	 */
+	seq_window(int first = 0, size_t capacity = 8) :
+			slots(capacity), lowest(first), highest(first - 1) {
+		assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+	}
+
+	/** @return number of values the array can hold before growing */
+	size_t capacity() const { return slots.size(); }
+
+	/**
+	 * @param seq
+	 * @return true if a value for that sequence number is kept
+	 */
+	bool contains(int seq) const { return seq >= lowest && seq <= highest; }
+
+	/**
+	 * Records the value for a sequence number, replacing any already kept.
+	 * @param seq no lower than the lowest kept
+	 * @param value
+	 */
+	void record(int seq, const T &value) {
+		assert(seq >= lowest);
+		growTo(seq);
+		slots[slotIndex(seq)] = value;
+		if (seq > highest) {
+			// Anything skipped over wasn't recorded; don't leave stale values.
+			for (int i = highest + 1; i < seq; i++) {
+				slots[slotIndex(i)] = T();
+			}
+			highest = seq;
+		}
+	}
+
+	/**
+	 * Stops keeping the values of sequence numbers below the given one.
+	 * @param seq
+	 */
+	void forgetBefore(int seq) {
+		if (seq > lowest) {
+			lowest = seq;
+			if (highest < lowest - 1) {
+				highest = lowest - 1;
+			}
+		}
+	}
+
+	/**
+	 * @param seq @pre kept; see @c contains
+	 * @return the value for that sequence number
+	 */
+	const T &at(int seq) const {
+		assert(contains(seq));
+		return slots[slotIndex(seq)];
+	}
+};
+
+#endif // SEQ_WINDOW_H
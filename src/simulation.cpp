@@ -3,10 +3,18 @@
  */
 
 #include "simulation.h"
+#include "queue_discipline.h"
+#include "congestion_control.h"
 
-simulation::simulation () : outfile(NULL) {}
+simulation::simulation (scheduler_type sched_type) :
+		num_flows_remaining(0),
+		events(event_scheduler::makeScheduler(sched_type)), timers(*events),
+		outfile(NULL) {}
 
-simulation::simulation (const char *inputfile) {
+simulation::simulation (const char *inputfile, scheduler_type sched_type) :
+		num_flows_remaining(0),
+		events(event_scheduler::makeScheduler(sched_type)), timers(*events),
+		outfile(NULL) {
 
 	// Read JSON file into a single string.
 	string jsonstr;
@@ -27,9 +35,82 @@ simulation::simulation (const char *inputfile) {
 }
 
 simulation::~simulation () {
+	while (!events->empty()) {
+		delete events->pop();
+	}
+	while (timers.size() > 0) {
+		delete timers.removeAny();
+	}
+	delete events;
 	free_network_devices();
 }
 
+/**
+ * Reads a link's optional "queue" setting, which is either the name of a
+ * queue discipline or an object with a "type" and any of its parameters.
+ * @param thislink the link's JSON object
+ * @return the settings, drop-tail if there are none
+ */
+static queue_config parse_queue_config(const Value &thislink) {
+	queue_config config;
+	if (!thislink.HasMember("queue")) {
+		return config;
+	}
+	const Value &queue = thislink["queue"];
+	if (queue.IsString()) {
+		bool known = queue_discipline::parseQueueType(queue.GetString(),
+				config.type);
+		assert(known);
+		(void) known;
+		return config;
+	}
+	assert(queue.IsObject());
+	bool known = queue_discipline::parseQueueType(queue["type"].GetString(),
+			config.type);
+	assert(known);
+	(void) known;
+	if (queue.HasMember("min_th")) {
+		config.red_min_th_kb = queue["min_th"].GetDouble();
+	}
+	if (queue.HasMember("max_th")) {
+		config.red_max_th_kb = queue["max_th"].GetDouble();
+	}
+	if (queue.HasMember("max_p")) {
+		config.red_max_p = queue["max_p"].GetDouble();
+	}
+	if (queue.HasMember("weight")) {
+		config.red_weight = queue["weight"].GetDouble();
+	}
+	if (queue.HasMember("target")) {
+		config.codel_target_ms = queue["target"].GetDouble();
+	}
+	if (queue.HasMember("interval")) {
+		config.codel_interval_ms = queue["interval"].GetDouble();
+	}
+	if (queue.HasMember("flows")) {
+		config.fq_flows = queue["flows"].GetInt();
+	}
+	if (queue.HasMember("quantum")) {
+		config.fq_quantum_bytes = queue["quantum"].GetInt64();
+	}
+	if (queue.HasMember("classify")) {
+		string classify = queue["classify"].GetString();
+		assert(classify == "type" || classify == "flow");
+		config.classify = classify == "type" ? CLASS_BY_TYPE : CLASS_BY_FLOW;
+	}
+	if (queue.HasMember("classes")) {
+		config.num_classes = queue["classes"].GetInt();
+	}
+	if (queue.HasMember("quanta")) {
+		const Value &quanta = queue["quanta"];
+		assert(quanta.IsArray());
+		for (SizeType i = 0; i < quanta.Size(); i++) {
+			config.quanta.push_back(quanta[i].GetInt64());
+		}
+	}
+	return config;
+}
+
 void simulation::parse_JSON_input (string jsonstring) {
 
 	// Parse JSON text into a document.
@@ -45,7 +126,7 @@ void simulation::parse_JSON_input (string jsonstring) {
 	for (SizeType i = 0; i < texthosts.Size(); i++) {
 		string hostname(texthosts[i].GetString());
 		nethost *curr_host = new nethost(hostname);
-		hosts[hostname] = curr_host;
+		hosts.add(curr_host);
 	}
 
 	// Load the routers into memory
@@ -54,9 +135,16 @@ void simulation::parse_JSON_input (string jsonstring) {
 	for (SizeType i = 0; i < textrouters.Size(); i++) {
 		string routername(textrouters[i].GetString());
 		netrouter *curr_router = new netrouter(routername);
-		routers[routername] = curr_router;
+		routers.add(curr_router);
 	}
 
+	// Number the nodes densely, hosts then routers, each in name order.
+	// Routers index their tables and packets name their endpoints by these.
+	hosts.assignIds(0);
+	routers.assignIds(hosts.size());
+	nodes.assign(hosts.begin(), hosts.end());
+	nodes.insert(nodes.end(), routers.begin(), routers.end());
+
 	// Load the links into memory
     const Value& textlinks = document["links"];
 	assert(textlinks.IsArray());
@@ -65,6 +153,10 @@ void simulation::parse_JSON_input (string jsonstring) {
 		const Value& thislink = textlinks[i];
 		string linkname = thislink["id"].GetString();
 
+		// Links are half-duplex unless the input says otherwise.
+		bool full_duplex = thislink.HasMember("full_duplex") &&
+				thislink["full_duplex"].GetBool();
+
 		string endpt1name = thislink["endpt_1"].GetString();
 		string endpt2name = thislink["endpt_2"].GetString();
 
@@ -74,13 +166,13 @@ void simulation::parse_JSON_input (string jsonstring) {
 		bool endpt2IsHost = false;
 
 		// if this endpoint is a host
-		if (hosts.find(endpt1name) != hosts.end()) {
-			endpoint1 = hosts[endpt1name];
+		if (hosts.find(endpt1name) != NULL) {
+			endpoint1 = hosts.find(endpt1name);
 			endpt1IsHost = true;
 		}
 		// if this endpoint is a router
-		else if (routers.find(endpt1name) != routers.end()) {
-			endpoint1 = routers[endpt1name];
+		else if (routers.find(endpt1name) != NULL) {
+			endpoint1 = routers.find(endpt1name);
 		}
 		// if this endpoint is neither a router nor a host...
 		else {
@@ -89,13 +181,13 @@ void simulation::parse_JSON_input (string jsonstring) {
 		}
 
 		// if this endpoint is a host
-		if (hosts.find(endpt2name) != hosts.end()) {
-			endpoint2 = hosts[endpt2name];
+		if (hosts.find(endpt2name) != NULL) {
+			endpoint2 = hosts.find(endpt2name);
 			endpt2IsHost = true;
 		}
 		// if this endpoint is a router
-		else if (routers.find(endpt2name) != routers.end()) {
-			endpoint2 = routers[endpt2name];
+		else if (routers.find(endpt2name) != NULL) {
+			endpoint2 = routers.find(endpt2name);
 		}
 		// if this endpoint is neither a router nor a host...
 		else {
@@ -108,7 +200,14 @@ void simulation::parse_JSON_input (string jsonstring) {
 						(float) thislink["rate"].GetDouble(),
 						(float) thislink["delay"].GetDouble(),
 						(long) thislink["buf_len"].GetInt64(),
-						*endpoint1, *endpoint2);
+						*endpoint1, *endpoint2, full_duplex);
+
+		// Seed any random drops by the link's place in the input so runs
+		// are repeatable.
+		curr_link->setQueueDiscipline(parse_queue_config(thislink), i + 1);
+		if (thislink.HasMember("ecn_threshold")) {
+			curr_link->setEcnThreshold(thislink["ecn_threshold"].GetDouble());
+		}
 
 		// If this link is connected to a host, put reference to it in host.
 		if (endpt1IsHost) {
@@ -133,8 +232,9 @@ void simulation::parse_JSON_input (string jsonstring) {
 			netrouter *thisrouter = dynamic_cast<netrouter *>(endpoint2);
 			thisrouter->addLink(*curr_link);
 		}
-		links[linkname] = curr_link;
+		links.add(curr_link);
 	}
+	links.assignIds(0);
 
 	// Load the flows into memory.
     const Value& textflows = document["flows"];
@@ -143,7 +243,8 @@ void simulation::parse_JSON_input (string jsonstring) {
 		assert(textflows[i].IsObject());
 		const Value& thisflow = textflows[i];
 		string flowname = thisflow["id"].GetString();
-		bool usingFAST = thisflow["FAST"].GetBool();
+		bool usingFAST = thisflow.HasMember("FAST") &&
+				thisflow["FAST"].GetBool();
 
 		// Make sure that the source and destination of this flow are hosts.
 		string srcname = thisflow["src"].GetString();
@@ -155,9 +256,9 @@ void simulation::parse_JSON_input (string jsonstring) {
 		nethost *destination_host;
 
 		// if the source is a host, great, that's expected
-		if (hosts.find(srcname) != hosts.end()) {
+		if (hosts.find(srcname) != NULL) {
 			srcIsHost = true;
-			source_host = hosts[srcname];
+			source_host = hosts.find(srcname);
 		}
 		// but flows can't start (or end) on anything else...
 		else {
@@ -165,9 +266,9 @@ void simulation::parse_JSON_input (string jsonstring) {
 		}
 
 		// if the destination is a host, great, that's expected
-		if (hosts.find(dstname) != hosts.end()) {
+		if (hosts.find(dstname) != NULL) {
 			dstIsHost = true;
-			destination_host = hosts[dstname];
+			destination_host = hosts.find(dstname);
 		}
 		// but flows can't end (or start) on anything else...
 		else {
@@ -182,123 +283,173 @@ void simulation::parse_JSON_input (string jsonstring) {
 						(float) thisflow["size"].GetDouble(),
 						*source_host, *destination_host, usingFAST,
 						*this);
-		flows[flowname] = curr_flow;
+		if (thisflow.HasMember("cc")) {
+			cc_type type;
+			bool known = congestion_control::parseCongestionControlType(
+					thisflow["cc"].GetString(), type);
+			assert(known);
+			(void) known;
+			curr_flow->setCongestionControl(
+					congestion_control::makeCongestionControl(type,
+							*curr_flow, curr_flow->getWindowSize()));
+		}
+		if (thisflow.HasMember("pacing")) {
+			curr_flow->getCongestionControl().setPacing(
+					thisflow["pacing"].GetBool());
+		}
+		if (thisflow.HasMember("class")) {
+			curr_flow->setTrafficClass(thisflow["class"].GetInt());
+		}
+		if (thisflow.HasMember("fluid")) {
+			curr_flow->setFluid(thisflow["fluid"].GetBool());
+		}
+		double max_rate = thisflow.HasMember("max_rate") ?
+				thisflow["max_rate"].GetDouble() : 0;
+		fluid.addFlow(*curr_flow, nodes.size(), max_rate);
+		flows.add(curr_flow);
+		if (!curr_flow->doneTransmitting()) {
+			num_flows_remaining++;
+		}
+	}
+	flows.assignIds(0);
+
+	// Optionally change the window link and flow rates are measured over.
+	if (document.HasMember("rate_window") ||
+			document.HasMember("rate_buckets")) {
+		double window_ms = document.HasMember("rate_window") ?
+				document["rate_window"].GetDouble() : RATE_INTERVAL;
+		int num_buckets = document.HasMember("rate_buckets") ?
+				document["rate_buckets"].GetInt() : RATE_BUCKETS;
+		for (vector<netlink *>::const_iterator it = links.begin();
+				it != links.end(); it++) {
+			(*it)->setRateWindow(window_ms, num_buckets);
+		}
+		for (vector<netflow *>::const_iterator it = flows.begin();
+				it != flows.end(); it++) {
+			(*it)->setRateWindow(window_ms, num_buckets);
+		}
 	}
 }
 
 void simulation::free_network_devices () {
 
-	map<string, nethost *>::iterator hitr;
-	map<string, netrouter *>::iterator ritr;
-	map<string, netlink *>::iterator litr;
-	map<string, netflow *>::iterator fitr;
+	vector<nethost *>::const_iterator hitr;
+	vector<netrouter *>::const_iterator ritr;
+	vector<netlink *>::const_iterator litr;
+	vector<netflow *>::const_iterator fitr;
 
 	for (hitr = hosts.begin(); hitr != hosts.end(); hitr++) {
-		delete hitr->second;
+		delete *hitr;
 	}
 	for (ritr = routers.begin(); ritr != routers.end(); ritr++) {
-		delete ritr->second;
+		delete *ritr;
 	}
 	for (litr = links.begin(); litr != links.end(); litr++) {
-		delete litr->second;
+		delete *litr;
 	}
 	for (fitr = flows.begin(); fitr != flows.end(); fitr++) {
-		delete fitr->second;
+		delete *fitr;
 	}
 }
 
 void simulation::print_network(ostream &os) const {
 
-	map<string, nethost *>::const_iterator hitr;
-	map<string, netrouter *>::const_iterator ritr;
-	map<string, netlink *>::const_iterator litr;
-	map<string, netflow *>::const_iterator fitr;
+	vector<nethost *>::const_iterator hitr;
+	vector<netrouter *>::const_iterator ritr;
+	vector<netlink *>::const_iterator litr;
+	vector<netflow *>::const_iterator fitr;
 
 	// Print all the hosts
 	for (hitr = hosts.begin(); hitr != hosts.end(); hitr++) {
-		os << *(hitr->second) << endl << endl;
+		os << **hitr << endl << endl;
 	}
 
 	// Print all the routers
 	for (ritr = routers.begin(); ritr != routers.end(); ritr++) {
-		os << *(ritr->second) << endl << endl;
+		os << **ritr << endl << endl;
 	}
 
 	// Print all the links
 	for (litr = links.begin(); litr != links.end(); litr++) {
-		os << *(litr->second) << endl << endl;
+		os << **litr << endl << endl;
 	}
 
 	// Print all the flows
 	for (fitr = flows.begin(); fitr != flows.end(); fitr++) {
-		os << *(fitr->second) << endl << endl;
+		os << **fitr << endl << endl;
 	}
 }
 
-map<string, nethost *> simulation::getHosts() const { return hosts; }
+const element_table<nethost> &simulation::getHosts() const { return hosts; }
+
+const element_table<netrouter> &simulation::getRouters() const {
+	return routers;
+}
+
+const element_table<netlink> &simulation::getLinks() const { return links; }
 
-map<string, netrouter *> simulation::getRouters() const { return routers; }
+const element_table<netflow> &simulation::getFlows() const { return flows; }
+
+const vector<netnode *> &simulation::getNodes() const { return nodes; }
 
 void simulation::runSimulation() {
 
 	// Initialize routing tables
-	for (map<string, netrouter*>::iterator it_rt = routers.begin();
-		 it_rt != routers.end(); it_rt++) {
-		it_rt->second->initializeTables(hosts, routers);
+	for (vector<netrouter *>::const_iterator router_it = routers.begin();
+			router_it != routers.end(); router_it++) {
+		netrouter *router = *router_it;
+		router->initializeTables(nodes);
 
 		if (debug) {
-			it_rt->second->printHelper(cout);
+			router->printHelper(cout);
 			cout << endl;
 		}
 	}
 
-	// At regular time intervals, push router discovery events onto events
-	// queue. 
-
-	router_discovery_event *r_event = new router_discovery_event(0, *this);
+	// Run the routing algorithm once right away, then at regular time
+	// intervals. The periodic event re-arms itself each time it runs.
+	router_discovery_event *r_event =
+			new (*this) router_discovery_event(0, *this);
 	addEvent(r_event);
 
-	for (int update_t = 550; update_t < UPPER_TIME_ROUTING_LIMIT;
-			update_t += 5000) {
-		router_discovery_event *r_event = new 
-				router_discovery_event(update_t, *this);
-		addEvent(r_event);
-	}
+	router_discovery_event *r_periodic = new (*this) router_discovery_event(
+			FIRST_ROUTING_UPDATE, *this, ROUTING_UPDATE_INTERVAL,
+			UPPER_TIME_ROUTING_LIMIT);
+	addEvent(r_periodic);
 	
 	// Loop over the flows, making a start flow event for each and adding
 	// it to the events queue.
-	// If the flow is using FAST TCP for congestion control, also push
-	// update_window_events at regular intervals.
-	for (map<string, netflow *>::iterator itr = flows.begin();
-			itr != flows.end(); itr++) {
-		netflow *flow = itr->second;
-		start_flow_event *fevent = new
+	// If the flow's congestion control wants periodic updates, as FAST TCP
+	// does, also add an update_window_event, which stops once the flow is
+	// done.
+	// Fluid flows send no packets; the fluid model runs them instead.
+	for (vector<netflow *>::const_iterator flow_it = flows.begin();
+			flow_it != flows.end(); flow_it++) {
+		netflow *flow = *flow_it;
+		if (flow->isFluid()) {
+			continue;
+		}
+		start_flow_event *fevent = new (*this)
 				start_flow_event(flow->getStartTimeMs(), *this, *flow);
 		addEvent(fevent);
 
-		// Add update_window_events here if necessary.
-		if (flow->isUsingFAST()) {
-
-			for (int update_w = flow->getStartTimeMs(); 
-					update_w < UPPER_TIME_ROUTING_LIMIT;
-					update_w += 20) {
-				
-				update_window_event *w_event = new
-						update_window_event(update_w, *this, *flow);
-				addEvent(w_event);
-			}
+		double interval = flow->getCongestionControl().getUpdateInterval();
+		if (interval > 0) {
+			update_window_event *w_event = new (*this) update_window_event(
+					(int) flow->getStartTimeMs(), *this, *flow,
+					interval, UPPER_TIME_ROUTING_LIMIT);
+			addEvent(w_event);
 		}
 	}
-	
+
+	if (fluid.hasFluidFlows()) {
+		addEvent(new (*this) fluid_update_event(fluid.getFirstStartTime(),
+				*this));
+	}
 
 	// Loop over the events in the events queue, running the one with the
 	// smallest start time.
-	while (!events.empty() && !(allFlowsDone())) {
-		multimap<double, event *>::iterator it = events.begin();
-		event *curr_event = (*it).second;
-		events.erase(it);
-		curr_event->runEvent();
-
+	while (!allFlowsDone() && runNextEvent()) {
 		if (debug) {
 			debug_os << endl;
 			if (detail) {
@@ -310,38 +461,81 @@ void simulation::runSimulation() {
 	}
 }
 
+bool simulation::runNextEvent() {
+
+	// Bring in any timers due by the time of the next event. If there's no
+	// next event, the earliest timers are it.
+	if (events->empty()) {
+		if (!timers.advanceToNext()) {
+			return false;
+		}
+	}
+	else {
+		timers.advanceTo(events->peek()->getTime());
+	}
+	event *curr_event = events->pop();
+	curr_event->dispatch();
+
+	// Timers reuse themselves by re-arming; everything
+	// else is done and its memory goes back to the pool.
+	if (!curr_event->isScheduled()) {
+		delete curr_event;
+	}
+	return true;
+}
+
 void simulation::addEvent(event *e) {
-	events.insert( pair<double, event *> (e->getTime(), e) );
+	events->push(e);
 }
 
 void simulation::removeEvent(event *e) {
-		
-	// Find the first occurrence of the input time. Since map is sorted
-	// by time, all simultaneous events (if any) will be lumped together
-	multimap<double, event *>::iterator it = events.find(e->getTime());
-
-	while ((*it).first == e->getTime()) {
-
-		// Check that the event we are removing has the same id as the
-		// input.
-		if ((*it).second->getId() == e->getId()) {
-			events.erase(it);
-			delete e;
-		}
-		it++;
+	if (events->remove(e) || timers.cancel(e)) {
+		delete e;
 	}
 }
 
-bool simulation::allFlowsDone() {
-	map<string, netflow *>::iterator fitr;
+void simulation::rescheduleEvent(event *e, double time) {
+	events->reschedule(e, time);
+}
 
-	bool isDone = true;
-	// iterate through all flows
-	for (fitr = flows.begin(); fitr != flows.end(); fitr++) {
-			isDone = isDone && fitr->second->doneTransmitting();
+void simulation::armTimer(event *e, double time) {
+	events->remove(e);
+	timers.cancel(e);
+	e->setTime(time);
+	timers.arm(e);
+}
+
+bool simulation::hasEventBefore(const event &e) {
+	timers.advanceTo(e.getTime());
+	return !events->empty() && event_scheduler::runsBefore(events->peek(), &e);
+}
+
+event_pool &simulation::getEventPool() { return pool; }
+
+fluid_model &simulation::getFluidModel() { return fluid; }
+
+long simulation::getNumPendingEvents() const {
+	return events->size() + timers.size();
+}
+
+bool simulation::allFlowsDone() { return num_flows_remaining == 0; }
+
+void simulation::flowCompleted(netflow &flow, double time_ms) {
+
+	// Only flows this simulation parsed are counted; tests sometimes make
+	// flows of their own.
+	if (flows.contains(&flow)) {
+		assert(num_flows_remaining > 0);
+		num_flows_remaining--;
 	}
+	if (on_flow_completion) {
+		on_flow_completion(flow, time_ms);
+	}
+}
 
-	return isDone;
+void simulation::setFlowCompletionCallback(
+		flow_completion_callback callback) {
+	on_flow_completion = callback;
 }
 
 /********** SIMULATION LOGGER RELATED FUNCTIONS **********/
@@ -391,29 +585,34 @@ int simulation::logEvent(double currTime) {
     json allFlows;
     json currEvent;
 
+    // Nothing to do if no log was set up, e.g. in tests.
+    if (outfile == NULL) {
+    	return 0;
+    }
+
     // Log only as frequency as LOG_FREQUENCY
     if (eventCount % LOG_FREQUENCY != 0) {
     	eventCount++;
     	return 0;
     }
 
-    // initalize iterators
-    map<string, netlink *>::const_iterator litr;
-    map<string, netflow *>::const_iterator fitr;
-
     // get and format link data
-    for (litr = links.begin(); litr != links.end(); litr++) {
+    for (vector<netlink *>::const_iterator link_it = links.begin();
+            link_it != links.end(); link_it++) {
+        netlink *link = *link_it;
         // get and format metrics
-        json linkMetric = logLinkMetric(*(litr->second), currTime);
+        json linkMetric = logLinkMetric(*link, currTime);
 
         // append to link metric array
         allLinks.push_back(linkMetric);
     }
 
     // get and format flow data
-    for (fitr = flows.begin(); fitr != flows.end(); fitr++) {
+    for (vector<netflow *>::const_iterator flow_it = flows.begin();
+            flow_it != flows.end(); flow_it++) {
+        netflow *flow = *flow_it;
         // get and format metrics
-        json flowMetric = logFlowMetric(*(fitr->second), currTime);
+        json flowMetric = logFlowMetric(*flow, currTime);
         
         // append to flow metric array
         allFlows.push_back(flowMetric);
@@ -448,12 +647,12 @@ void simulation::appendEventMetric(json event, ofstream& logger) {
     logger << std::setw(4) << event << '\n';
 }
 
-json simulation::logLinkMetric(netlink link, double currTime) {
+json simulation::logLinkMetric(netlink &link, double currTime) {
 
     // retreive link metrics
     string name = link.getName();
-    double rate = link.getRateMbps();
-    long occ = link.getBufferOccupancy() / 1000; // kilobyte
+    double rate = link.getRateMbps(currTime);
+    long occ = link.getBufferOccupancy(currTime) / 1000; // kilobyte
     int loss = link.getPktLoss();
 
     // format into json
@@ -465,10 +664,40 @@ json simulation::logLinkMetric(netlink link, double currTime) {
         {"PktLoss" , loss},
     };
 
+    // per-class queue stats for links that schedule between classes
+    json classMetrics = json::array();
+    for (int dir = 0; dir < 2; dir++) {
+        const class_queue *classes =
+                dynamic_cast<const class_queue *>(link.getQueueDiscipline(dir));
+        if (classes == NULL) {
+            continue;
+        }
+        for (int cls = 0; cls < classes->getNumClasses(); cls++) {
+            const class_stats &stats = classes->getClassStats(cls);
+            json classMetric =
+            {
+                {"Class" , classes->getClassName(cls)},
+                {"Direction" , dir},
+                {"BuffOcc" , stats.backlog_bytes / 1000}, // kilobyte
+                {"PktsSent" , stats.packets_sent},
+                {"Drops" , stats.drops},
+            };
+            classMetrics.push_back(classMetric);
+        }
+    }
+    if (!classMetrics.empty()) {
+        linkMetric["Classes"] = classMetrics;
+    }
+
+    // ECN marks so far, for links that mark
+    if (link.marksEcn()) {
+        linkMetric["PktsMarked"] = link.getPacketsMarked();
+    }
+
     return linkMetric;
 }
 
-json simulation::logFlowMetric(netflow flow, double currTime) {
+json simulation::logFlowMetric(const netflow &flow, double currTime) {
   
 	// retrieve flow metrics
     string name = flow.getName();
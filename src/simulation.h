@@ -18,6 +18,7 @@
 #include <cstdlib>
 #include <vector>
 #include <queue>
+#include <functional>
 
 // Libraries.
 /* NOTE: rapidjson is used for parsing input while
@@ -38,6 +39,11 @@ class netflow;
 
 // Custom headers.
 #include "events.h"
+#include "event_pool.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "element_table.h"
+#include "fluid_model.h"
 
 using namespace std;
 using namespace rapidjson;
@@ -47,6 +53,12 @@ extern bool debug;
 extern bool detail;
 extern ostream &debug_os;
 
+/**
+ * Function called when a flow finishes transmitting; gets the flow and the
+ * completion time in milliseconds.
+ */
+typedef function<void (netflow &, double)> flow_completion_callback;
+
 /**
  * Represents the simulation. Sets up network based on .json input file and
  * runs network simulation. TCP protocol to use indicated as flow parameter in
@@ -57,23 +69,51 @@ class simulation {
 
 private:
 
-	/** All hosts in network. */
-	map<string, nethost *> hosts;
+	/** All hosts in network. Their IDs come first among the nodes. */
+	element_table<nethost> hosts;
+
+	/** All routers in network. Numbered after the hosts. */
+	element_table<netrouter> routers;
 
-	/** All routers in network. */
-	map<string, netrouter *> routers;
+	/** Hosts then routers, each in name order, indexed by node ID. */
+	vector<netnode *> nodes;
 
 	/** All links in network. */
-	map<string, netlink *> links;
+	element_table<netlink> links;
 
 	/** All flows in network. */
-	map<string, netflow *> flows;
+	element_table<netflow> flows;
+
+	/**
+	 * Number of flows in @c flows that haven't finished transmitting. Kept
+	 * up to date by @c flowCompleted so the main loop's termination check
+	 * doesn't walk every flow after every event.
+	 */
+	long num_flows_remaining;
+
+	/** Called from @c flowCompleted if set. */
+	flow_completion_callback on_flow_completion;
+
+	/**
+	 * Memory for this simulation's events. Declared before the event queue
+	 * so it's still around while leftover events are deleted.
+	 */
+	event_pool pool;
+
+	/**
+	 * Event queue. Which priority queue implementation is used is chosen at
+	 * construction time; see @c scheduler.h.
+	 */
+	event_scheduler *events;
 
 	/**
-	 * Event queue (implemented with a multimap which is sorted by key).
-	 * Keys represent time in milliseconds.
+	 * Protocol timers that aren't due yet. They're moved into @c events just
+	 * before the first event at or after their tick is popped.
 	 */
-	multimap<double, event *> events;
+	timer_wheel timers;
+
+	/** Carries the fluid flows, and knows about all the others. */
+	fluid_model fluid;
 
 	/** Name of file to which simulation metrics are logged */
 	char *outfile;
@@ -90,18 +130,20 @@ public:
 	 * Parses the JSON file stored at @c inputfile and populates in-memory
 	 * hosts, routers, links, and flows.
 	 * @param inputfile JSON filename. Points to description of network.
+	 * @param sched_type kind of event queue to use
 	 */
-	simulation (const char *inputfile);
+	simulation (const char *inputfile,
+			scheduler_type sched_type = CALENDAR_SCHEDULER);
 
 	/**
 	 * Default constructor which does nothing. Might be used in tests.
-	 * @param inputfile JSON filename. Points to description of network.
+	 * @param sched_type kind of event queue to use
 	 */
-	simulation ();
+	simulation (scheduler_type sched_type = CALENDAR_SCHEDULER);
 
 	/**
 	 * Deletes all the dynamically allocated network objects like hosts,
-	 * routers, and so forth.
+	 * routers, and so forth, as well as any events that never ran.
 	 */
 	~simulation ();
 
@@ -121,16 +163,34 @@ public:
 	void print_network(ostream &os) const;
 
 	/**
-	 * Getter for the string to host-pointer map.
+	 * Getter for the hosts.
 	 * @return hosts
 	 */
-	map<string, nethost *> getHosts() const;
+	const element_table<nethost> &getHosts() const;
 
 	/**
-	 * Getter for the string to router-pointer map.
+	 * Getter for the routers.
 	 * @return router
 	 */
-	map<string, netrouter *> getRouters() const;
+	const element_table<netrouter> &getRouters() const;
+
+	/**
+	 * Getter for the links.
+	 * @return links
+	 */
+	const element_table<netlink> &getLinks() const;
+
+	/**
+	 * Getter for the flows.
+	 * @return flows
+	 */
+	const element_table<netflow> &getFlows() const;
+
+	/**
+	 * Getter for the nodes, indexed by their IDs.
+	 * @return nodes
+	 */
+	const vector<netnode *> &getNodes() const;
 
 	/**
 	 * Runs the simulation by loading some initial events into the @c events
@@ -139,12 +199,20 @@ public:
 	 * empties. Note that each event can (1) modify the host, flow, router,
 	 * or link data structures in this simulation object, (2) add new events
 	 * to this simulation object's event queue, or (3) log data into this
-	 * simulation object's related log file. This function is not responsible
+	 * simulation object's related log file. Events are deleted once they've
+	 * run unless they put themselves back on the queue. This function is not responsible
 	 * for writing the data logger's data to disk--the caller
 	 * (individual event) is.
 	 */
 	void runSimulation();
 
+	/**
+	 * Pops the earliest pending event, runs it, and deletes it unless it put
+	 * itself back on the queue.
+	 * @return false if there were no events to run
+	 */
+	bool runNextEvent();
+
 	/**
 	 * Adds an event to the simulation's event queue. Event objects have a
 	 * reference to this simulation so they can add events they need to
@@ -154,16 +222,79 @@ public:
 	void addEvent(event *e);
 
 	/**
-	 * Removes the given event from the simulation's event map.
+	 * Removes the given event from the simulation's event queue or timer
+	 * wheel and deletes it. Does nothing if the event isn't scheduled.
 	 * @param e event to remove
 	 */
 	void removeEvent(event *e);
 
+	/**
+	 * Moves the given event to a new time, queueing it if it isn't already
+	 * queued. Cheaper than removing the event and adding a new one, which is
+	 * what timers that get pushed back all the time want.
+	 * @param e event to move
+	 * @param time new time in milliseconds
+	 */
+	void rescheduleEvent(event *e, double time);
+
+	/**
+	 * Arms the given event as a timer that goes off at the given time,
+	 * disarming or dequeueing it first if need be. Timers that usually get
+	 * pushed back or cancelled before they go off, like retransmission
+	 * timeouts, should use this instead of @c rescheduleEvent so they stay
+	 * out of the event queue until they're due.
+	 * @param e timer
+	 * @param time in milliseconds
+	 */
+	void armTimer(event *e, double time);
+
+	/**
+	 * Checks if any pending event would run before the given one, were it
+	 * queued. Brings in the timers due by then, like @c runNextEvent.
+	 * @param e an event that isn't queued
+	 * @return true if some other event comes first
+	 */
+	bool hasEventBefore(const event &e);
+
+	/**
+	 * Getter for the pool events should be allocated from; see
+	 * @c event::operator new.
+	 * @return this simulation's event pool
+	 */
+	event_pool &getEventPool();
+
+	/**
+	 * Getter for the model carrying this simulation's fluid flows.
+	 * @return the fluid model
+	 */
+	fluid_model &getFluidModel();
+
+	/**
+	 * Getter for the number of events waiting in the event queue or armed
+	 * in the timer wheel.
+	 * @return number of pending events
+	 */
+	long getNumPendingEvents() const;
+
 	/** Returns true if all flows have finished transmitting
 	 * @return boolean
 	 */
 	bool allFlowsDone();
 
+	/**
+	 * Called by a flow when the packet that completes it arrives. Updates
+	 * the count of unfinished flows and calls the completion callback.
+	 * @param flow that just finished
+	 * @param time_ms completion time in milliseconds
+	 */
+	void flowCompleted(netflow &flow, double time_ms);
+
+	/**
+	 * Sets the function to call each time a flow finishes transmitting.
+	 * @param callback completion callback, or an empty function for none
+	 */
+	void setFlowCompletionCallback(flow_completion_callback callback);
+
 	//------------ SIMULATION LOGGER RELATED FUNCTIONS -----------------------//
 	
 	/**
@@ -196,7 +327,8 @@ public:
 	/**
 	 * Called everytime an event is run/"popped".
 	 * Sweeps for all relevant metrics of time currTime stored in event object
-	 * and then writes to file.
+	 * and then writes to file. Does nothing if @c initializeLog hasn't been
+	 * called.
 	 * @param currTime occurrance time of event currently being logged
 	 * @return 0 returned if successful
 	 */
@@ -214,12 +346,13 @@ public:
 	/**
 	 * Helper function to logEvent.
 	 * Retrieves link ID, link rate, link buffer occupancy, and packet loss of
-	 * single link and formats metrics into json.
+	 * single link, plus per-class queue stats if the link schedules between
+	 * traffic classes, and formats metrics into json.
 	 * @param link
 	 * @param currTime occurrance time of event currently being logged
 	 * @param returns metrics for input link in JSON format
 	 */
-	json logLinkMetric(netlink link, double currTime);
+	json logLinkMetric(netlink &link, double currTime);
 
 	/**
 	 * Helper function to logEvent.
@@ -229,7 +362,7 @@ public:
 	 * @param currTime occurrance time of event currently being logged
 	 * @param returns metrics for input flow in JSON format
 	 */
-	json logFlowMetric(netflow flow, double currTime);
+	json logFlowMetric(const netflow &flow, double currTime);
 };
 
 #endif // SIMULATION_H
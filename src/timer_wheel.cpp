@@ -0,0 +1,186 @@
+/*
+ * See header file for comments.
+ */
+
+// Standard includes.
+#include <cassert>
+#include <cmath>
+
+// Custom headers.
+#include "timer_wheel.h"
+
+// ------------------------------ timer_wheel class ---------------------------
+
+constexpr double timer_wheel::TICK_MS;
+
+const int timer_wheel::BITS_PER_LEVEL;
+
+const long timer_wheel::SLOTS;
+
+const long timer_wheel::SLOT_MASK;
+
+const int timer_wheel::LEVELS;
+
+const long timer_wheel::OVERFLOW_BUCKET;
+
+const long timer_wheel::NUM_BUCKETS;
+
+timer_wheel::timer_wheel(event_scheduler &queue) :
+		queue(&queue), buckets(NUM_BUCKETS), level0_occupied(0),
+		current_tick(0), num_timers(0) { }
+
+long timer_wheel::tickOf(double time) {
+	return (long) floor(time / TICK_MS);
+}
+
+void timer_wheel::file(event *e) {
+	long tick = tickOf(e->getTime());
+	assert(tick >= current_tick);
+
+	// Use the finest level whose span reaches the timer's tick.
+	long delta = tick - current_tick;
+	long bucket = OVERFLOW_BUCKET;
+	for (int level = 0; level < LEVELS; level++) {
+		if (delta < (1L << (BITS_PER_LEVEL * (level + 1)))) {
+			bucket = level * SLOTS +
+					((tick >> (BITS_PER_LEVEL * level)) & SLOT_MASK);
+			break;
+		}
+	}
+
+	e->setTimerSlot(buckets[bucket].size() * NUM_BUCKETS + bucket);
+	buckets[bucket].push_back(e);
+	if (bucket < SLOTS) {
+		level0_occupied |= (uint64_t) 1 << bucket;
+	}
+}
+
+void timer_wheel::unfile(long bucket, long pos) {
+	vector<event *> &events = buckets[bucket];
+	event *last = events.back();
+	events[pos] = last;
+	last->setTimerSlot(pos * NUM_BUCKETS + bucket);
+	events.pop_back();
+	if (bucket < SLOTS && events.empty()) {
+		level0_occupied &= ~((uint64_t) 1 << bucket);
+	}
+}
+
+void timer_wheel::cascade(long bucket) {
+	vector<event *> moving;
+	moving.swap(buckets[bucket]);
+	for (unsigned long i = 0; i < moving.size(); i++) {
+		file(moving[i]);
+	}
+}
+
+long timer_wheel::expireCurrentTick() {
+	long slot = current_tick & SLOT_MASK;
+	vector<event *> &events = buckets[slot];
+	long moved = events.size();
+	for (long i = 0; i < moved; i++) {
+		events[i]->setTimerSlot(event::NOT_SCHEDULED);
+		queue->push(events[i]);
+	}
+	events.clear();
+	level0_occupied &= ~((uint64_t) 1 << slot);
+	num_timers -= moved;
+	return moved;
+}
+
+long timer_wheel::advanceToTick(long target_tick) {
+	long moved = 0;
+	while (current_tick <= target_tick) {
+		long index = current_tick & SLOT_MASK;
+
+		// At the start of each level 0 lap pull the timers of the new span
+		// down from the coarser levels. The coarser a level is, the less
+		// often its index wraps to zero; re-file from the coarsest level
+		// that's starting a new slot down to level 1.
+		if (index == 0) {
+			int top = 1;
+			while (top < LEVELS &&
+					((current_tick >> (BITS_PER_LEVEL * top)) & SLOT_MASK) == 0) {
+				top++;
+			}
+			if (top == LEVELS) {
+				cascade(OVERFLOW_BUCKET);
+				top = LEVELS - 1;
+			}
+			for (int level = top; level >= 1; level--) {
+				cascade(level * SLOTS +
+						((current_tick >> (BITS_PER_LEVEL * level)) & SLOT_MASK));
+			}
+		}
+
+		// Skip straight to the next occupied slot in this lap, or to the end
+		// of the lap if there isn't one.
+		uint64_t pending = level0_occupied >> index;
+		if (pending == 0) {
+			long lap_end = (current_tick | SLOT_MASK) + 1;
+			current_tick = lap_end <= target_tick + 1 ?
+					lap_end : target_tick + 1;
+			continue;
+		}
+		long next = current_tick + __builtin_ctzll(pending);
+		if (next > target_tick) {
+			current_tick = target_tick + 1;
+			break;
+		}
+		current_tick = next;
+		moved += expireCurrentTick();
+		current_tick++;
+	}
+	return moved;
+}
+
+void timer_wheel::arm(event *e) {
+	assert(!e->isScheduled());
+
+	// Already past this tick, so it belongs in the queue right away.
+	if (tickOf(e->getTime()) < current_tick) {
+		queue->push(e);
+		return;
+	}
+	file(e);
+	num_timers++;
+}
+
+bool timer_wheel::cancel(event *e) {
+	if (!e->isTimerArmed()) {
+		return false;
+	}
+	long slot = e->getTimerSlot();
+	long bucket = slot % NUM_BUCKETS;
+	long pos = slot / NUM_BUCKETS;
+	assert(buckets[bucket][pos] == e);
+	unfile(bucket, pos);
+	e->setTimerSlot(event::NOT_SCHEDULED);
+	num_timers--;
+	return true;
+}
+
+void timer_wheel::advanceTo(double time) {
+	advanceToTick(tickOf(time));
+}
+
+bool timer_wheel::advanceToNext() {
+	if (num_timers == 0) {
+		return false;
+	}
+	while (advanceToTick(current_tick | SLOT_MASK) == 0) { }
+	return true;
+}
+
+event *timer_wheel::removeAny() {
+	for (long bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+		if (!buckets[bucket].empty()) {
+			event *e = buckets[bucket].back();
+			cancel(e);
+			return e;
+		}
+	}
+	return NULL;
+}
+
+long timer_wheel::size() const { return num_timers; }
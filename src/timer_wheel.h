@@ -0,0 +1,177 @@
+/**
+ * @file
+ *
+ * Contains the declaration of the hierarchical timer wheel that holds a
+ * simulation's protocol timers (retransmission timeouts, FAST window
+ * updates, routing refreshes) until they're about to go off.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Standard includes.
+#include <cstdint>
+#include <vector>
+
+// Custom headers.
+#include "events.h"
+#include "scheduler.h"
+
+using namespace std;
+
+// ------------------------------ timer_wheel class ---------------------------
+
+/**
+ * Hierarchical timer wheel (Varghese and Lauck, 1987). Time is cut into
+ * ticks of @c TICK_MS milliseconds. Level 0 has a slot for each of the next
+ * @c SLOTS ticks, and each higher level has slots @c SLOTS times as wide as
+ * the level below it. Timers further out than the top level go on an
+ * overflow list. When the wheel's current tick reaches the start of a
+ * slot's span on some level, that slot's timers are re-filed into finer
+ * slots. Arming and cancelling a timer are O(1).
+ *
+ * Timers that are pushed back over and over never touch the event queue.
+ * A timer is moved into the queue only when the simulation is about to pop
+ * an event at or after the timer's tick. It keeps its exact time when it
+ * moves, so events run in exactly the same order as if every timer had been
+ * queued directly.
+ */
+class timer_wheel {
+
+private:
+
+	/** Width of a tick in milliseconds. */
+	static constexpr double TICK_MS = 1.0;
+
+	/** Bits of the tick number covered by each level. */
+	static const int BITS_PER_LEVEL = 6;
+
+	/** Number of slots per level. */
+	static const long SLOTS = 1L << BITS_PER_LEVEL;
+
+	/** Mask for a slot index within a level. */
+	static const long SLOT_MASK = SLOTS - 1;
+
+	/** Number of levels. Covers 2^24 ticks, i.e. about 4.6 hours. */
+	static const int LEVELS = 4;
+
+	/** Index of the overflow list among the buckets. */
+	static const long OVERFLOW_BUCKET = LEVELS * SLOTS;
+
+	/** Number of buckets, including the overflow list. */
+	static const long NUM_BUCKETS = OVERFLOW_BUCKET + 1;
+
+	/** Queue that timers are moved into when they're due. */
+	event_scheduler *queue;
+
+	/**
+	 * Armed timers. Bucket @c level * @c SLOTS + slot holds a level's slot.
+	 * Order within a bucket doesn't matter. An armed event's timer slot is
+	 * its position in the bucket times @c NUM_BUCKETS plus the bucket index.
+	 */
+	vector<vector<event *> > buckets;
+
+	/** Bit i is set if level 0's slot i isn't empty. */
+	uint64_t level0_occupied;
+
+	/** All ticks before this one have been moved into the queue. */
+	long current_tick;
+
+	/** Number of armed timers. */
+	long num_timers;
+
+	/**
+	 * Computes the tick that a time falls in.
+	 * @param time in milliseconds
+	 * @return tick number
+	 */
+	static long tickOf(double time);
+
+	/**
+	 * Puts an armed timer in the bucket that covers its tick. The tick must
+	 * not be before the current tick.
+	 * @param e timer
+	 */
+	void file(event *e);
+
+	/**
+	 * Takes the event at the given position out of its bucket, filling the
+	 * hole with the bucket's last event.
+	 * @param bucket index of the bucket
+	 * @param pos position in the bucket
+	 */
+	void unfile(long bucket, long pos);
+
+	/**
+	 * Re-files every timer in the given bucket.
+	 * @param bucket index of the bucket
+	 */
+	void cascade(long bucket);
+
+	/**
+	 * Moves every timer in level 0's slot for the current tick into the
+	 * queue.
+	 * @return number of timers moved
+	 */
+	long expireCurrentTick();
+
+	/**
+	 * Moves the timers of every tick up to and including the given one into
+	 * the queue.
+	 * @param target_tick
+	 * @return number of timers moved
+	 */
+	long advanceToTick(long target_tick);
+
+public:
+
+	/**
+	 * Makes an empty wheel.
+	 * @param queue that due timers are moved into
+	 */
+	timer_wheel(event_scheduler &queue);
+
+	/**
+	 * Arms an event as a timer that goes off at the event's time. If that's
+	 * in a tick the wheel has already passed the event goes straight into
+	 * the queue. The event must not be queued or armed already.
+	 * @param e timer
+	 */
+	void arm(event *e);
+
+	/**
+	 * Disarms a timer.
+	 * @param e timer
+	 * @return true if the event was armed in this wheel
+	 */
+	bool cancel(event *e);
+
+	/**
+	 * Moves every timer that goes off in or before the tick containing the
+	 * given time into the queue. Called before each pop so that no timer
+	 * is left behind an event that should run after it.
+	 * @param time in milliseconds
+	 */
+	void advanceTo(double time);
+
+	/**
+	 * Moves the earliest armed timers into the queue, however far away they
+	 * are. Used when the queue is empty.
+	 * @return false if no timers are armed
+	 */
+	bool advanceToNext();
+
+	/**
+	 * Takes some armed timer out of the wheel. Used for cleanup.
+	 * @return an armed timer, or NULL if there are none
+	 */
+	event *removeAny();
+
+	/**
+	 * Getter for the number of armed timers.
+	 * @return number of timers
+	 */
+	long size() const;
+};
+
+#endif // TIMER_WHEEL_H
@@ -30,8 +30,8 @@ const int BYTES_PER_MEGABIT =
 /** Milliseconds per second. */
 const int MS_PER_SEC = 1000;
 
-/** Types of packets in this simulation. */
-enum packet_type {
+/** Types of packets in this simulation. Kept to a byte in packets. */
+enum packet_type : unsigned char {
 	FLOW,
 	ACK,
 	ROUTING
@@ -40,12 +40,39 @@ enum packet_type {
 /** A sentinel used for the sequence numbers of routing packets. */
 const int SEQNUM_FOR_NONFLOWS = -1;
 
-/** Time interval in ms over which to compute flow rate */
+/** Default length in ms of the sliding window link and flow rates cover. */
 const int RATE_INTERVAL = 1000;
 
+/** Default number of buckets that window slides in. */
+const int RATE_BUCKETS = 10;
+
+/** Number of values of @c packet_type, for arrays indexed by it. */
+const int NUM_PACKET_TYPES = ROUTING + 1;
+
 /** Send routing packets until this time (in milliseconds) is reached. */
 const int UPPER_TIME_ROUTING_LIMIT = 400000;
 
+/** Time in ms of the first periodic routing update after the initial one. */
+const int FIRST_ROUTING_UPDATE = 550;
+
+/** Time in ms between periodic routing updates. */
+const int ROUTING_UPDATE_INTERVAL = 5000;
+
+/** Time in ms between FAST TCP window updates. */
+const int WINDOW_UPDATE_INTERVAL = 20;
+
+/**
+ * Most of a link's capacity fluid flows may use. The rest is kept for
+ * packet-level traffic like routing updates, so it never stalls.
+ */
+const double FLUID_MAX_UTILIZATION = 0.99;
+
+/**
+ * Time in ms between fluid rate updates while packet-level flows, whose
+ * finishing times the fluid model can't predict, are running too.
+ */
+const int FLUID_UPDATE_INTERVAL = 100;
+
 /** Print information about packets every (this many) packets. */
 const int PRINT_PACKET_INFO_MILESTONE = 5000;
 
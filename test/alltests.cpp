@@ -12,6 +12,17 @@
 #include "events.h"
 #include "network.h"
 #include "simulation.h"
+#include "event_pool.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "element_table.h"
+#include "ring_buffer.h"
+#include "queue_discipline.h"
+#include "fluid_model.h"
+#include "rate_counter.h"
+#include "seq_window.h"
+#include "seq_bitmap.h"
+#include "congestion_control.h"
 
 // Unit test suites
 #include "gtest/gtest.h"
@@ -20,6 +31,18 @@
 #include "test_simulation.cpp"
 #include "test_event.cpp"
 #include "test_packet.cpp"
+#include "test_scheduler.cpp"
+#include "test_event_pool.cpp"
+#include "test_timer_wheel.cpp"
+#include "test_flow_completion.cpp"
+#include "test_element_table.cpp"
+#include "test_ring_buffer.cpp"
+#include "test_queue_discipline.cpp"
+#include "test_fluid_model.cpp"
+#include "test_rate_counter.cpp"
+#include "test_seq_window.cpp"
+#include "test_seq_bitmap.cpp"
+#include "test_congestion_control.cpp"
 
 using namespace testing;
 
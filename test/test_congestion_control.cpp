@@ -0,0 +1,375 @@
+/**
+ * @file
+ *
+ * Tests the congestion control algorithms and how flows use them.
+ */
+
+#ifndef TEST_CONGESTION_CONTROL_CPP
+#define TEST_CONGESTION_CONTROL_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+/**
+ * Gives a flow an ACK with the given sequence number.
+ * @param flow
+ * @param seq
+ * @param time at which the ACK arrives
+ * @param sent_time when the packet it acknowledges was sent, or -1 for no
+ * RTT sample
+ * @param ecn_echo true if the packet it acknowledges was marked
+ */
+static void ackFlow(netflow &flow, int seq, double time,
+		double sent_time = -1, bool ecn_echo = false) {
+	packet ack(ACK, flow, seq);
+	ack.setTransmitTimestamp(sent_time);
+	ack.setEcnEcho(ecn_echo);
+	flow.receivedAck(ack, time, 0);
+}
+
+/*
+ * Names in the input file map to the algorithms.
+ */
+TEST(congestionControlTest, parseTest) {
+	cc_type type;
+	ASSERT_TRUE(congestion_control::parseCongestionControlType("newreno",
+			type));
+	ASSERT_EQ(NEWRENO_CC, type);
+	ASSERT_TRUE(congestion_control::parseCongestionControlType("cubic", type));
+	ASSERT_EQ(CUBIC_CC, type);
+	ASSERT_TRUE(congestion_control::parseCongestionControlType("bbr", type));
+	ASSERT_EQ(BBR_CC, type);
+	ASSERT_TRUE(congestion_control::parseCongestionControlType("dctcp", type));
+	ASSERT_EQ(DCTCP_CC, type);
+	ASSERT_FALSE(congestion_control::parseCongestionControlType("bic", type));
+}
+
+/*
+ * Tahoe drops to a window of one on a fast retransmit while Reno halves it,
+ * and both grow by a packet per ACK until they reach the threshold.
+ */
+TEST(congestionControlTest, tahoeRenoTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	tahoe_control tahoe(flow, 1);
+	reno_control reno(flow, 1);
+
+	tahoe.onAck(9, 0);
+	reno.onAck(9, 0);
+	ASSERT_FLOAT_EQ(10, tahoe.getWindow());
+	ASSERT_FLOAT_EQ(10, reno.getWindow());
+
+	// Only the third duplicate counts.
+	tahoe.onDupAck(2, 0);
+	reno.onDupAck(2, 0);
+	ASSERT_FLOAT_EQ(10, tahoe.getWindow());
+	tahoe.onDupAck(3, 0);
+	reno.onDupAck(3, 0);
+	ASSERT_FLOAT_EQ(1, tahoe.getWindow());
+	ASSERT_FLOAT_EQ(5, tahoe.getThreshold());
+	ASSERT_FLOAT_EQ(5, reno.getWindow());
+	ASSERT_FLOAT_EQ(5, reno.getThreshold());
+
+	// Reno is past the threshold, so it grows by a packet per window.
+	reno.onAck(5, 0);
+	ASSERT_LT(5.9, reno.getWindow());
+	ASSERT_GT(6, reno.getWindow());
+
+	reno.onTimeout();
+	ASSERT_FLOAT_EQ(1, reno.getWindow());
+	ASSERT_LT(2.9, reno.getThreshold());
+}
+
+/*
+ * A second loss from a window NewReno is already recovering doesn't halve
+ * it again, where it does for Reno.
+ */
+TEST(congestionControlTest, newRenoTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow reno("F1", 1, 20, h1, h2, false, sim);
+	netflow newreno("F2", 1, 20, h1, h2, false, sim);
+	reno.setCongestionControl(
+			congestion_control::makeCongestionControl(RENO_CC, reno, 8));
+	newreno.setCongestionControl(
+			congestion_control::makeCongestionControl(NEWRENO_CC, newreno, 8));
+
+	netflow *flows[] = { &reno, &newreno };
+	for (int i = 0; i < 2; i++) {
+		netflow &flow = *flows[i];
+		ASSERT_EQ(8u, flow.popOutstandingPackets(0, 0).size());
+
+		// Packet 1 is lost; the rest get through.
+		for (int dup = 0; dup < 3; dup++) {
+			ackFlow(flow, 1, 10 + dup);
+		}
+		ASSERT_FLOAT_EQ(4, flow.getWindowSize());
+
+		// The retransmission gets through but packet 3 was lost too.
+		ackFlow(flow, 3, 20);
+		for (int dup = 0; dup < 3; dup++) {
+			ackFlow(flow, 3, 30 + dup);
+		}
+	}
+	ASSERT_GT(4, reno.getWindowSize());
+	ASSERT_FLOAT_EQ(4, newreno.getWindowSize());
+
+	// Once everything sent before the first loss is acknowledged, NewReno
+	// grows again.
+	ackFlow(newreno, 9, 40);
+	ASSERT_LT(4, newreno.getWindowSize());
+}
+
+/*
+ * After a loss CUBIC's window climbs back to where the loss happened,
+ * levels off there, and only then probes past it.
+ */
+TEST(congestionControlTest, cubicTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	cubic_control cubic(flow, 1);
+	cubic.onAck(99, 0);
+	cubic.onDupAck(3, 0);
+	ASSERT_FLOAT_EQ(70, cubic.getWindow());
+
+	// An ACK every 10 ms. The cubic gets back to 100 after about 4.2
+	// seconds, and the window follows it a little behind.
+	double time = 0;
+	for (; time < 4000; time += 10) {
+		cubic.onAck(1, time);
+	}
+	double before = cubic.getWindow();
+	ASSERT_LT(95, before);
+	ASSERT_GT(100, before);
+	for (; time < 5500; time += 10) {
+		cubic.onAck(1, time);
+	}
+	double plateau = cubic.getWindow();
+	ASSERT_GT(before + 2, plateau);
+	for (; time < 8500; time += 10) {
+		cubic.onAck(1, time);
+	}
+	ASSERT_LT(plateau + 10, cubic.getWindow());
+}
+
+/*
+ * Vegas leaves slow start once RTTs show packets queueing, then backs off
+ * a packet per round trip while too many are queued.
+ */
+TEST(congestionControlTest, vegasTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	flow.setCongestionControl(
+			congestion_control::makeCongestionControl(VEGAS_CC, flow, 10));
+	ASSERT_EQ(10u, flow.popOutstandingPackets(0, 0).size());
+
+	// The first round trip is quick, so slow start carries on.
+	ackFlow(flow, 2, 100, 0);
+	ASSERT_FLOAT_EQ(11, flow.getWindowSize());
+	ASSERT_GT(0, flow.getLinGrowthWinsizeThreshold());
+
+	// Then they take twice as long, so half the window is queued.
+	for (int seq = 3; seq <= 11; seq++) {
+		ackFlow(flow, seq, 200 + 200 * seq, 200 * seq);
+	}
+	double window = flow.getWindowSize();
+	ASSERT_FLOAT_EQ(window, flow.getLinGrowthWinsizeThreshold());
+	ackFlow(flow, 12, 2600, 2400);
+	ASSERT_FLOAT_EQ(window - 1, flow.getWindowSize());
+}
+
+/*
+ * BBR finds the bottleneck's bandwidth on a full-duplex link, settles into
+ * PROBE_BW and paces at a multiple of it.
+ */
+TEST(congestionControlTest, bbrTest) {
+	simulation sim;
+	sim.parse_JSON_input("{ \"hosts\": [ \"H1\", \"H2\" ], "
+			"\"routers\": [], "
+			"\"links\": [ { \"id\": \"L1\", \"rate\": 10, "
+			"\"delay\": 10, \"buf_len\": 64, \"full_duplex\": true, "
+			"\"endpt_1\": \"H1\", \"endpt_2\": \"H2\" } ], "
+			"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+			"\"dst\": \"H2\", \"size\": 20, \"start\": 1.0, "
+			"\"cc\": \"bbr\" } ] }");
+	netflow *flow = sim.getFlows().find("F1");
+	ASSERT_FALSE(flow->isPaced());
+	sim.runSimulation();
+	ASSERT_TRUE(sim.allFlowsDone());
+
+	bbr_control &bbr =
+			dynamic_cast<bbr_control &>(flow->getCongestionControl());
+	double link_rate = 10.0 * BYTES_PER_MEGABIT / MS_PER_SEC /
+			FLOW_PACKET_SIZE;
+	ASSERT_LT(0.9 * link_rate, bbr.getBandwidth());
+	ASSERT_GT(1.25 * link_rate, bbr.getBandwidth());
+	double gain = bbr.getPacingGain();
+	ASSERT_TRUE(gain == 1.25 || gain == 0.75 || gain == 1) << gain;
+	ASSERT_FLOAT_EQ(gain * bbr.getBandwidth(), bbr.getPacingRate());
+	ASSERT_TRUE(flow->isPaced());
+}
+
+/*
+ * A paced flow spaces its packets at its rate and starts afresh after a
+ * timeout.
+ */
+TEST(congestionControlTest, pacingTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	flow.getCongestionControl().setPacing(true);
+	ASSERT_FALSE(flow.isPaced()); // no RTT to pace over yet
+	ASSERT_EQ(1u, flow.popOutstandingPackets(0, 0).size());
+	ackFlow(flow, 2, 100, 0);
+	ASSERT_TRUE(flow.isPaced());
+
+	// Slow start paces two windows per RTT: 4 packets per 100 ms.
+	ASSERT_FLOAT_EQ(0.04, flow.getCongestionControl().getPacingRate());
+	ASSERT_FLOAT_EQ(200, flow.pace(200));
+	ASSERT_FLOAT_EQ(225, flow.pace(200));
+	ASSERT_FLOAT_EQ(250, flow.pace(210));
+	ASSERT_FLOAT_EQ(400, flow.pace(400));
+
+	flow.timeoutOccurred();
+	ASSERT_FLOAT_EQ(410, flow.pace(410));
+}
+
+/*
+ * DCTCP cuts its window by half its estimate of the marked fraction, once
+ * per window of marks, and updates the estimate once per window of data.
+ */
+TEST(congestionControlTest, dctcpTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	flow.setCongestionControl(
+			congestion_control::makeCongestionControl(DCTCP_CC, flow, 10));
+	dctcp_control &dctcp =
+			dynamic_cast<dctcp_control &>(flow.getCongestionControl());
+	ASSERT_TRUE(dctcp.isEcnCapable());
+	ASSERT_FLOAT_EQ(1, dctcp.getAlpha());
+	ASSERT_EQ(10u, flow.popOutstandingPackets(0, 0).size());
+
+	// The first ACK ends a window with nothing marked.
+	ackFlow(flow, 2, 100);
+	double alpha = 1 - 1.0 / 16;
+	ASSERT_FLOAT_EQ(alpha, dctcp.getAlpha());
+	ASSERT_FLOAT_EQ(11, flow.getWindowSize());
+
+	// The first mark cuts the window and ends slow start; the next one,
+	// from the same window, doesn't cut it again.
+	ackFlow(flow, 3, 110, -1, true);
+	double cut = 11 * (1 - alpha / 2);
+	ASSERT_FLOAT_EQ(cut, flow.getLinGrowthWinsizeThreshold());
+	ASSERT_FLOAT_EQ(cut + 1 / cut, flow.getWindowSize());
+	ackFlow(flow, 4, 120, -1, true);
+	ASSERT_LT(cut, flow.getWindowSize());
+
+	// Two of the nine ACKs in the next window were marked.
+	for (int seq = 5; seq <= 11; seq++) {
+		ackFlow(flow, seq, 100 + 10 * seq);
+	}
+	ASSERT_FLOAT_EQ(alpha * (1 - 1.0 / 16) + 2.0 / 9 / 16, dctcp.getAlpha());
+}
+
+/*
+ * Each ACK echoes only the packet that triggered it: duplicate ACKs count,
+ * and the ACK that fills a hole counts once however much it covers.
+ */
+TEST(congestionControlTest, dctcpEchoTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	flow.setCongestionControl(
+			congestion_control::makeCongestionControl(DCTCP_CC, flow, 10));
+	dctcp_control &dctcp =
+			dynamic_cast<dctcp_control &>(flow.getCongestionControl());
+	ASSERT_EQ(10u, flow.popOutstandingPackets(0, 0).size());
+	ackFlow(flow, 2, 100);
+	double alpha = 1 - 1.0 / 16;
+	ASSERT_FLOAT_EQ(alpha, dctcp.getAlpha());
+
+	// Packet 2 is lost. The duplicate ACKs for 3 and 4, one marked, are
+	// two packets delivered, and the ACK for 11 when 2 gets through is one
+	// more, also marked.
+	ackFlow(flow, 2, 110, -1, true);
+	double cut = 11 * (1 - alpha / 2);
+	ASSERT_FLOAT_EQ(cut, flow.getLinGrowthWinsizeThreshold());
+	ackFlow(flow, 2, 120);
+	ackFlow(flow, 11, 130, -1, true);
+	ASSERT_FLOAT_EQ(alpha * (1 - 1.0 / 16) + 2.0 / 3 / 16, dctcp.getAlpha());
+}
+
+/*
+ * On a link that marks, DCTCP keeps the queue short, so its packets wait
+ * much less than Tahoe's, which fill the buffer until it drops them.
+ */
+TEST(congestionControlTest, dctcpSimulationTest) {
+	double avg_rtt[2];
+	const char *names[] = { "tahoe", "dctcp" };
+	for (int i = 0; i < 2; i++) {
+		simulation sim;
+		sim.parse_JSON_input(string("{ \"hosts\": [ \"H1\", \"H2\" ], "
+				"\"routers\": [], "
+				"\"links\": [ { \"id\": \"L1\", \"rate\": 10, "
+				"\"delay\": 10, \"buf_len\": 64, \"full_duplex\": true, "
+				"\"ecn_threshold\": 4, "
+				"\"endpt_1\": \"H1\", \"endpt_2\": \"H2\" } ], "
+				"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+				"\"dst\": \"H2\", \"size\": 20, \"start\": 1.0, "
+				"\"cc\": \"") + names[i] + "\" } ] }");
+		sim.runSimulation();
+		ASSERT_TRUE(sim.allFlowsDone());
+		netflow *flow = sim.getFlows().find("F1");
+		avg_rtt[i] = flow->getAvgRTT();
+		long marked = sim.getLinks().find("L1")->getPacketsMarked();
+		if (i == 0) {
+			ASSERT_EQ(0, marked);
+		}
+		else {
+			ASSERT_LT(0, marked);
+			double alpha = dynamic_cast<dctcp_control &>(
+					flow->getCongestionControl()).getAlpha();
+			ASSERT_LT(0, alpha);
+			ASSERT_GT(0.5, alpha);
+		}
+	}
+	ASSERT_GT(avg_rtt[0] * 0.6, avg_rtt[1]);
+	ASSERT_LT(avg_rtt[1], 1.25 * 20.83); // about the propagation delay
+}
+
+/*
+ * Every algorithm named in the input file gets a flow through, and FAST
+ * gets its periodic window updates.
+ */
+TEST(congestionControlTest, simulationTest) {
+	const char *names[] = { "tahoe", "reno", "newreno", "cubic", "vegas",
+			"fast", "bbr", "dctcp" };
+	for (int i = 0; i < 8; i++) {
+		simulation sim;
+		sim.parse_JSON_input(string("{ \"hosts\": [ \"H1\", \"H2\" ], "
+				"\"routers\": [], "
+				"\"links\": [ { \"id\": \"L1\", \"rate\": 10, "
+				"\"delay\": 10, \"buf_len\": 64, \"endpt_1\": \"H1\", "
+				"\"endpt_2\": \"H2\" } ], "
+				"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+				"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0, "
+				"\"cc\": \"") + names[i] + "\" } ] }");
+		netflow *flow = sim.getFlows().find("F1");
+		ASSERT_EQ(i == 5 ? WINDOW_UPDATE_INTERVAL : 0,
+				flow->getCongestionControl().getUpdateInterval());
+		sim.runSimulation();
+		ASSERT_TRUE(sim.allFlowsDone()) << names[i];
+		ASSERT_LT(1000, flow->getCompletionTimeMs()) << names[i];
+	}
+}
+
+#endif // TEST_CONGESTION_CONTROL_CPP
@@ -0,0 +1,62 @@
+/**
+ * @file
+ *
+ * Tests the element_table class.
+ */
+
+#ifndef TEST_ELEMENT_TABLE_CPP
+#define TEST_ELEMENT_TABLE_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+/*
+ * IDs are handed out in name order starting wherever the caller says, and
+ * both lookups find the same element.
+ */
+TEST(elementTableTest, assignIdsTest) {
+	nethost h1("H1"), h2("H2"), h3("H3");
+	element_table<nethost> hosts;
+	hosts.add(&h3);
+	hosts.add(&h1);
+	hosts.add(&h2);
+	hosts.assignIds(5);
+
+	ASSERT_EQ(3, hosts.size());
+	ASSERT_EQ(5, h1.getId());
+	ASSERT_EQ(6, h2.getId());
+	ASSERT_EQ(7, h3.getId());
+	ASSERT_EQ(&h2, hosts.get(6));
+	ASSERT_EQ(&h3, hosts.find("H3"));
+	ASSERT_EQ(NULL, hosts.find("H4"));
+	ASSERT_EQ(&h1, *hosts.begin());
+
+	nethost stranger("H1");
+	ASSERT_TRUE(hosts.contains(&h1));
+	ASSERT_FALSE(hosts.contains(&stranger));
+	stranger.setId(5);
+	ASSERT_FALSE(hosts.contains(&stranger));
+}
+
+/*
+ * Parsing numbers every kind of element, and nodes share one ID space.
+ */
+TEST(elementTableTest, simulationIdsTest) {
+	simulation sim;
+	sim.parse_JSON_input(TWO_HOP_NETWORK);
+
+	ASSERT_EQ(0, sim.getHosts().find("H1")->getId());
+	ASSERT_EQ(1, sim.getHosts().find("H2")->getId());
+	ASSERT_EQ(2, sim.getRouters().find("R1")->getId());
+	ASSERT_EQ(sim.getRouters().find("R1"), sim.getNodes()[2]);
+	ASSERT_EQ(0, sim.getLinks().find("L1")->getId());
+	ASSERT_EQ(1, sim.getLinks().find("L2")->getId());
+	ASSERT_EQ(0, sim.getFlows().find("F1")->getId());
+}
+
+#endif // TEST_ELEMENT_TABLE_CPP
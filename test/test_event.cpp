@@ -60,4 +60,251 @@ TEST_F(eventTest, printTest) {
 	cout << e1 << endl << e2 << endl << e3 << endl << endl;
 }
 
+/*
+ * Untagged event that records that it ran.
+ */
+class flag_event : public event {
+public:
+	bool *ran;
+
+	flag_event(double time, simulation &sim, bool *ran) :
+		event(time, sim), ran(ran) { }
+
+	void runEvent() { *ran = true; }
+};
+
+/*
+ * Checks that events are tagged with their kind and that untagged events
+ * still run their own runEvent when dispatched.
+ */
+TEST(eventDispatchTest, typeTagTest) {
+	simulation sim;
+	bool ran = false;
+	flag_event generic(0, sim, &ran);
+	ASSERT_EQ(GENERIC_EVENT, generic.getType());
+	generic.dispatch();
+	ASSERT_TRUE(ran);
+
+	router_discovery_event routing(0, sim);
+	ASSERT_EQ(PERIODIC_EVENT, routing.getType());
+}
+
+/*
+ * Periodic event that counts how many times it went off.
+ */
+class counting_event : public periodic_event {
+public:
+	vector<double> *fired;
+	int stop_after;
+
+	counting_event(double time, simulation &sim, double period,
+			double stop_time, vector<double> *fired, int stop_after) :
+				periodic_event(time, sim, period, stop_time), fired(fired),
+				stop_after(stop_after) { }
+
+protected:
+	void fire() {
+		fired->push_back(getTime());
+		if ((int) fired->size() == stop_after) {
+			stop();
+		}
+	}
+};
+
+/**
+ * Two hosts on a CoDel link, so packets go through link_transmit_events,
+ * with a packet-level flow F1 and a fluid flow F2.
+ */
+static const char *DISPATCH_NETWORK = "{ \"hosts\": [ \"H1\", \"H2\" ], "
+		"\"routers\": [], "
+		"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+		"\"buf_len\": 64, \"queue\": \"codel\", "
+		"\"endpt_1\": \"H1\", \"endpt_2\": \"H2\" } ], "
+		"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+		"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0 }, "
+		"{ \"id\": \"F2\", \"src\": \"H1\", \"dst\": \"H2\", "
+		"\"size\": 1, \"start\": 1.0, \"fluid\": true } ] }";
+
+/*
+ * Checks that every tagged event is routed to its own runEvent: each one
+ * is dispatched by hand, in a fresh simulation, and does what only its
+ * class does.
+ */
+TEST(eventDispatchTest, tagRoutingTest) {
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f1 = sim.getFlows().find("F1");
+		start_flow_event e(1000, sim, *f1);
+		ASSERT_EQ(START_FLOW_EVENT, e.getType());
+		e.dispatch();
+		ASSERT_LT(0, f1->getHighestSentSeqnum());
+	}
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f1 = sim.getFlows().find("F1");
+		start_flow_event start(1000, sim, *f1);
+		start.dispatch();
+		timeout_event e(2000, sim, *f1);
+		ASSERT_EQ(TIMEOUT_EVENT, e.getType());
+		double timeout = f1->getTimeoutLengthMs();
+		e.dispatch();
+		ASSERT_FLOAT_EQ(1, f1->getWindowSize());
+		ASSERT_LT(timeout, f1->getTimeoutLengthMs());
+	}
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f1 = sim.getFlows().find("F1");
+		netlink *l1 = sim.getLinks().find("L1");
+		nethost *h1 = sim.getHosts().find("H1");
+		int dir = l1->directionIndex(sim.getHosts().find("H2"));
+		packet pkt(FLOW, *f1, 1);
+		send_packet_event e(1000, sim, *f1, pkt, *l1, *h1);
+		ASSERT_EQ(SEND_PACKET_EVENT, e.getType());
+		e.dispatch();
+		ASSERT_TRUE(l1->isTransmitting(dir));
+	}
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f1 = sim.getFlows().find("F1");
+		netlink *l1 = sim.getLinks().find("L1");
+		nethost *h2 = sim.getHosts().find("H2");
+		int dir = l1->directionIndex(h2);
+		packet pkt(FLOW, *f1, 1);
+		ASSERT_TRUE(l1->enqueuePacket(pkt, h2, 1000));
+		link_transmit_event e(1000, sim, *l1, dir);
+		ASSERT_EQ(LINK_TRANSMIT_EVENT, e.getType());
+		long pending = sim.getNumPendingEvents();
+		e.dispatch();
+		ASSERT_TRUE(l1->isTransmitting(dir));
+		ASSERT_EQ(pending + 2, sim.getNumPendingEvents());
+	}
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f1 = sim.getFlows().find("F1");
+		netlink *l1 = sim.getLinks().find("L1");
+		packet pkt(FLOW, *f1, 1);
+		receive_packet_event e(1000, sim, *f1, pkt, *sim.getHosts().find("H2"),
+				*l1);
+		ASSERT_EQ(RECEIVE_PACKET_EVENT, e.getType());
+		e.dispatch();
+		ASSERT_EQ(1, f1->getPktTally(1000));
+	}
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f1 = sim.getFlows().find("F1");
+		packet ack(ACK, *f1, 2);
+		ack_event e(1000, sim, *f1, ack);
+		ASSERT_EQ(ACK_EVENT, e.getType());
+		long pending = sim.getNumPendingEvents();
+		e.dispatch();
+		ASSERT_EQ(pending + 1, sim.getNumPendingEvents());
+	}
+	{
+		simulation sim;
+		sim.parse_JSON_input(DISPATCH_NETWORK);
+		netflow *f2 = sim.getFlows().find("F2");
+		fluid_update_event *e = new (sim) fluid_update_event(1000, sim);
+		ASSERT_EQ(FLUID_UPDATE_EVENT, e->getType());
+		sim.addEvent(e); // it reschedules itself
+		e->dispatch();
+		ASSERT_LT(0, sim.getFluidModel().getRateMbps(*f2));
+	}
+	{
+		simulation sim;
+		vector<double> fired;
+		counting_event e(7, sim, 10, 100, &fired, 1);
+		ASSERT_EQ(PERIODIC_EVENT, e.getType());
+		e.dispatch();
+		ASSERT_EQ(1u, fired.size());
+		ASSERT_FALSE(e.isScheduled());
+	}
+}
+
+/*
+ * Checks that a periodic event keeps exactly one occurrence queued, goes off
+ * once per period, and ends at its stop time.
+ */
+TEST(periodicEventTest, stopTimeTest) {
+	simulation sim;
+	vector<double> fired;
+	sim.addEvent(new (sim) counting_event(5, sim, 10, 40, &fired, -1));
+
+	while (sim.runNextEvent()) {
+		ASSERT_LE(sim.getNumPendingEvents(), 1);
+	}
+	ASSERT_EQ(4u, fired.size());
+	ASSERT_EQ(5, fired[0]);
+	ASSERT_EQ(35, fired[3]);
+	ASSERT_EQ(0, sim.getEventPool().getNumLive());
+}
+
+/*
+ * Checks that a periodic event can cancel itself, and that a zero period
+ * makes it a one-off.
+ */
+TEST(periodicEventTest, stopTest) {
+	simulation sim;
+	vector<double> fired;
+	vector<double> fired_once;
+	sim.addEvent(new (sim) counting_event(0, sim, 20, 1000, &fired, 3));
+	sim.addEvent(new (sim) counting_event(1, sim, 0, 1000, &fired_once, -1));
+
+	while (sim.runNextEvent()) { }
+	ASSERT_EQ(3u, fired.size());
+	ASSERT_EQ(40, fired[2]);
+	ASSERT_EQ(1u, fired_once.size());
+	ASSERT_EQ(0, sim.getEventPool().getNumLive());
+}
+
+/*
+ * Untagged event that records a link's buffer occupancy when it runs.
+ */
+class occupancy_event : public event {
+public:
+	netlink *link;
+	long *seen;
+
+	occupancy_event(double time, simulation &sim, netlink &link, long *seen) :
+		event(time, sim), link(&link), seen(seen) { }
+
+	void runEvent() { *seen = link->getBufferOccupancy(); }
+};
+
+/*
+ * Checks that a window goes out as one event that sends each packet at its
+ * own time, makes way for an event due between two of its packets, and
+ * shares arrival events between packets sent without a break.
+ */
+TEST(packetTrainTest, sendWindowTest) {
+	simulation sim;
+	sim.parse_JSON_input(TWO_HOP_NETWORK);
+	netflow *flow = sim.getFlows().find("F1");
+	netlink *l1 = sim.getLinks().find("L1");
+	vector<packet> pkts;
+	for (int seq = 1; seq <= 3; seq++) {
+		pkts.push_back(packet(FLOW, *flow, seq));
+	}
+	long seen = -1;
+	sim.addEvent(new (sim) occupancy_event(0.7, sim, *l1, &seen));
+	send_packet_event::sendWindow(0, 0.5, sim, *flow, pkts);
+	ASSERT_EQ(2, sim.getNumPendingEvents());
+
+	// The first two packets go out, then the other event's turn comes.
+	ASSERT_TRUE(sim.runNextEvent());
+	ASSERT_EQ(2 * FLOW_PACKET_SIZE, l1->getBufferOccupancy());
+	ASSERT_TRUE(sim.runNextEvent());
+	ASSERT_EQ(2 * FLOW_PACKET_SIZE, seen);
+	ASSERT_TRUE(sim.runNextEvent());
+	ASSERT_EQ(3 * FLOW_PACKET_SIZE, l1->getBufferOccupancy());
+
+	// One arrival event for the first two packets, one for the third.
+	ASSERT_EQ(2, sim.getNumPendingEvents());
+}
+
 #endif // TEST_EVENT_CPP
@@ -0,0 +1,101 @@
+/**
+ * @file
+ *
+ * Tests the event pool and the event allocation operators that use it.
+ */
+
+#ifndef TEST_EVENT_POOL_CPP
+#define TEST_EVENT_POOL_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Checks that freed blocks are handed out again instead of carving new ones,
+ * and that blocks of different sizes don't get mixed up.
+ */
+TEST(eventPoolTest, reuseTest) {
+	event_pool pool;
+
+	void *a = pool.allocate(100);
+	void *b = pool.allocate(40);
+	ASSERT_EQ(2, pool.getNumLive());
+	ASSERT_EQ(1, pool.getNumSlabs());
+
+	pool.release(a, 100);
+	ASSERT_EQ(1, pool.getNumLive());
+
+	// Same size class comes back, a different one doesn't.
+	void *c = pool.allocate(48);
+	ASSERT_TRUE(c != a);
+	ASSERT_EQ(a, pool.allocate(97));
+
+	pool.release(a, 97);
+	pool.release(b, 40);
+	pool.release(c, 48);
+	ASSERT_EQ(0, pool.getNumLive());
+}
+
+/*
+ * Allocates and frees many blocks in waves, like a simulation does, and
+ * checks the pool stops growing after the first wave.
+ */
+TEST(eventPoolTest, steadyStateTest) {
+	event_pool pool;
+	vector<void *> blocks;
+
+	for (int wave = 0; wave < 10; wave++) {
+		for (int i = 0; i < 5000; i++) {
+			void *p = pool.allocate(200);
+			ASSERT_EQ(0u, ((unsigned long) p) % 16);
+			blocks.push_back(p);
+		}
+		for (unsigned int i = 0; i < blocks.size(); i++) {
+			pool.release(blocks[i], 200);
+		}
+		blocks.clear();
+	}
+	ASSERT_EQ(0, pool.getNumLive());
+	ASSERT_LE(pool.getNumSlabs(), 5000 * 208 / (64 * 1024) + 1);
+}
+
+/*
+ * Blocks too big for the slabs come from the global heap but are still
+ * counted.
+ */
+TEST(eventPoolTest, bigBlockTest) {
+	event_pool pool;
+	void *p = pool.allocate(100000);
+	ASSERT_EQ(1, pool.getNumLive());
+	ASSERT_EQ(0, pool.getNumSlabs());
+	pool.release(p, 100000);
+	ASSERT_EQ(0, pool.getNumLive());
+}
+
+/*
+ * Events made with the pool version of new come from the simulation's pool
+ * and plain delete gives them back; other events don't touch it.
+ */
+TEST(eventPoolTest, eventAllocationTest) {
+	simulation sim;
+
+	event *pooled = new (sim) event(1, sim);
+	event *global = new event(2, sim);
+	ASSERT_EQ(1, sim.getEventPool().getNumLive());
+
+	delete pooled;
+	delete global;
+	ASSERT_EQ(0, sim.getEventPool().getNumLive());
+
+	// The freed block is reused by the next event of the same size.
+	event *again = new (sim) event(3, sim);
+	ASSERT_EQ(pooled, again);
+	delete again;
+}
+
+#endif // TEST_EVENT_POOL_CPP
@@ -0,0 +1,57 @@
+/**
+ * @file
+ *
+ * Tests how flows report their completion to the simulation.
+ */
+
+#ifndef TEST_FLOW_COMPLETION_CPP
+#define TEST_FLOW_COMPLETION_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+/*
+ * The simulation's count of unfinished flows drops and the callback gets
+ * the completion time exactly once, when the packet that finishes a flow
+ * arrives.
+ */
+TEST(flowCompletionTest, callbackTest) {
+	simulation sim;
+	sim.parse_JSON_input("{ \"hosts\": [ \"H1\", \"H2\" ], "
+			"\"routers\": [], "
+			"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"H2\" } ], "
+			"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+			"\"dst\": \"H2\", \"size\": 0.04, \"start\": 1.0, "
+			"\"FAST\": false } ] }");
+
+	vector<double> completions;
+	sim.setFlowCompletionCallback([&](netflow &flow, double time_ms) {
+		completions.push_back(time_ms);
+	});
+
+	netflow *flow = sim.getFlows().find("F1");
+	ASSERT_FALSE(sim.allFlowsDone());
+	ASSERT_EQ(-1, flow->getCompletionTimeMs());
+
+	// Deliver every packet a millisecond apart, then deliver them all again;
+	// the duplicates mustn't count.
+	for (int round = 0; round < 2; round++) {
+		for (int seq = 1; seq < flow->getNumTotalPackets(); seq++) {
+			packet pkt(FLOW, *flow, seq);
+			flow->receivedFlowPacket(pkt, 100 * round + seq);
+		}
+	}
+	ASSERT_TRUE(sim.allFlowsDone());
+	ASSERT_EQ(1u, completions.size());
+	ASSERT_EQ(completions[0], flow->getCompletionTimeMs());
+	ASSERT_LT(0, completions[0]);
+	ASSERT_GT(100, completions[0]);
+}
+
+#endif // TEST_FLOW_COMPLETION_CPP
@@ -0,0 +1,158 @@
+/**
+ * @file
+ *
+ * Tests the fluid model and fluid flows.
+ */
+
+#ifndef TEST_FLUID_MODEL_CPP
+#define TEST_FLUID_MODEL_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Two hosts behind a router with two flows between them, which the tests
+ * make fluid or not by filling in the blanks.
+ */
+static string fluidNetwork(const string &f1_extra, const string &f2_extra) {
+	return string("{ \"hosts\": [ \"H1\", \"H2\" ], "
+			"\"routers\": [ \"R1\" ], "
+			"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"R1\" }, "
+			"{ \"id\": \"L2\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"R1\", \"endpt_2\": \"H2\" } ], "
+			"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+			"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0, "
+			"\"FAST\": false") + f1_extra + " }, "
+			"{ \"id\": \"F2\", \"src\": \"H1\", "
+			"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0, "
+			"\"FAST\": false" + f2_extra + " } ] }";
+}
+
+/*
+ * The path between the hosts goes through the router, using each link's
+ * transmitter towards the destination.
+ */
+TEST(fluidModelTest, findPathTest) {
+	simulation sim;
+	sim.parse_JSON_input(fluidNetwork("", ""));
+	netnode *h1 = sim.getHosts().find("H1");
+	netnode *h2 = sim.getHosts().find("H2");
+	netnode *r1 = sim.getRouters().find("R1");
+	netlink *l1 = sim.getLinks().find("L1");
+	netlink *l2 = sim.getLinks().find("L2");
+
+	vector<netlink *> links;
+	vector<int> dirs;
+	ASSERT_TRUE(fluid_model::findPath(*h1, *h2, 3, links, dirs));
+	ASSERT_EQ(2u, links.size());
+	ASSERT_EQ(l1, links[0]);
+	ASSERT_EQ(l2, links[1]);
+	ASSERT_EQ(l1->directionIndex(r1), dirs[0]);
+	ASSERT_EQ(l2->directionIndex(h2), dirs[1]);
+
+	ASSERT_TRUE(fluid_model::findPath(*h2, *h1, 3, links, dirs));
+	ASSERT_EQ(l2, links[0]);
+	ASSERT_EQ(l2->directionIndex(r1), dirs[0]);
+}
+
+/*
+ * Fluid flows get max-min fair rates that respect their caps, and the links
+ * carry the total as background load that slows packets down.
+ */
+TEST(fluidModelTest, maxMinTest) {
+	simulation sim;
+	sim.parse_JSON_input(fluidNetwork(", \"fluid\": true",
+			", \"fluid\": true, \"max_rate\": 2"));
+	netflow *f1 = sim.getFlows().find("F1");
+	netflow *f2 = sim.getFlows().find("F2");
+	netlink *l1 = sim.getLinks().find("L1");
+	netnode *r1 = sim.getRouters().find("R1");
+	fluid_model &model = sim.getFluidModel();
+	ASSERT_TRUE(model.hasFluidFlows());
+	ASSERT_FLOAT_EQ(1000, model.getFirstStartTime());
+
+	// Nothing's started yet, so the next change is when both start.
+	ASSERT_FLOAT_EQ(1000, model.update(0));
+	ASSERT_EQ(0, model.getRateMbps(*f1));
+	ASSERT_EQ(0, l1->getBackgroundRate(l1->directionIndex(r1)));
+
+	double next = model.update(1000);
+	ASSERT_FLOAT_EQ(2, model.getRateMbps(*f2));
+	ASSERT_FLOAT_EQ(10 * FLUID_MAX_UTILIZATION - 2, model.getRateMbps(*f1));
+	ASSERT_FLOAT_EQ(1000 + 1000 / (10 * FLUID_MAX_UTILIZATION - 2), next);
+	int dir = l1->directionIndex(r1);
+	ASSERT_FLOAT_EQ(l1->getRateBytesPerMs() * FLUID_MAX_UTILIZATION,
+			l1->getBackgroundRate(dir));
+	// The link is half-duplex, so the load keeps the other way busy too.
+	ASSERT_FLOAT_EQ(l1->getBackgroundRate(dir),
+			l1->getBackgroundRate(1 - dir));
+	// But it's only counted once in the link's rate.
+	ASSERT_FLOAT_EQ(l1->getBackgroundRate(dir) * MS_PER_SEC * 8 / 1000000,
+			sim.logLinkMetric(*l1, 1000)["LinkRate"].get<double>());
+
+	packet pkt(FLOW, *f1, 1);
+	ASSERT_FLOAT_EQ(l1->getTransmissionTimeMs(pkt) /
+			(1 - FLUID_MAX_UTILIZATION),
+			l1->getTransmissionTimeMs(pkt, r1));
+
+	// When F1 finishes, F2 keeps its capped rate and the load drops to it.
+	model.update(next);
+	ASSERT_TRUE(f1->doneTransmitting());
+	ASSERT_FLOAT_EQ(next + 20, f1->getCompletionTimeMs());
+	ASSERT_EQ(0, model.getRateMbps(*f1));
+	ASSERT_FLOAT_EQ(2, model.getRateMbps(*f2));
+	ASSERT_FALSE(sim.allFlowsDone());
+}
+
+/*
+ * A simulation of only fluid flows finishes them about when their size over
+ * their rate says, plus the path's delay.
+ */
+TEST(fluidModelTest, fluidOnlyTest) {
+	simulation sim;
+	sim.parse_JSON_input(fluidNetwork(", \"fluid\": true",
+			", \"fluid\": true"));
+	sim.runSimulation();
+	ASSERT_TRUE(sim.allFlowsDone());
+	double expected = 1000 + 2 * 1000 / (10 * FLUID_MAX_UTILIZATION) + 20;
+	ASSERT_NEAR(expected, sim.getFlows().find("F1")->getCompletionTimeMs(),
+			1e-6);
+	ASSERT_NEAR(expected, sim.getFlows().find("F2")->getCompletionTimeMs(),
+			1e-6);
+}
+
+/*
+ * A packet-level flow sharing the path with a fluid flow finishes, later
+ * than it would alone.
+ */
+TEST(fluidModelTest, mixedTest) {
+	simulation shared;
+	shared.parse_JSON_input(fluidNetwork(", \"fluid\": true", ""));
+	simulation solo;
+	solo.parse_JSON_input(string("{ \"hosts\": [ \"H1\", \"H2\" ], "
+			"\"routers\": [ \"R1\" ], "
+			"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"R1\" }, "
+			"{ \"id\": \"L2\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"R1\", \"endpt_2\": \"H2\" } ], "
+			"\"flows\": [ { \"id\": \"F2\", \"src\": \"H1\", "
+			"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0, "
+			"\"FAST\": false } ] }"));
+	solo.runSimulation();
+	shared.runSimulation();
+
+	ASSERT_TRUE(shared.allFlowsDone());
+	double solo_time = solo.getFlows().find("F2")->getCompletionTimeMs();
+	double shared_time = shared.getFlows().find("F2")->getCompletionTimeMs();
+	ASSERT_LT(solo_time, shared_time);
+	ASSERT_LT(0, shared.getFlows().find("F1")->getCompletionTimeMs());
+}
+
+#endif // TEST_FLUID_MODEL_CPP
@@ -56,9 +56,9 @@ TEST_F(packetTest, constructorTest) {
 	r2.addLink(l12); r2.addLink(l31);
 	r3.addLink(l12); r3.addLink(l31);
 
-	packet p4(ROUTING, r1.getName(), r2.getName());
-	packet p5(ROUTING, r2.getName(), r3.getName());
-	packet p6(ROUTING, r1.getName(), r3.getName());
+	packet p4(ROUTING, r1, r2);
+	packet p5(ROUTING, r2, r3);
+	packet p6(ROUTING, r1, r3);
 
 	ASSERT_EQ(FLOW, p1.getType());
 	ASSERT_EQ(ACK, p2.getType());
@@ -80,4 +80,117 @@ TEST_F(packetTest, constructorTest) {
 	ASSERT_LT(p4.getSeq(), 0);
 }
 
+/*
+ * Packets name their endpoints by node ID, which the simulation hands out
+ * to hosts then routers, each in name order.
+ */
+TEST_F(packetTest, nodeIdTest) {
+	simulation sim;
+	sim.parse_JSON_input("{ \"hosts\": [ \"H2\", \"H1\" ], "
+			"\"routers\": [ \"R1\" ], "
+			"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"R1\" }, "
+			"{ \"id\": \"L2\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"R1\", \"endpt_2\": \"H2\" } ], "
+			"\"flows\": [ { \"id\": \"F1\", \"src\": \"H2\", "
+			"\"dst\": \"H1\", \"size\": 0.04, \"start\": 1.0, "
+			"\"FAST\": false } ] }");
+
+	const vector<netnode *> &nodes = sim.getNodes();
+	ASSERT_EQ(3u, nodes.size());
+	ASSERT_EQ("H1", nodes[0]->getName());
+	ASSERT_EQ("H2", nodes[1]->getName());
+	ASSERT_EQ("R1", nodes[2]->getName());
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		ASSERT_EQ((int) i, nodes[i]->getId());
+	}
+
+	netflow &flow = *sim.getFlows().find("F1");
+	packet data(FLOW, flow, 1);
+	packet ack(ACK, flow, 1);
+	ASSERT_EQ(1, data.getSourceId());
+	ASSERT_EQ(0, data.getDestinationId());
+	ASSERT_EQ(0, ack.getSourceId());
+	ASSERT_EQ(1, ack.getDestinationId());
+	ASSERT_EQ(NULL, data.getDistances());
+}
+
+/*
+ * A routing packet's distances live outside the packet and go away when
+ * the last holder lets go of them.
+ */
+TEST_F(packetTest, distancePayloadTest) {
+	netrouter r1("R1");
+	netrouter r2("R2");
+	packet rpack(ROUTING, r1, r2);
+	rpack.setDistances(new distance_vector(vector<double>(3, 1.5)));
+
+	// Copies share the payload instead of duplicating it.
+	packet copy = rpack;
+	ASSERT_EQ(rpack.getDistances(), copy.getDistances());
+	ASSERT_EQ(3u, copy.getDistances()->getDistances().size());
+	ASSERT_EQ(1.5, copy.getDistances()->getDistances()[2]);
+
+	rpack.retainPayload();
+	copy.retainPayload();
+	rpack.releasePayload();
+	copy.releasePayload(); // frees it
+}
+
+/*
+ * Routers hand their own distances to the routing packets they send, and
+ * only copy them when a change comes in while a packet still holds them.
+ */
+TEST_F(packetTest, sharedDistancesTest) {
+	simulation sim;
+	sim.parse_JSON_input("{ \"hosts\": [ \"H1\", \"H2\" ], "
+			"\"routers\": [ \"R1\", \"R2\" ], "
+			"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"R1\" }, "
+			"{ \"id\": \"L2\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"R1\", \"endpt_2\": \"R2\" }, "
+			"{ \"id\": \"L3\", \"rate\": 10, \"delay\": 10, "
+			"\"buf_len\": 64, \"endpt_1\": \"R2\", \"endpt_2\": \"H2\" } ], "
+			"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+			"\"dst\": \"H2\", \"size\": 0.04, \"start\": 1.0, "
+			"\"FAST\": false } ] }");
+	netrouter *r1 = sim.getRouters().find("R1");
+	netrouter *r2 = sim.getRouters().find("R2");
+	netlink *l2 = sim.getLinks().find("L2");
+	int h2 = sim.getHosts().find("H2")->getId();
+	r1->initializeTables(sim.getNodes());
+	r2->initializeTables(sim.getNodes());
+
+	// Nothing to reset yet, so nothing gets copied.
+	const distance_vector *initial = r1->getDistanceVector();
+	r1->resetDistances();
+	ASSERT_EQ(initial, r1->getDistanceVector());
+
+	// A packet in flight keeps R1's old distances when R2's news comes in.
+	packet held(ROUTING, *r1, *r2);
+	held.setDistances(initial);
+	held.retainPayload();
+
+	packet news(ROUTING, *r2, *r1);
+	news.setDistances(r2->getDistanceVector());
+	news.setTransmitTimestamp(0);
+	r1->receiveRoutingPacket(1, sim, news, *l2);
+
+	ASSERT_NE(initial, r1->getDistanceVector());
+	ASSERT_EQ(1, r1->getRDistances()[h2]);
+	ASSERT_EQ(numeric_limits<double>::max(), initial->getDistances()[h2]);
+	netflow &flow = *sim.getFlows().find("F1");
+	ASSERT_EQ(l2, r1->receivePacket(1, sim, flow, packet(FLOW, flow, 1)));
+
+	// Once every routing packet is delivered nothing else holds R1's
+	// distances, so later changes are made in place.
+	held.releasePayload();
+	while (sim.runNextEvent()) { }
+	const distance_vector *updated = r1->getDistanceVector();
+	ASSERT_FALSE(updated->isShared());
+	r1->resetDistances();
+	ASSERT_EQ(updated, r1->getDistanceVector());
+	ASSERT_EQ(numeric_limits<double>::max(), r1->getRDistances()[h2]);
+}
+
 #endif // TEST_PACKET_CPP
@@ -0,0 +1,399 @@
+/**
+ * @file
+ *
+ * Tests the queue disciplines and links that use them.
+ */
+
+#ifndef TEST_QUEUE_DISCIPLINE_CPP
+#define TEST_QUEUE_DISCIPLINE_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+ * A drop-tail queue hands packets back in order and turns them away once
+ * its bytes are used up.
+ */
+TEST(queueDisciplineTest, dropTailTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	queue_config config;
+	queue_discipline *q =
+			queue_discipline::makeQueueDiscipline(config, 2048, 1250, 1);
+
+	packet p1(FLOW, flow, 1), p2(FLOW, flow, 2), p3(ACK, flow, 1);
+	ASSERT_TRUE(q->enqueue(p1, 0, 0));
+	ASSERT_TRUE(q->enqueue(p2, 1, 1));
+	ASSERT_FALSE(q->enqueue(p3, 0, 2));
+	ASSERT_EQ(1, q->getDrops());
+	ASSERT_EQ(2048, q->getBacklogBytes());
+
+	waiting_packet out;
+	ASSERT_TRUE(q->dequeue(3, out));
+	ASSERT_EQ(p1.getId(), out.pkt.getId());
+	ASSERT_EQ(0, out.direction);
+	ASSERT_TRUE(q->dequeue(3, out));
+	ASSERT_EQ(p2.getId(), out.pkt.getId());
+	ASSERT_EQ(1, out.direction);
+	ASSERT_FLOAT_EQ(1, out.enqueue_time);
+	ASSERT_FALSE(q->dequeue(3, out));
+	ASSERT_EQ(0, q->getNumPackets());
+	delete q;
+}
+
+/*
+ * RED leaves a short queue alone but starts dropping before the buffer is
+ * full once the average backlog builds up, and makes the same choices
+ * given the same seed.
+ */
+TEST(queueDisciplineTest, redTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	queue_config config;
+	ASSERT_TRUE(queue_discipline::parseQueueType("red", config.type));
+	config.red_weight = 0.2;
+
+	long drops[2];
+	for (int run = 0; run < 2; run++) {
+		queue_discipline *q = queue_discipline::makeQueueDiscipline(
+				config, 64 * BYTES_PER_KB, 1250, 7);
+		waiting_packet out;
+
+		// One packet at a time never builds an average.
+		for (int i = 0; i < 100; i++) {
+			packet pkt(FLOW, flow, i);
+			ASSERT_TRUE(q->enqueue(pkt, 0, i));
+			ASSERT_TRUE(q->dequeue(i, out));
+		}
+
+		// Arrivals with no departures: drops start well short of full.
+		long accepted = 0;
+		for (int i = 0; i < 64; i++) {
+			packet pkt(FLOW, flow, i);
+			if (q->enqueue(pkt, 0, 100)) {
+				accepted++;
+			}
+		}
+		ASSERT_LT(0, q->getDrops());
+		ASSERT_GT(64, accepted);
+		ASSERT_LT(q->getBacklogBytes(), 64 * BYTES_PER_KB);
+		drops[run] = q->getDrops();
+		delete q;
+	}
+	ASSERT_EQ(drops[0], drops[1]);
+}
+
+/*
+ * CoDel drops nothing while the queue drains quickly, and starts dropping
+ * from the head once packets have been waiting longer than the target for
+ * a whole interval.
+ */
+TEST(queueDisciplineTest, codelTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	queue_config config;
+	ASSERT_TRUE(queue_discipline::parseQueueType("codel", config.type));
+	queue_discipline *q = queue_discipline::makeQueueDiscipline(
+			config, 1024 * BYTES_PER_KB, 1250, 1);
+	waiting_packet out;
+
+	// Quick turnaround: no drops.
+	for (int i = 0; i < 100; i++) {
+		packet pkt(FLOW, flow, i);
+		ASSERT_TRUE(q->enqueue(pkt, 0, i));
+		ASSERT_TRUE(q->enqueue(pkt, 0, i));
+		ASSERT_TRUE(q->dequeue(i + 1, out));
+		ASSERT_TRUE(q->dequeue(i + 1, out));
+	}
+	ASSERT_EQ(0, q->getDrops());
+
+	// A standing queue: two packets in per ms, one out, so the delay grows.
+	long sent = 0;
+	for (int i = 100; i < 400; i++) {
+		packet p1(FLOW, flow, 2 * i), p2(FLOW, flow, 2 * i + 1);
+		q->enqueue(p1, 0, i);
+		q->enqueue(p2, 0, i);
+		if (q->dequeue(i, out)) {
+			sent++;
+		}
+		if (i < 100 + config.codel_interval_ms) {
+			ASSERT_EQ(0, q->getDrops());
+		}
+	}
+	ASSERT_LT(0, q->getDrops());
+	ASSERT_EQ(300, sent);
+	delete q;
+}
+
+/*
+ * FQ-CoDel lets a sparse flow's packet go ahead of a bulk flow's backlog,
+ * and takes turns between two bulk flows.
+ */
+TEST(queueDisciplineTest, fqCodelTest) {
+	simulation sim;
+	sim.parse_JSON_input(TWO_HOP_NETWORK);
+	netflow *f1 = sim.getFlows().find("F1");
+	nethost h1("H1"), h2("H2");
+	netflow f2("F2", 1, 20, h1, h2, false, sim);
+	f2.setId(1);
+
+	queue_config config;
+	ASSERT_TRUE(queue_discipline::parseQueueType("fq_codel", config.type));
+	queue_discipline *q = queue_discipline::makeQueueDiscipline(
+			config, 64 * BYTES_PER_KB, 1250, 1);
+	for (int i = 0; i < 10; i++) {
+		packet pkt(FLOW, *f1, i);
+		ASSERT_TRUE(q->enqueue(pkt, 0, 0));
+	}
+	waiting_packet out;
+	ASSERT_TRUE(q->dequeue(0, out));
+	ASSERT_EQ(0, out.pkt.getSeq());
+
+	// The ACK's queue is new, the bulk flow's isn't any more.
+	packet ack(ACK, *f1, 1);
+	ASSERT_TRUE(q->enqueue(ack, 1, 0));
+	ASSERT_TRUE(q->dequeue(0, out));
+	ASSERT_EQ(ACK, out.pkt.getType());
+
+	// A second bulk flow gets every other turn.
+	for (int i = 0; i < 4; i++) {
+		packet pkt(FLOW, f2, i);
+		ASSERT_TRUE(q->enqueue(pkt, 0, 0));
+	}
+	int f2_turns = 0;
+	for (int i = 0; i < 6; i++) {
+		ASSERT_TRUE(q->dequeue(0, out));
+		if (out.pkt.getParentFlow() == &f2) {
+			f2_turns++;
+		}
+	}
+	ASSERT_EQ(3, f2_turns);
+	ASSERT_EQ(7, q->getNumPackets());
+	delete q;
+}
+
+/*
+ * Links with a queue discipline hold packets until the transmitter gets
+ * to them, and a transfer over them still completes.
+ */
+TEST(queueDisciplineTest, linkTest) {
+	const char *names[] = { "red", "codel", "fq_codel" };
+	for (int i = 0; i < 3; i++) {
+		string network = string(TWO_HOP_NETWORK);
+		string link_end = "\"endpt_2\": \"R1\"";
+		network.insert(network.find(link_end) + link_end.size(),
+				string(", \"queue\": \"") + names[i] + "\"");
+		simulation sim;
+		sim.parse_JSON_input(network);
+		netlink *l1 = sim.getLinks().find("L1");
+		ASSERT_TRUE(l1->hasQueueDiscipline());
+		ASSERT_FALSE(sim.getLinks().find("L2")->hasQueueDiscipline());
+
+		// Two packets: one goes straight out, the other waits its turn.
+		netflow *flow = sim.getFlows().find("F1");
+		packet p1(FLOW, *flow, 1), p2(FLOW, *flow, 2);
+		ASSERT_TRUE(l1->enqueuePacket(p1, l1->getEndpoint2(), 0));
+		ASSERT_TRUE(l1->enqueuePacket(p2, l1->getEndpoint2(), 0));
+		ASSERT_EQ(2048, l1->getBufferOccupancy());
+		packet sent;
+		netnode *destination;
+		double done, arrival;
+		ASSERT_TRUE(l1->startNextTransmission(0, 0, sent, destination,
+				done, arrival));
+		ASSERT_EQ(p1.getId(), sent.getId());
+		ASSERT_EQ(l1->getEndpoint2(), destination);
+		ASSERT_FLOAT_EQ(l1->getTransmissionTimeMs(p1), done);
+		ASSERT_FLOAT_EQ(done + l1->getDelay(), arrival);
+		ASSERT_TRUE(l1->isTransmitting(0));
+		ASSERT_EQ(1024, l1->getBufferOccupancy());
+		ASSERT_TRUE(l1->startNextTransmission(0, done, sent, destination,
+				done, arrival));
+		ASSERT_FALSE(l1->startNextTransmission(0, done, sent, destination,
+				done, arrival));
+		ASSERT_FALSE(l1->isTransmitting(0));
+	}
+
+	for (int i = 0; i < 3; i++) {
+		string network = string(TWO_HOP_NETWORK);
+		string link_end = "\"endpt_2\": \"H2\"";
+		network.insert(network.find(link_end) + link_end.size(),
+				string(", \"queue\": { \"type\": \"") + names[i] + "\" }");
+		simulation sim;
+		sim.parse_JSON_input(network);
+		sim.runSimulation();
+		ASSERT_LT(1000, sim.getFlows().find("F1")->getCompletionTimeMs());
+	}
+}
+
+/*
+ * Strict priority sends routing packets, then ACKs, then data, whatever
+ * order they came in, and counts each class separately.
+ */
+TEST(queueDisciplineTest, prioTest) {
+	simulation sim;
+	sim.parse_JSON_input(TWO_HOP_NETWORK);
+	netflow *flow = sim.getFlows().find("F1");
+	netnode *h1 = sim.getHosts().find("H1");
+	netnode *r1 = sim.getRouters().find("R1");
+
+	queue_config config;
+	ASSERT_TRUE(queue_discipline::parseQueueType("prio", config.type));
+	queue_discipline *q = queue_discipline::makeQueueDiscipline(
+			config, 4 * BYTES_PER_KB, 1250, 1);
+	packet f1(FLOW, *flow, 1), f2(FLOW, *flow, 2), a1(ACK, *flow, 1);
+	packet r(ROUTING, *h1, *r1);
+	ASSERT_TRUE(q->enqueue(f1, 0, 0));
+	ASSERT_TRUE(q->enqueue(a1, 0, 0));
+	ASSERT_TRUE(q->enqueue(f2, 0, 0));
+	ASSERT_TRUE(q->enqueue(r, 0, 0));
+
+	packet_type expected[] = { ROUTING, ACK, FLOW, FLOW };
+	waiting_packet out;
+	for (int i = 0; i < 4; i++) {
+		ASSERT_TRUE(q->dequeue(0, out));
+		ASSERT_EQ(expected[i], out.pkt.getType());
+	}
+	ASSERT_EQ(f2.getId(), out.pkt.getId());
+	ASSERT_FALSE(q->dequeue(0, out));
+
+	// The classes share the buffer: 4 data packets leave no room for
+	// anything else.
+	for (int i = 3; i < 7; i++) {
+		packet pkt(FLOW, *flow, i);
+		ASSERT_TRUE(q->enqueue(pkt, 0, 0));
+	}
+	ASSERT_FALSE(q->enqueue(f1, 0, 0));
+	ASSERT_FALSE(q->enqueue(a1, 0, 0));
+	ASSERT_FALSE(q->enqueue(r, 0, 0));
+
+	const class_queue *classes = dynamic_cast<class_queue *>(q);
+	ASSERT_TRUE(classes != NULL);
+	ASSERT_EQ(3, classes->getNumClasses());
+	ASSERT_EQ("ack", classes->getClassName(1));
+	ASSERT_EQ(2, classes->getClassStats(2).packets_sent);
+	ASSERT_EQ(1, classes->getClassStats(2).drops);
+	ASSERT_EQ(1, classes->getClassStats(1).drops);
+	ASSERT_EQ(1, classes->getClassStats(0).drops);
+	ASSERT_EQ(4 * 1024, classes->getClassStats(2).backlog_bytes);
+	delete q;
+}
+
+/*
+ * DRR shares the link between classes in proportion to their quanta, and
+ * sorts flows by their traffic class when asked.
+ */
+TEST(queueDisciplineTest, drrTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow bulk("F1", 1, 20, h1, h2, false, sim);
+	netflow fast("F2", 1, 20, h1, h2, false, sim);
+	fast.setTrafficClass(1);
+
+	queue_config config;
+	ASSERT_TRUE(queue_discipline::parseQueueType("drr", config.type));
+	config.classify = CLASS_BY_FLOW;
+	config.num_classes = 3;
+	config.quanta.push_back(1024);
+	config.quanta.push_back(1024);
+	config.quanta.push_back(3 * 1024);
+	queue_discipline *q = queue_discipline::makeQueueDiscipline(
+			config, 64 * BYTES_PER_KB, 1250, 1);
+	for (int i = 0; i < 20; i++) {
+		packet b(FLOW, bulk, i), f(FLOW, fast, i);
+		ASSERT_TRUE(q->enqueue(b, 0, 0));
+		ASSERT_TRUE(q->enqueue(f, 0, 0));
+	}
+
+	int fast_sent = 0;
+	waiting_packet out;
+	for (int i = 0; i < 16; i++) {
+		ASSERT_TRUE(q->dequeue(0, out));
+		if (out.pkt.getParentFlow() == &fast) {
+			fast_sent++;
+		}
+	}
+	ASSERT_EQ(12, fast_sent);
+
+	const class_queue *classes = dynamic_cast<class_queue *>(q);
+	ASSERT_EQ("flow class 1", classes->getClassName(2));
+	ASSERT_EQ(4, classes->getClassStats(1).packets_sent);
+	ASSERT_EQ(0, classes->getClassStats(0).packets_sent);
+	delete q;
+}
+
+/*
+ * On a congested link, strict priority gets the routing updates through
+ * well ahead of the data; and the link metrics report each class.
+ */
+TEST(queueDisciplineTest, prioLinkTest) {
+	string network = string(TWO_HOP_NETWORK);
+	string link_end = "\"endpt_2\": \"R1\"";
+	network.insert(network.find(link_end) + link_end.size(),
+			", \"queue\": \"prio\"");
+	simulation sim;
+	sim.parse_JSON_input(network);
+	netlink *l1 = sim.getLinks().find("L1");
+	netflow *flow = sim.getFlows().find("F1");
+	netnode *h1 = sim.getHosts().find("H1");
+
+	for (int i = 0; i < 10; i++) {
+		packet pkt(FLOW, *flow, i);
+		send_packet_event *e = new (sim) send_packet_event(
+				0, sim, *flow, pkt, *l1, *h1);
+		sim.addEvent(e);
+	}
+	packet update(ROUTING, *h1, *l1->getEndpoint2());
+	send_packet_event *e = new (sim) send_packet_event(
+			0.5, sim, update, *l1, *h1);
+	sim.addEvent(e);
+
+	// The first data packet is on the wire; the update goes next.
+	while (sim.runNextEvent() && l1->getQueueDiscipline(0)->getNumPackets() <
+			10) { }
+	const class_queue *classes =
+			dynamic_cast<const class_queue *>(l1->getQueueDiscipline(0));
+	ASSERT_EQ(1, classes->getClassStats(0).num_packets);
+	ASSERT_EQ(9, classes->getClassStats(2).num_packets);
+
+	json metric = sim.logLinkMetric(*l1, 1);
+	ASSERT_EQ(3u, metric["Classes"].size());
+	ASSERT_EQ("routing", metric["Classes"][0]["Class"]);
+	ASSERT_TRUE(sim.logLinkMetric(*sim.getLinks().find("L2"), 1)
+			.count("Classes") == 0);
+}
+
+/*
+ * A link with a queue discipline marks against the discipline's backlog,
+ * and its metrics count the marks.
+ */
+TEST(queueDisciplineTest, ecnTest) {
+	string network = string(TWO_HOP_NETWORK);
+	string link_end = "\"endpt_2\": \"R1\"";
+	network.insert(network.find(link_end) + link_end.size(),
+			", \"queue\": \"codel\", \"ecn_threshold\": 1");
+	simulation sim;
+	sim.parse_JSON_input(network);
+	netlink *l1 = sim.getLinks().find("L1");
+	netflow *flow = sim.getFlows().find("F1");
+
+	packet p1(FLOW, *flow, 1), p2(FLOW, *flow, 2);
+	p1.setEcnCapable(true);
+	p2.setEcnCapable(true);
+	ASSERT_TRUE(l1->enqueuePacket(p1, l1->getEndpoint2(), 0));
+	ASSERT_TRUE(l1->enqueuePacket(p2, l1->getEndpoint2(), 0));
+	ASSERT_FALSE(p1.isEcnMarked());
+	ASSERT_TRUE(p2.isEcnMarked());
+
+	ASSERT_EQ(1, sim.logLinkMetric(*l1, 0)["PktsMarked"]);
+	ASSERT_TRUE(sim.logLinkMetric(*sim.getLinks().find("L2"), 0)
+			.count("PktsMarked") == 0);
+}
+
+#endif // TEST_QUEUE_DISCIPLINE_CPP
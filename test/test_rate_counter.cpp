@@ -0,0 +1,91 @@
+/**
+ * @file
+ *
+ * Tests the sliding-window rate counter and the link and flow rates built
+ * on it.
+ */
+
+#ifndef TEST_RATE_COUNTER_CPP
+#define TEST_RATE_COUNTER_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+ * Amounts count while they're in the window and drop out one bucket at a
+ * time as it slides past them.
+ */
+TEST(rateCounterTest, slidingTest) {
+	rate_counter counter(100, 10);
+	ASSERT_FLOAT_EQ(100, counter.getWindowMs());
+	counter.add(5, 100);
+	counter.add(15, 50);
+	ASSERT_EQ(150, counter.getTotal(15));
+	ASSERT_FLOAT_EQ(1.5, counter.getRatePerMs(15));
+	ASSERT_EQ(150, counter.getTotal(99));
+	ASSERT_EQ(50, counter.getTotal(104));
+	ASSERT_EQ(0, counter.getTotal(115));
+
+	// Reading doesn't change anything; adding slides the window for real.
+	ASSERT_EQ(150, counter.getTotal(99));
+	counter.add(104, 1);
+	ASSERT_EQ(51, counter.getTotal(104));
+}
+
+/*
+ * A long idle gap empties the window in one go, and amounts from before
+ * the window are ignored.
+ */
+TEST(rateCounterTest, idleGapTest) {
+	rate_counter counter(100, 10);
+	counter.add(5, 10);
+	counter.add(1e7, 20);
+	ASSERT_EQ(20, counter.getTotal(1e7));
+	ASSERT_EQ(0, counter.getTotal(2e7));
+
+	counter.add(1e7 - 50, 3);
+	ASSERT_EQ(23, counter.getTotal(1e7));
+	counter.add(1e7 - 500, 4);
+	ASSERT_EQ(23, counter.getTotal(1e7));
+
+	counter.setWindow(1000, 4);
+	ASSERT_EQ(0, counter.getTotal(1e7));
+	ASSERT_FLOAT_EQ(1000, counter.getWindowMs());
+}
+
+/*
+ * Links count the bytes and packets of each type that go through them, and
+ * flows the FLOW packets they receive.
+ */
+TEST(rateCounterTest, linkAndFlowTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netlink link("L1", 10, 10, 64, h1, h2);
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	packet data(FLOW, flow, 1), ack(ACK, flow, 1);
+
+	link.updateLinkTraffic(10, data);
+	link.updateLinkTraffic(20, ack);
+	link.updateLinkTraffic(30, data);
+	ASSERT_EQ(2, link.getPacketsCarried(FLOW));
+	ASSERT_EQ(1, link.getPacketsCarried(ACK));
+	ASSERT_EQ(0, link.getPacketsCarried(ROUTING));
+	double bytes_per_sec = (2 * FLOW_PACKET_SIZE + ACK_PACKET_SIZE) * 1000.0 /
+			RATE_INTERVAL;
+	ASSERT_FLOAT_EQ(bytes_per_sec * 8 / 1000000, link.getRateMbps(30));
+	ASSERT_EQ(0, link.getRateMbps(30 + 2 * RATE_INTERVAL));
+
+	flow.updatePktTally(10);
+	flow.updatePktTally(30);
+	ASSERT_EQ(2, flow.getPktTally(30));
+	ASSERT_FLOAT_EQ(2 * FLOW_PACKET_SIZE * 1000.0 / RATE_INTERVAL,
+			flow.getFlowRateBytesPerSec(30));
+	flow.setRateWindow(10, 1);
+	ASSERT_EQ(0, flow.getPktTally(30));
+}
+
+#endif // TEST_RATE_COUNTER_CPP
@@ -0,0 +1,215 @@
+/**
+ * @file
+ *
+ * Tests the ring_buffer class and the link buffer built on it.
+ */
+
+#ifndef TEST_RING_BUFFER_CPP
+#define TEST_RING_BUFFER_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+ * Elements come out in the order they went in, including after the indices
+ * wrap around, and a full queue turns new elements away.
+ */
+TEST(ringBufferTest, wrapAroundTest) {
+	ring_buffer<int> ring;
+	ring.setCapacity(3);
+	ASSERT_TRUE(ring.empty());
+
+	int next_in = 0, next_out = 0;
+	for (int round = 0; round < 5; round++) {
+		while (ring.push_back(next_in)) {
+			next_in++;
+		}
+		ASSERT_TRUE(ring.full());
+		ASSERT_EQ(3, ring.size());
+		ASSERT_EQ(next_in - 1, ring.back());
+		ASSERT_EQ(next_out + 1, ring[1]);
+
+		// Take out two so the next round's pushes wrap.
+		for (int i = 0; i < 2; i++) {
+			ASSERT_EQ(next_out, ring.front());
+			ring.pop_front();
+			next_out++;
+		}
+	}
+	ASSERT_EQ(1, ring.size());
+	ASSERT_EQ(next_in - 1, ring.front());
+}
+
+/*
+ * The link keeps its occupancy and free-at time up to date as packets come
+ * and go, and only the packet at the front can be dequeued.
+ */
+TEST(ringBufferTest, linkBufferTest) {
+	simulation sim;
+	netlink link("L1", 8, 10, 2);
+	nethost h1("H1", link), h2("H2", link);
+	link.setEndpoint1(h1);
+	link.setEndpoint2(h2);
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	packet p1(FLOW, flow, 1), p2(ACK, flow, 1), p3(FLOW, flow, 2);
+
+	ASSERT_EQ(0, link.getBufferOccupancy());
+	ASSERT_EQ(0, link.getLinkFreeAtTime(&h1));
+
+	ASSERT_TRUE(link.sendPacket(p1, &h2, true, 0));
+	double p1_arrival = link.getLinkFreeAtTime(&h1);
+	ASSERT_FLOAT_EQ(10 + link.getTransmissionTimeMs(p1), p1_arrival);
+	ASSERT_TRUE(link.sendPacket(p2, &h1, false, 0));
+	ASSERT_EQ(1024 + 64, link.getBufferOccupancy());
+	ASSERT_FLOAT_EQ(p1_arrival + link.getTransmissionTimeMs(p2),
+			link.getLinkFreeAtTime(&h1));
+
+	// Another 1024 bytes would overflow the 2 KB buffer.
+	ASSERT_FALSE(link.sendPacket(p3, &h2, false, 0));
+	ASSERT_EQ(1, link.getPktLoss());
+
+	ASSERT_FALSE(link.receivedPacket(p2.getId(), &h1)); // not at the front
+	ASSERT_TRUE(link.receivedPacket(p1.getId(), &h2));
+	ASSERT_EQ(64, link.getBufferOccupancy());
+	ASSERT_TRUE(link.receivedPacket(p2.getId(), &h1));
+	ASSERT_EQ(0, link.getBufferOccupancy());
+	ASSERT_EQ(0, link.getLinkFreeAtTime(&h1));
+	ASSERT_FALSE(link.receivedPacket(p1.getId(), &h2));
+}
+
+/*
+ * A full-duplex link queues each direction separately: traffic one way
+ * doesn't wait for, or take buffer space from, traffic the other way, and
+ * back-to-back packets each pay the propagation delay but pipeline behind
+ * one another's transmission.
+ */
+TEST(ringBufferTest, fullDuplexTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netlink link("L1", 8, 10, 2, h1, h2, true);
+	h1.setLink(link);
+	h2.setLink(link);
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	packet p1(FLOW, flow, 1), p2(FLOW, flow, 2), p3(FLOW, flow, 3);
+	packet a1(ACK, flow, 1);
+	double tx = link.getTransmissionTimeMs(p1);
+	ASSERT_TRUE(link.isFullDuplex());
+
+	ASSERT_TRUE(link.sendPacket(p1, &h2, false, 0));
+	ASSERT_TRUE(link.sendPacket(p2, &h2, false, 0));
+	ASSERT_FLOAT_EQ(2 * tx + 10, link.getLinkFreeAtTime(&h1));
+
+	// The other direction is idle, so the ACK goes straight out.
+	ASSERT_FLOAT_EQ(link.getTransmissionTimeMs(a1) + 10,
+			link.getArrivalTime(a1, &h1, false, 0));
+	ASSERT_TRUE(link.sendPacket(a1, &h1, false, 0));
+	ASSERT_FLOAT_EQ(link.getTransmissionTimeMs(a1) + 10,
+			link.getLinkFreeAtTime(&h2));
+
+	// The 2 KB toward H2 is used up, but that's all.
+	ASSERT_FALSE(link.sendPacket(p3, &h2, false, 0));
+	ASSERT_EQ(2048 + 64, link.getBufferOccupancy());
+
+	// Once the first packet is through, the next one goes out right away.
+	ASSERT_TRUE(link.receivedPacket(p1.getId(), &h2));
+	ASSERT_FLOAT_EQ(3 * tx + 10, link.getArrivalTime(p3, &h2, false, tx));
+	ASSERT_FLOAT_EQ(tx + 50, link.getArrivalTime(p3, &h2, false, 40));
+
+	ASSERT_FALSE(link.receivedPacket(a1.getId(), &h2)); // wrong direction
+	ASSERT_TRUE(link.receivedPacket(a1.getId(), &h1));
+	ASSERT_TRUE(link.receivedPacket(p2.getId(), &h2));
+	ASSERT_EQ(0, link.getBufferOccupancy());
+}
+
+/*
+ * A full-duplex link's buffer only holds packets waiting for the
+ * transmitter, so a link whose bandwidth-delay product is bigger than its
+ * buffer keeps taking packets as fast as it sends them.
+ */
+TEST(ringBufferTest, fullDuplexPipeTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netlink link("L1", 10, 10, 4, h1, h2, true);
+	h1.setLink(link);
+	h2.setLink(link);
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	vector<packet> sent;
+
+	// Ten packets 1 ms apart: each is on the wire before the next comes,
+	// and together they're more than the buffer holds.
+	for (int i = 0; i < 10; i++) {
+		packet pkt(FLOW, flow, i + 1);
+		ASSERT_TRUE(link.sendPacket(pkt, &h2, false, i));
+		ASSERT_EQ(FLOW_PACKET_SIZE, link.getBufferOccupancy());
+		sent.push_back(pkt);
+	}
+	ASSERT_EQ(0, link.getBufferOccupancy(9.9));
+
+	// A burst still only gets the buffer's worth.
+	for (int i = 0; i < 5; i++) {
+		packet pkt(FLOW, flow, i + 11);
+		ASSERT_EQ(i < 4, link.sendPacket(pkt, &h2, false, 10));
+		if (i < 4) {
+			sent.push_back(pkt);
+		}
+	}
+	ASSERT_EQ(4 * FLOW_PACKET_SIZE, link.getBufferOccupancy());
+
+	for (unsigned i = 0; i < sent.size(); i++) {
+		ASSERT_TRUE(link.receivedPacket(sent[i].getId(), &h2));
+	}
+	ASSERT_EQ(0, link.getBufferOccupancy());
+}
+
+/*
+ * A link with an ECN threshold marks the ECN-capable packets that find at
+ * least that much waiting ahead of them, and leaves the rest alone. The
+ * packet being transmitted and those on the wire don't count.
+ */
+TEST(ringBufferTest, ecnMarkingTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netlink link("L1", 8, 10, 8, h1, h2, true);
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	ASSERT_FALSE(link.marksEcn());
+	link.setEcnThreshold(2);
+	ASSERT_TRUE(link.marksEcn());
+
+	packet pkts[5] = { packet(FLOW, flow, 1), packet(FLOW, flow, 2),
+			packet(FLOW, flow, 3), packet(FLOW, flow, 4),
+			packet(FLOW, flow, 5) };
+	for (int i = 0; i < 4; i++) {
+		pkts[i].setEcnCapable(true);
+	}
+	for (int i = 0; i < 5; i++) {
+		ASSERT_TRUE(link.sendPacket(pkts[i], &h2, false, 0));
+	}
+	ASSERT_FALSE(pkts[0].isEcnMarked());
+	ASSERT_FALSE(pkts[1].isEcnMarked());
+	ASSERT_FALSE(pkts[2].isEcnMarked()); // the first is going out
+	ASSERT_TRUE(pkts[3].isEcnMarked());
+	ASSERT_FALSE(pkts[4].isEcnMarked()); // not ECN-capable
+	ASSERT_EQ(1, link.getPacketsMarked());
+
+	// Once they've all gone out they're still on the wire, but nothing's
+	// waiting.
+	double sent = 5 * link.getTransmissionTimeMs(pkts[0]);
+	ASSERT_LT(sent, link.getDelay());
+	packet late(FLOW, flow, 6);
+	late.setEcnCapable(true);
+	ASSERT_TRUE(link.sendPacket(late, &h2, false, sent + 0.1));
+	ASSERT_FALSE(late.isEcnMarked());
+
+	// The copy in the buffer is marked too, and the threshold is per
+	// direction.
+	packet ack(ACK, flow, 1);
+	ack.setEcnCapable(true);
+	ASSERT_TRUE(link.sendPacket(ack, &h1, false, 0));
+	ASSERT_FALSE(ack.isEcnMarked());
+}
+
+#endif // TEST_RING_BUFFER_CPP
@@ -0,0 +1,289 @@
+/**
+ * @file
+ *
+ * Tests the event schedulers. The multimap scheduler is the reference
+ * implementation; the others must pop events in exactly the same order,
+ * i.e. by time and then by event ID.
+ */
+
+#ifndef TEST_SCHEDULER_CPP
+#define TEST_SCHEDULER_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+/*
+ * This is a "test fixture" that sets up things we need in the actual unit
+ * tests below. Note that an object of this class is created before
+ * each test case begins and is torn down when each test case ends.
+ */
+class schedulerTest : public ::testing::Test {
+protected:
+
+	simulation sim;
+
+	/* Every event made by a test, so they can be deleted afterwards. */
+	vector<event *> made;
+
+	/*
+	 * An event can only be in one scheduler at a time, so every event pushed
+	 * onto the reference scheduler has a twin, made right after it, that's
+	 * pushed onto the candidate.
+	 */
+	map<event *, event *> twin;
+
+	/* Reference scheduler and the one being checked against it. */
+	event_scheduler *reference;
+	event_scheduler *candidate;
+
+	/* Simple deterministic pseudo-random numbers in [0, 1). */
+	unsigned long seed;
+
+	double nextRandom() {
+		seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+		return (seed >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	/*
+	 * Makes an event at the given time and its twin.
+	 * @return the reference scheduler's event
+	 */
+	event *makeTwins(double time) {
+		event *e = new event(time, sim);
+		event *t = new event(time, sim);
+		made.push_back(e);
+		made.push_back(t);
+		twin[e] = t;
+		return e;
+	}
+
+	/*
+	 * Makes an event at the given time and pushes it onto both schedulers.
+	 * @return the reference scheduler's event
+	 */
+	event *pushBoth(double time) {
+		event *e = makeTwins(time);
+		reference->push(e);
+		candidate->push(twin[e]);
+		return e;
+	}
+
+	/*
+	 * Makes an event some random time after the given one. Sometimes it's
+	 * simultaneous, sometimes it's a TIME_EPSILON away, like the packet
+	 * bursts in the real simulation.
+	 */
+	event *pushBothAfter(double now) {
+		double r = nextRandom();
+		if (r < 0.2) {
+			return pushBoth(now);
+		}
+		if (r < 0.4) {
+			return pushBoth(now + netflow::TIME_EPSILON);
+		}
+		return pushBoth(now + 50 * nextRandom());
+	}
+
+	/*
+	 * Pops both schedulers and checks they gave back twins.
+	 * @return the reference scheduler's event
+	 */
+	event *popBoth() {
+		event *expected = reference->pop();
+		event *actual = candidate->pop();
+		EXPECT_EQ(expected == NULL ? NULL : twin[expected], actual);
+		EXPECT_EQ(reference->size(), candidate->size());
+		return expected;
+	}
+
+	/*
+	 * Runs the "hold" model that event-driven simulations follow: pop the
+	 * earliest event then push one or two in its future, then drain.
+	 */
+	void runHoldModel() {
+		for (int i = 0; i < 500; i++) {
+			pushBoth(1000 * nextRandom());
+		}
+		for (int i = 0; i < 20000; i++) {
+			event *e = popBoth();
+			ASSERT_TRUE(e != NULL);
+			pushBothAfter(e->getTime());
+			if (i % 3 == 0) {
+				pushBothAfter(e->getTime());
+			}
+		}
+		while (!reference->empty()) {
+			popBoth();
+		}
+		ASSERT_TRUE(candidate->empty());
+		ASSERT_TRUE(candidate->pop() == NULL);
+	}
+
+	/*
+	 * Pushes a batch of simultaneous events in a scrambled order and checks
+	 * they come out in ID order.
+	 */
+	void runSimultaneousEvents() {
+		vector<event *> byId;
+		for (int i = 0; i < 300; i++) {
+			byId.push_back(makeTwins(42));
+		}
+		vector<event *> scrambled = byId;
+		for (unsigned int i = scrambled.size() - 1; i > 0; i--) {
+			swap(scrambled[i], scrambled[(unsigned int) (nextRandom() * (i + 1))]);
+		}
+		for (unsigned int i = 0; i < scrambled.size(); i++) {
+			reference->push(scrambled[i]);
+			candidate->push(twin[scrambled[i]]);
+		}
+		for (unsigned int i = 0; i < byId.size(); i++) {
+			ASSERT_EQ(byId[i], popBoth());
+		}
+	}
+
+	/*
+	 * Removes every third of a batch of random events from both schedulers
+	 * and checks the remaining ones still come out in the same order.
+	 */
+	void runRemove() {
+		vector<event *> pushed;
+		for (int i = 0; i < 2000; i++) {
+			pushed.push_back(pushBoth(100 * nextRandom()));
+		}
+		for (unsigned int i = 0; i < pushed.size(); i += 3) {
+			ASSERT_TRUE(reference->remove(pushed[i]));
+			ASSERT_TRUE(candidate->remove(twin[pushed[i]]));
+			ASSERT_FALSE(candidate->remove(twin[pushed[i]])); // already gone
+			ASSERT_FALSE(twin[pushed[i]]->isQueued());
+		}
+		while (!reference->empty()) {
+			popBoth();
+		}
+	}
+
+	/*
+	 * Moves random events to new times, earlier and later, like timers that
+	 * keep getting pushed back. Also reschedules events that were just popped,
+	 * which should put them back on the queue.
+	 */
+	void runReschedule() {
+		vector<event *> pushed;
+		for (int i = 0; i < 2000; i++) {
+			pushed.push_back(pushBoth(100 * nextRandom()));
+		}
+		for (int round = 0; round < 5; round++) {
+			for (unsigned int i = round; i < pushed.size(); i += 3) {
+				double time = 200 * nextRandom();
+				reference->reschedule(pushed[i], time);
+				candidate->reschedule(twin[pushed[i]], time);
+				ASSERT_TRUE(twin[pushed[i]]->isQueued());
+				ASSERT_EQ(time, twin[pushed[i]]->getTime());
+			}
+			for (int i = 0; i < 100; i++) {
+				event *e = popBoth();
+				ASSERT_FALSE(twin[e]->isQueued());
+				double time = e->getTime() + 10;
+				reference->reschedule(e, time);
+				candidate->reschedule(twin[e], time);
+			}
+		}
+		ASSERT_EQ(2000, candidate->size());
+		while (!reference->empty()) {
+			popBoth();
+		}
+	}
+
+	void makeSchedulers(scheduler_type type) {
+		reference = event_scheduler::makeScheduler(MULTIMAP_SCHEDULER);
+		candidate = event_scheduler::makeScheduler(type);
+	}
+
+	virtual void SetUp() {
+		seed = 143;
+		reference = NULL;
+		candidate = NULL;
+	}
+
+	virtual void TearDown() {
+		delete reference;
+		delete candidate;
+		for (unsigned int i = 0; i < made.size(); i++) {
+			delete made[i];
+		}
+	}
+};
+
+TEST_F(schedulerTest, calendarMatchesMultimapHoldTest) {
+	makeSchedulers(CALENDAR_SCHEDULER);
+	runHoldModel();
+}
+
+TEST_F(schedulerTest, heapMatchesMultimapHoldTest) {
+	makeSchedulers(HEAP_SCHEDULER);
+	runHoldModel();
+}
+
+/*
+ * Checks that simultaneous events come out in ID order, including across
+ * resizes of the calendar.
+ */
+TEST_F(schedulerTest, calendarSimultaneousEventsTest) {
+	makeSchedulers(CALENDAR_SCHEDULER);
+	runSimultaneousEvents();
+}
+
+TEST_F(schedulerTest, heapSimultaneousEventsTest) {
+	makeSchedulers(HEAP_SCHEDULER);
+	runSimultaneousEvents();
+}
+
+TEST_F(schedulerTest, calendarRemoveTest) {
+	makeSchedulers(CALENDAR_SCHEDULER);
+	runRemove();
+}
+
+TEST_F(schedulerTest, heapRemoveTest) {
+	makeSchedulers(HEAP_SCHEDULER);
+	runRemove();
+}
+
+TEST_F(schedulerTest, calendarRescheduleTest) {
+	makeSchedulers(CALENDAR_SCHEDULER);
+	runReschedule();
+}
+
+TEST_F(schedulerTest, heapRescheduleTest) {
+	makeSchedulers(HEAP_SCHEDULER);
+	runReschedule();
+}
+
+/*
+ * Checks that the calendar grows and shrinks its number of buckets.
+ */
+TEST_F(schedulerTest, calendarResizeTest) {
+	calendar_scheduler cal;
+
+	for (int i = 0; i < 1000; i++) {
+		event *e = new event(i * 0.5, sim);
+		made.push_back(e);
+		cal.push(e);
+	}
+	ASSERT_EQ(1000, cal.size());
+	ASSERT_GE(cal.getNumBuckets(), 500u);
+	ASSERT_LE(cal.getNumBuckets(), 1024u);
+
+	for (int i = 0; i < 1000; i++) {
+		ASSERT_FLOAT_EQ(i * 0.5, cal.pop()->getTime());
+	}
+	ASSERT_TRUE(cal.empty());
+	ASSERT_LE(cal.getNumBuckets(), 4u);
+}
+
+#endif // TEST_SCHEDULER_CPP
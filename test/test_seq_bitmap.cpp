@@ -0,0 +1,70 @@
+/**
+ * @file
+ *
+ * Tests the seq_bitmap class the destination uses to track received packets.
+ */
+
+#ifndef TEST_SEQ_BITMAP_CPP
+#define TEST_SEQ_BITMAP_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+ * Packets arriving in order move the first missing one along, and the
+ * bitmap stays one word however many go by.
+ */
+TEST(seqBitmapTest, inOrderTest) {
+	seq_bitmap bitmap(1);
+	ASSERT_EQ(1, bitmap.getNextMissing());
+	ASSERT_FALSE(bitmap.test(1));
+	for (int seq = 1; seq <= 1000; seq++) {
+		ASSERT_TRUE(bitmap.set(seq));
+		ASSERT_EQ(seq + 1, bitmap.getNextMissing());
+	}
+	ASSERT_EQ(64u, bitmap.capacity());
+	ASSERT_TRUE(bitmap.test(1));
+	ASSERT_TRUE(bitmap.test(1000));
+	ASSERT_FALSE(bitmap.test(1001));
+
+	// Duplicates are reported as such.
+	ASSERT_FALSE(bitmap.set(500));
+	ASSERT_FALSE(bitmap.set(1000));
+}
+
+/*
+ * A hole holds the first missing packet back while later ones arrive, and
+ * filling it jumps past everything received since, across word boundaries.
+ */
+TEST(seqBitmapTest, holeTest) {
+	seq_bitmap bitmap(1);
+	ASSERT_TRUE(bitmap.set(1));
+	for (int seq = 3; seq <= 200; seq++) {
+		ASSERT_TRUE(bitmap.set(seq));
+		ASSERT_EQ(2, bitmap.getNextMissing());
+	}
+	ASSERT_EQ(256u, bitmap.capacity());
+	ASSERT_FALSE(bitmap.test(2));
+	ASSERT_TRUE(bitmap.test(150));
+	ASSERT_FALSE(bitmap.set(150));
+
+	// Leave another hole further on, then fill the first.
+	ASSERT_TRUE(bitmap.set(202));
+	ASSERT_TRUE(bitmap.set(2));
+	ASSERT_EQ(201, bitmap.getNextMissing());
+	ASSERT_TRUE(bitmap.set(201));
+	ASSERT_EQ(203, bitmap.getNextMissing());
+
+	// The window sliding on doesn't need more room.
+	for (int seq = 203; seq <= 5000; seq++) {
+		ASSERT_TRUE(bitmap.set(seq));
+	}
+	ASSERT_EQ(5001, bitmap.getNextMissing());
+	ASSERT_EQ(256u, bitmap.capacity());
+}
+
+#endif // TEST_SEQ_BITMAP_CPP
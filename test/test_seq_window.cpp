@@ -0,0 +1,124 @@
+/**
+ * @file
+ *
+ * Tests the seq_window class and the flow's RTT table built on it.
+ */
+
+#ifndef TEST_SEQ_WINDOW_CPP
+#define TEST_SEQ_WINDOW_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * A window that slides along keeps the values in its range, stays as small
+ * as the range, and grows without losing anything when the range does.
+ */
+TEST(seqWindowTest, slideAndGrowTest) {
+	seq_window<double> window(1, 4);
+	for (int seq = 1; seq <= 1000; seq++) {
+		window.forgetBefore(seq - 2);
+		window.record(seq, -seq);
+	}
+	ASSERT_EQ(4u, window.capacity());
+	ASSERT_FALSE(window.contains(997));
+	ASSERT_TRUE(window.contains(998));
+	ASSERT_FLOAT_EQ(-998, window.at(998));
+	ASSERT_FLOAT_EQ(-1000, window.at(1000));
+	ASSERT_FALSE(window.contains(1001));
+
+	// Ten in flight at once; the values recorded earlier survive the move.
+	for (int seq = 1001; seq <= 1007; seq++) {
+		window.record(seq, -seq);
+	}
+	ASSERT_EQ(16u, window.capacity());
+	for (int seq = 998; seq <= 1007; seq++) {
+		ASSERT_FLOAT_EQ(-seq, window.at(seq));
+	}
+
+	// Recording again replaces, e.g. for a retransmission.
+	window.record(999, -2000);
+	ASSERT_FLOAT_EQ(-2000, window.at(999));
+	ASSERT_TRUE(window.contains(1007));
+}
+
+/*
+ * The flow keeps start times for the packets it sends, and forgets them
+ * once they're acknowledged.
+ */
+TEST(seqWindowTest, flowRttTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	vector<packet> sent = flow.popOutstandingPackets(1000, 0);
+	ASSERT_LT(0u, sent.size());
+	ASSERT_FLOAT_EQ(-1000, flow.getRoundTripTimes().at(1));
+	ASSERT_FALSE(flow.getRoundTripTimes().contains(0));
+}
+
+/*
+ * After a fast retransmit, the ACK for the resent packet can cover packets
+ * the receiver already had, and the go-back that follows resends some of
+ * them. Their start times aren't kept, since they're already acknowledged.
+ */
+TEST(seqWindowTest, goBackTest) {
+	simulation sim;
+	nethost h1("H1"), h2("H2");
+	netflow flow("F1", 1, 20, h1, h2, false, sim);
+	flow.setCongestionControl(
+			congestion_control::makeCongestionControl(TAHOE_CC, flow, 10));
+	ASSERT_EQ(10u, flow.popOutstandingPackets(0, 0).size());
+
+	// Packet 2 is lost: 2 is acknowledged, then duplicated until the
+	// flow resends it on its own.
+	for (int i = 0; i <= netflow::FAST_RETRANSMIT_DUPLICATE_ACK_THRESHOLD;
+			i++) {
+		packet ack(ACK, flow, 2);
+		flow.receivedAck(ack, 100 + i, 0);
+	}
+	vector<packet> sent = flow.popOutstandingPackets(110, 0);
+	ASSERT_EQ(1u, sent.size());
+	ASSERT_EQ(2, sent[0].getSeq());
+
+	// The receiver had 3 through 10 all along.
+	packet ack(ACK, flow, 11);
+	flow.receivedAck(ack, 200, 0);
+	sent = flow.popOutstandingPackets(200, 0);
+	ASSERT_LT(0u, sent.size());
+	ASSERT_EQ(3, sent[0].getSeq());
+	for (unsigned i = 0; i < sent.size(); i++) {
+		ASSERT_EQ(sent[i].getSeq() >= 11,
+				flow.getRoundTripTimes().contains(sent[i].getSeq()));
+	}
+}
+
+/*
+ * The same, end to end: the first test case, with its link made
+ * full-duplex so that ACKs come back while the window's still going out,
+ * runs to completion.
+ */
+TEST(seqWindowTest, fullDuplexGoBackTest) {
+	ifstream input("input_files/test_case_0_tahoe");
+	stringstream json;
+	json << input.rdbuf();
+	string network = json.str();
+	size_t at = network.find("\"buf_len\"");
+	ASSERT_NE(string::npos, at);
+	network.insert(at, "\"full_duplex\": true, ");
+
+	simulation sim;
+	sim.parse_JSON_input(network);
+	ASSERT_TRUE(sim.getLinks().find("L1")->isFullDuplex());
+	sim.runSimulation();
+	ASSERT_TRUE(sim.allFlowsDone());
+}
+
+#endif // TEST_SEQ_WINDOW_CPP
@@ -17,9 +17,48 @@
 #include <iostream>
 #include <cstdlib>
 #include <string.h>
+#include <thread>
 
 using namespace std;
 
+/** Two hosts with a router between them, and one Tahoe flow. */
+static const char *TWO_HOP_NETWORK = "{ \"hosts\": [ \"H1\", \"H2\" ], "
+		"\"routers\": [ \"R1\" ], "
+		"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+		"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"R1\" }, "
+		"{ \"id\": \"L2\", \"rate\": 10, \"delay\": 10, "
+		"\"buf_len\": 64, \"endpt_1\": \"R1\", \"endpt_2\": \"H2\" } ], "
+		"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+		"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0, "
+		"\"FAST\": false } ] }";
+
+/** The same network with full-duplex links. */
+static const char *FULL_DUPLEX_TWO_HOP_NETWORK =
+		"{ \"hosts\": [ \"H1\", \"H2\" ], "
+		"\"routers\": [ \"R1\" ], "
+		"\"links\": [ { \"id\": \"L1\", \"rate\": 10, \"delay\": 10, "
+		"\"buf_len\": 64, \"endpt_1\": \"H1\", \"endpt_2\": \"R1\", "
+		"\"full_duplex\": true }, "
+		"{ \"id\": \"L2\", \"rate\": 10, \"delay\": 10, "
+		"\"buf_len\": 64, \"endpt_1\": \"R1\", \"endpt_2\": \"H2\", "
+		"\"full_duplex\": true } ], "
+		"\"flows\": [ { \"id\": \"F1\", \"src\": \"H1\", "
+		"\"dst\": \"H2\", \"size\": 1, \"start\": 1.0, "
+		"\"FAST\": false } ] }";
+
+/*
+ * Runs a two-hop network to completion.
+ * @param completion_ms out parameter, the flow's completion time
+ * @param network JSON input, @c TWO_HOP_NETWORK by default
+ */
+static void runTwoHopNetwork(double *completion_ms,
+		const char *network = TWO_HOP_NETWORK) {
+	simulation sim;
+	sim.parse_JSON_input(network);
+	sim.runSimulation();
+	*completion_ms = sim.getFlows().find("F1")->getCompletionTimeMs();
+}
+
 /*
  * This is a "test fixture" that sets up things we need in the actual unit
  * tests below. Note that an object of this class is created before
@@ -63,4 +102,39 @@ TEST_F(simulationTest, Simulation) {
 	cout << endl;
 }
 
+/*
+ * Simulations don't share state, so two of them running on different
+ * threads get exactly the same results as one running alone.
+ */
+TEST_F(simulationTest, concurrentSimulationsTest) {
+	// Run everything on other threads so this thread's event IDs, which
+	// other tests look at, aren't used up.
+	double alone;
+	thread t0(runTwoHopNetwork, &alone, TWO_HOP_NETWORK);
+	t0.join();
+	ASSERT_LT(1000, alone);
+
+	double first, second;
+	thread t1(runTwoHopNetwork, &first, TWO_HOP_NETWORK);
+	thread t2(runTwoHopNetwork, &second, TWO_HOP_NETWORK);
+	t1.join();
+	t2.join();
+	ASSERT_EQ(alone, first);
+	ASSERT_EQ(alone, second);
+}
+
+/*
+ * ACKs don't wait behind data on full-duplex links, so the same transfer
+ * finishes sooner than on half-duplex ones.
+ */
+TEST_F(simulationTest, fullDuplexTest) {
+	double half, full;
+	thread t_half(runTwoHopNetwork, &half, TWO_HOP_NETWORK);
+	thread t_full(runTwoHopNetwork, &full, FULL_DUPLEX_TWO_HOP_NETWORK);
+	t_half.join();
+	t_full.join();
+	ASSERT_LT(1000, full);
+	ASSERT_LT(full, half);
+}
+
 #endif // TEST_SIMULATION_CPP
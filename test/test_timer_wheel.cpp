@@ -0,0 +1,205 @@
+/**
+ * @file
+ *
+ * Tests the timer wheel. However timers are armed, cancelled, and re-armed,
+ * draining the wheel and its queue together must give the events back in
+ * the same order as a plain scheduler would, i.e. by time and then by ID.
+ */
+
+#ifndef TEST_TIMER_WHEEL_CPP
+#define TEST_TIMER_WHEEL_CPP
+
+// Standard includes.
+#include "gtest/gtest.h"
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <set>
+#include <utility>
+
+using namespace std;
+
+/*
+ * This is a "test fixture" that sets up things we need in the actual unit
+ * tests below. Note that an object of this class is created before
+ * each test case begins and is torn down when each test case ends.
+ */
+class timerWheelTest : public ::testing::Test {
+protected:
+
+	simulation sim;
+
+	/* Every event made by a test, so they can be deleted afterwards. */
+	vector<event *> made;
+
+	/* Queue that due timers go into, and the wheel itself. */
+	event_scheduler *queue;
+	timer_wheel *wheel;
+
+	/* Time and ID of every event in the queue or the wheel. */
+	set<pair<double, long> > pending;
+
+	/* Simple deterministic pseudo-random numbers in [0, 1). */
+	unsigned long seed;
+
+	double nextRandom() {
+		seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+		return (seed >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	/*
+	 * Makes an event at the given time and arms it.
+	 * @return the event
+	 */
+	event *armNew(double time) {
+		event *e = new event(time, sim);
+		made.push_back(e);
+		wheel->arm(e);
+		pending.insert(make_pair(time, e->getId()));
+		return e;
+	}
+
+	/*
+	 * Disarms a timer and re-arms it at a new time, the way a flow's
+	 * retransmission timer is pushed back.
+	 */
+	void rearm(event *e, double time) {
+		pending.erase(make_pair(e->getTime(), e->getId()));
+		ASSERT_TRUE(wheel->cancel(e));
+		e->setTime(time);
+		wheel->arm(e);
+		pending.insert(make_pair(time, e->getId()));
+	}
+
+	/*
+	 * Pops the next event the way the simulation loop does and checks that
+	 * it's the earliest pending one.
+	 * @return the event, or NULL if there are none left
+	 */
+	event *popNext() {
+		if (queue->empty()) {
+			if (!wheel->advanceToNext()) {
+				EXPECT_TRUE(pending.empty());
+				return NULL;
+			}
+		}
+		else {
+			wheel->advanceTo(queue->peek()->getTime());
+		}
+		event *e = queue->pop();
+		EXPECT_EQ(pending.begin()->first, e->getTime());
+		EXPECT_EQ(pending.begin()->second, e->getId());
+		pending.erase(pending.begin());
+		return e;
+	}
+
+	virtual void SetUp() {
+		queue = event_scheduler::makeScheduler(HEAP_SCHEDULER);
+		wheel = new timer_wheel(*queue);
+		seed = 7;
+	}
+
+	virtual void TearDown() {
+		while (wheel->removeAny() != NULL) { }
+		while (!queue->empty()) {
+			queue->pop();
+		}
+		delete wheel;
+		delete queue;
+		for (unsigned int i = 0; i < made.size(); i++) {
+			delete made[i];
+		}
+	}
+};
+
+/*
+ * Arms timers spread over every level of the wheel and past its top level,
+ * including several in the same tick and at the same time, cancels some of
+ * them, then drains everything.
+ */
+TEST_F(timerWheelTest, drainOrderTest) {
+	vector<event *> armed;
+	for (int i = 0; i < 3000; i++) {
+		double r = nextRandom();
+		double time;
+		if (i % 3 == 0) {
+			time = 1000 * r;
+		}
+		else if (i % 3 == 1) {
+			time = 5e7 * r;
+		}
+		else {
+			time = (int) (64 * r);
+		}
+		armed.push_back(armNew(time));
+	}
+	ASSERT_EQ(3000, wheel->size());
+
+	for (unsigned int i = 0; i < armed.size(); i += 4) {
+		pending.erase(make_pair(armed[i]->getTime(), armed[i]->getId()));
+		ASSERT_TRUE(wheel->cancel(armed[i]));
+		ASSERT_FALSE(wheel->cancel(armed[i]));
+		ASSERT_FALSE(armed[i]->isScheduled());
+	}
+
+	long popped = 0;
+	while (popNext() != NULL) {
+		popped++;
+	}
+	ASSERT_EQ(2250, popped);
+	ASSERT_EQ(0, wheel->size());
+}
+
+/*
+ * Mixes ordinary queued events with timers that are pushed back, cancelled,
+ * and re-armed while the run is in progress, like a busy flow's timeout.
+ */
+TEST_F(timerWheelTest, interleavedTest) {
+	vector<event *> timers;
+	for (int i = 0; i < 50; i++) {
+		timers.push_back(armNew(100 + 10 * i));
+	}
+	for (int i = 0; i < 200; i++) {
+		event *e = new event(5000 * nextRandom(), sim);
+		made.push_back(e);
+		queue->push(e);
+		pending.insert(make_pair(e->getTime(), e->getId()));
+	}
+
+	double last = 0;
+	event *e;
+	while ((e = popNext()) != NULL) {
+		ASSERT_LE(last, e->getTime());
+		last = e->getTime();
+
+		// Push back a random timer that hasn't gone off yet, sometimes into
+		// the same tick and sometimes far away.
+		if (last < 4000) {
+			event *t = timers[(int) (50 * nextRandom())];
+			if (t->isTimerArmed()) {
+				double delay = nextRandom() < 0.3 ?
+						nextRandom() : 200 * nextRandom();
+				rearm(t, last + delay);
+			}
+		}
+	}
+	ASSERT_EQ(0, wheel->size());
+	ASSERT_TRUE(queue->empty());
+}
+
+/*
+ * A timer armed for a tick the wheel has already passed goes straight into
+ * the queue rather than being lost.
+ */
+TEST_F(timerWheelTest, pastTickTest) {
+	armNew(100);
+	ASSERT_EQ(100, popNext()->getTime());
+
+	event *late = armNew(50.5);
+	ASSERT_EQ(0, wheel->size());
+	ASSERT_TRUE(late->isQueued());
+	ASSERT_EQ(late, popNext());
+	ASSERT_TRUE(popNext() == NULL);
+}
+
+#endif // TEST_TIMER_WHEEL_CPP